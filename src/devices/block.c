@@ -3,7 +3,21 @@
 #include <string.h>
 #include <stdio.h>
 #include "devices/ide.h"
+#include "devices/iotrace.h"
+#include "devices/timer.h"
+#include "threads/interrupt.h"
 #include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+
+/*! Most sectors the dispatcher merges into one transfer. */
+#define BLOCK_MERGE_MAX 64
+
+/*! Microseconds a queued request waits for each priority level it gains,
+    one timer tick, so that even a PRI_MIN request is served within
+    PRI_MAX ticks. */
+#define BLOCK_AGE_USECS (1000 * 1000 / TIMER_FREQ)
 
 /*! A block device. */
 struct block {
@@ -18,6 +32,16 @@ struct block {
 
     unsigned long long read_cnt;        /*!< Number of sectors read. */
     unsigned long long write_cnt;       /*!< Number of sectors written. */
+    struct block_stats stats;           /*!< Requests carried out here. */
+    block_sector_t next_sector;         /*!< End of last request here. */
+
+    /* Request queue, if block_start_queue() was called. */
+    bool queued;                        /*!< Is there a dispatcher? */
+    struct list queue;                  /*!< Pending requests, by sector. */
+    struct lock queue_lock;             /*!< Protects queue and head. */
+    struct condition queue_ready;       /*!< Signaled when queue nonempty. */
+    block_sector_t head;                /*!< Sector after last dispatched. */
+    uint8_t *merge_buf;                 /*!< For merged requests, or null. */
 };
 
 /*! List of all block devices. */
@@ -27,6 +51,18 @@ static struct list all_blocks = LIST_INITIALIZER(all_blocks);
 static struct block *block_by_role[BLOCK_ROLE_CNT];
 
 static struct block *list_elem_to_block(struct list_elem *);
+static void transfer(struct block *, bool write, block_sector_t, size_t cnt,
+                     void *buffer);
+static void complete(struct block_request *);
+static void account_submit(struct block *, const struct block_request *);
+static void account_done(struct block *, const struct block_request *,
+                         int64_t start, int64_t end);
+static void print_hist(const char *name, const char *what,
+                       const unsigned long long hist[BLOCK_HIST_BUCKETS]);
+static bool request_less(const struct list_elem *,
+                         const struct list_elem *, void *aux);
+static struct list_elem *elevator_next(struct block *);
+static void dispatcher(void *block_);
 
 /*! Returns a human-readable name for the given block device TYPE. */
 const char * block_type_name(enum block_type type) {
@@ -98,9 +134,7 @@ static void check_sector(struct block *block, block_sector_t sector) {
     Internally synchronizes accesses to block devices, so external
     per-block device locking is unneeded. */
 void block_read(struct block *block, block_sector_t sector, void *buffer) {
-    check_sector(block, sector);
-    block->ops->read(block->aux, sector, buffer);
-    block->read_cnt++;
+    block_read_multi(block, sector, 1, buffer);
 }
 
 /*! Write sector SECTOR to BLOCK from BUFFER, which must contain
@@ -110,10 +144,147 @@ void block_read(struct block *block, block_sector_t sector, void *buffer) {
     per-block device locking is unneeded. */
 void block_write(struct block *block, block_sector_t sector,
                  const void *buffer) {
+    block_write_multi(block, sector, 1, buffer);
+}
+
+/*! Verifies that the CNT sectors starting at SECTOR all lie within BLOCK.
+    Panics if not. */
+static void check_sectors(struct block *block, block_sector_t sector,
+                          size_t cnt) {
     check_sector(block, sector);
-    ASSERT(block->type != BLOCK_FOREIGN);
-    block->ops->write(block->aux, sector, buffer);
-    block->write_cnt++;
+    if (cnt > block->size - sector) {
+        PANIC("Access past end of device %s (sector=%"PRDSNu", cnt=%zu, "
+              "size=%"PRDSNu")\n", block_name(block), sector, cnt,
+              block->size);
+    }
+}
+
+/*! Reads the CNT consecutive sectors starting at SECTOR from BLOCK into
+    BUFFER, which must have room for CNT * BLOCK_SECTOR_SIZE bytes.  Uses
+    a single driver request if the driver supports it, which for a disk
+    means one command for the whole run instead of one per sector. */
+void block_read_multi(struct block *block, block_sector_t sector, size_t cnt,
+                      void *buffer) {
+    struct block_request req;
+
+    if (cnt == 0)
+        return;
+    block_request_init(&req, false, sector, cnt, buffer, NULL, NULL);
+    block_submit(block, &req);
+    block_wait(&req);
+}
+
+/*! Writes the CNT consecutive sectors starting at SECTOR on BLOCK from
+    BUFFER, which must contain CNT * BLOCK_SECTOR_SIZE bytes.  Returns
+    after the block device has acknowledged receiving all of the data. */
+void block_write_multi(struct block *block, block_sector_t sector,
+                       size_t cnt, const void *buffer) {
+    struct block_request req;
+
+    if (cnt == 0)
+        return;
+    block_request_init(&req, true, sector, cnt, (void *) buffer, NULL, NULL);
+    block_submit(block, &req);
+    block_wait(&req);
+}
+
+/*! Initializes REQ to read (if WRITE is false) or write (if WRITE is true)
+    the CNT sectors starting at SECTOR, from or to BUFFER.  When REQ has
+    been submitted and has completed, DONE is called with REQ, unless DONE
+    is a null pointer.  AUX is stored in REQ for DONE's use. */
+void block_request_init(struct block_request *req, bool write,
+                        block_sector_t sector, size_t cnt, void *buffer,
+                        void (*done)(struct block_request *), void *aux) {
+    ASSERT(cnt > 0);
+    req->write = write;
+    req->sector = sector;
+    req->cnt = cnt;
+    req->buffer = buffer;
+    req->done = done;
+    req->aux = aux;
+    sema_init(&req->finished, 0);
+}
+
+/*! Submits REQ for BLOCK.  If BLOCK, or the device it is mapped onto, has
+    a request queue, REQ joins the queue and this function returns at
+    once; otherwise, REQ is carried out before returning.  Either way, REQ
+    must stay allocated until it completes.
+
+    Queued requests may be reordered with respect to each other, so a
+    caller that needs one write to reach the disk before another must
+    wait for the first to complete before submitting the second. */
+void block_submit(struct block *block, struct block_request *req) {
+    check_sectors(block, req->sector, req->cnt);
+    ASSERT(!req->write || block->type != BLOCK_FOREIGN);
+
+    req->dev_sector = req->sector;
+    req->priority = thread_get_priority();
+    for (;;) {
+        if (req->write)
+            block->write_cnt += req->cnt;
+        else
+            block->read_cnt += req->cnt;
+        if (block->ops->map == NULL)
+            break;
+        block = block->ops->map(block->aux, &req->dev_sector);
+    }
+    req->submitted = timer_usecs();
+    account_submit(block, req);
+    iotrace_record(block, req);
+
+    if (block->ops->submit != NULL) {
+        enum intr_level old_level = intr_disable();
+        block->stats.transfers++;
+        intr_set_level(old_level);
+        block->ops->submit(block->aux, req);
+    }
+    else if (block->queued) {
+        lock_acquire(&block->queue_lock);
+        list_insert_ordered(&block->queue, &req->elem, request_less, NULL);
+        cond_signal(&block->queue_ready, &block->queue_lock);
+        lock_release(&block->queue_lock);
+    }
+    else {
+        transfer(block, req->write, req->dev_sector, req->cnt, req->buffer);
+        account_done(block, req, req->submitted, timer_usecs());
+        complete(req);
+    }
+}
+
+/*! Waits for REQ, which must have been submitted without a completion
+    callback, to complete. */
+void block_wait(struct block_request *req) {
+    ASSERT(req->done == NULL);
+    sema_down(&req->finished);
+}
+
+/*! Makes CAUSE the reason the running thread gives for the block I/O it
+    does from now on, and returns the previous one, for the caller to
+    restore when done. */
+enum block_cause block_set_cause(enum block_cause cause) {
+    struct thread *t = thread_current();
+    enum block_cause old = t->io_cause;
+
+    ASSERT(cause < BLOCK_CAUSE_CNT);
+    t->io_cause = cause;
+    return old;
+}
+
+/*! Returns a short name for CAUSE, such as "writeback". */
+const char * block_cause_name(enum block_cause cause) {
+    static const char *block_cause_names[BLOCK_CAUSE_CNT] = {
+        "other",
+        "cache-fill",
+        "read-ahead",
+        "writeback",
+        "direct",
+        "journal",
+        "swap-in",
+        "swap-out",
+    };
+
+    ASSERT(cause < BLOCK_CAUSE_CNT);
+    return block_cause_names[cause];
 }
 
 /*! Returns the number of sectors in BLOCK. */
@@ -131,7 +302,8 @@ enum block_type block_type(struct block *block) {
     return block->type;
 }
 
-/*! Prints statistics for each block device used for a Pintos role. */
+/*! Prints statistics for each block device used for a Pintos role,
+    followed by the I/O statistics of the devices underneath. */
 void block_print_stats(void) {
     int i;
 
@@ -143,6 +315,46 @@ void block_print_stats(void) {
                    block->read_cnt, block->write_cnt);
         }
     }
+    block_print_io_stats();
+}
+
+/*! Prints the I/O statistics of each block device that has carried out
+    requests: request count and size, how many were sequential, the
+    average and highest queue depth, and histograms of time spent queued
+    and in the driver and of request size. */
+void block_print_io_stats(void) {
+    struct block *block;
+
+    for (block = block_first(); block != NULL; block = block_next(block)) {
+        struct block_stats s;
+        int64_t elapsed;
+        unsigned long long avg_depth;
+
+        block_get_stats(block, &s);
+        if (s.requests == 0)
+            continue;
+        elapsed = timer_usecs() - s.first_usecs;
+        avg_depth = elapsed > 0 ? s.depth_usecs * 100 / elapsed : 0;
+        printf("%s: %llu requests, %llu sectors in %llu transfers, "
+               "%llu%% sequential\n", block->name, s.requests, s.sectors,
+               s.transfers, s.sequential * 100 / s.requests);
+        printf("%s: queue depth %llu.%02llu average, %d max\n",
+               block->name, avg_depth / 100, avg_depth % 100, s.max_depth);
+        print_hist(block->name, "wait (us)", s.wait);
+        print_hist(block->name, "service (us)", s.service);
+        print_hist(block->name, "size (sectors)", s.size);
+    }
+}
+
+/*! Copies BLOCK's I/O statistics into *STATS, with the queue depth
+    accounted up to now. */
+void block_get_stats(struct block *block, struct block_stats *stats) {
+    enum intr_level old_level = intr_disable();
+    int64_t now = timer_usecs();
+    *stats = block->stats;
+    stats->depth_usecs += stats->depth * (now - stats->depth_since);
+    stats->depth_since = now;
+    intr_set_level(old_level);
 }
 
 /*! Registers a new block device with the given NAME.  If EXTRA_INFO is
@@ -164,6 +376,9 @@ struct block * block_register(const char *name, enum block_type type,
     block->aux = aux;
     block->read_cnt = 0;
     block->write_cnt = 0;
+    memset(&block->stats, 0, sizeof block->stats);
+    block->next_sector = 0;
+    block->queued = false;
 
     printf("%s: %'"PRDSNu" sectors (", block->name, block->size);
     print_human_readable_size((uint64_t) block->size * BLOCK_SECTOR_SIZE);
@@ -175,6 +390,267 @@ struct block * block_register(const char *name, enum block_type type,
     return block;
 }
 
+/*! Gives BLOCK a request queue, served by a dispatcher thread that
+    merges adjacent requests and orders them by priority, then with the
+    C-LOOK elevator.  For devices where that order pays, such as disks.
+    See elevator_next() for details. */
+void block_start_queue(struct block *block) {
+    char name[sizeof block->name + 3];
+
+    ASSERT(!block->queued);
+    ASSERT(block->ops->submit == NULL);
+    list_init(&block->queue);
+    lock_init(&block->queue_lock);
+    cond_init(&block->queue_ready);
+    block->head = 0;
+    block->merge_buf = palloc_get_multiple(0, BLOCK_MERGE_MAX
+                                           * BLOCK_SECTOR_SIZE / PGSIZE);
+    block->queued = true;
+
+    snprintf(name, sizeof name, "%s-io", block->name);
+    if (thread_create(name, PRI_MAX, dispatcher, block) == TID_ERROR)
+        PANIC("%s: can't start request dispatcher", block->name);
+}
+
+/*! Called by BLOCK's driver, which has a submit operation, when REQ
+    has completed.  May be called from an interrupt handler.  REQ's time
+    in service runs from its submission, since the block layer does not
+    see how long it waits inside the driver. */
+void block_complete(struct block *block, struct block_request *req) {
+    account_done(block, req, req->submitted, timer_usecs());
+    complete(req);
+}
+
+/*! Returns true if request A_ starts before request B_ on their device. */
+static bool request_less(const struct list_elem *a_,
+                         const struct list_elem *b_, void *aux UNUSED) {
+    const struct block_request *a = list_entry(a_, struct block_request, elem);
+    const struct block_request *b = list_entry(b_, struct block_request, elem);
+    return a->dev_sector < b->dev_sector;
+}
+
+/*! Returns the request in BLOCK's queue, which must not be empty, to
+    serve next.  That is a request of the highest priority, counting the
+    priority of its submitter plus one level for each BLOCK_AGE_USECS it
+    has waited, so that a high-priority thread is not stuck behind a
+    stream of low-priority I/O but the stream still makes progress.
+    Among those requests, C-LOOK picks the first at or after the head,
+    wrapping around to the lowest sector if there is none.  Requests that
+    start at the same sector are served in submission order. */
+static struct list_elem * elevator_next(struct block *block) {
+    int64_t now = timer_usecs();
+    struct list_elem *lowest = NULL;    /* Lowest best, by sector. */
+    struct list_elem *ahead = NULL;     /* First best at or after head. */
+    int best = PRI_MIN - 1;
+    struct list_elem *e;
+
+    ASSERT(lock_held_by_current_thread(&block->queue_lock));
+    for (e = list_begin(&block->queue); e != list_end(&block->queue);
+         e = list_next(e)) {
+        struct block_request *r = list_entry(e, struct block_request, elem);
+        int64_t age = (now - r->submitted) / BLOCK_AGE_USECS;
+        int priority = (age >= PRI_MAX - r->priority
+                        ? PRI_MAX : r->priority + (int) age);
+
+        if (priority > best) {
+            best = priority;
+            lowest = e;
+            ahead = NULL;
+        }
+        if (priority == best && ahead == NULL && r->dev_sector >= block->head)
+            ahead = e;
+    }
+    return ahead != NULL ? ahead : lowest;
+}
+
+/*! Serves BLOCK's request queue. */
+static void dispatcher(void *block_) {
+    struct block *block = block_;
+
+    for (;;) {
+        struct block_request *first, *r;
+        struct list batch;
+        struct list_elem *e;
+        block_sector_t end;
+        int64_t start, finish;
+        size_t cnt;
+
+        /* Take the next request and every request that continues it in
+           the same direction, up to BLOCK_MERGE_MAX sectors, whatever
+           their priority. */
+        lock_acquire(&block->queue_lock);
+        while (list_empty(&block->queue))
+            cond_wait(&block->queue_ready, &block->queue_lock);
+        e = elevator_next(block);
+        first = list_entry(e, struct block_request, elem);
+        e = list_remove(e);
+        list_init(&batch);
+        list_push_back(&batch, &first->elem);
+        end = first->dev_sector + first->cnt;
+        cnt = first->cnt;
+        while (block->merge_buf != NULL && e != list_end(&block->queue)) {
+            r = list_entry(e, struct block_request, elem);
+            if (r->write != first->write || r->dev_sector != end
+                || cnt + r->cnt > BLOCK_MERGE_MAX)
+                break;
+            e = list_remove(e);
+            list_push_back(&batch, &r->elem);
+            end += r->cnt;
+            cnt += r->cnt;
+        }
+        block->head = end;
+        lock_release(&block->queue_lock);
+        start = timer_usecs();
+
+        /* Carry out the batch, through the merge buffer if it holds more
+           than one request. */
+        if (cnt == first->cnt) {
+            transfer(block, first->write, first->dev_sector, cnt,
+                     first->buffer);
+        }
+        else {
+            uint8_t *p = block->merge_buf;
+            if (first->write) {
+                for (e = list_begin(&batch); e != list_end(&batch);
+                     e = list_next(e)) {
+                    r = list_entry(e, struct block_request, elem);
+                    memcpy(p, r->buffer, r->cnt * BLOCK_SECTOR_SIZE);
+                    p += r->cnt * BLOCK_SECTOR_SIZE;
+                }
+            }
+            transfer(block, first->write, first->dev_sector, cnt,
+                     block->merge_buf);
+            if (!first->write) {
+                for (e = list_begin(&batch); e != list_end(&batch);
+                     e = list_next(e)) {
+                    r = list_entry(e, struct block_request, elem);
+                    memcpy(r->buffer, p, r->cnt * BLOCK_SECTOR_SIZE);
+                    p += r->cnt * BLOCK_SECTOR_SIZE;
+                }
+            }
+        }
+        finish = timer_usecs();
+        for (e = list_begin(&batch); e != list_end(&batch); e = list_next(e))
+            account_done(block, list_entry(e, struct block_request, elem),
+                         start, finish);
+        while (!list_empty(&batch))
+            complete(list_entry(list_pop_front(&batch),
+                                struct block_request, elem));
+    }
+}
+
+/*! Has BLOCK's driver read (if WRITE is false) or write (if WRITE is true)
+    the CNT sectors starting at SECTOR, from or to BUFFER. */
+static void transfer(struct block *block, bool write, block_sector_t sector,
+                     size_t cnt, void *buffer) {
+    enum intr_level old_level;
+    size_t i;
+
+    old_level = intr_disable();
+    block->stats.transfers++;
+    intr_set_level(old_level);
+    if (write && block->ops->write_multi != NULL) {
+        block->ops->write_multi(block->aux, sector, cnt, buffer);
+    }
+    else if (!write && block->ops->read_multi != NULL) {
+        block->ops->read_multi(block->aux, sector, cnt, buffer);
+    }
+    else {
+        for (i = 0; i < cnt; i++) {
+            uint8_t *p = (uint8_t *) buffer + i * BLOCK_SECTOR_SIZE;
+            if (write)
+                block->ops->write(block->aux, sector + i, p);
+            else
+                block->ops->read(block->aux, sector + i, p);
+        }
+    }
+}
+
+/*! Adds VALUE to the histogram HIST. */
+static void hist_add(unsigned long long hist[BLOCK_HIST_BUCKETS],
+                     int64_t value) {
+    int bucket = 0;
+
+    while (value > 0 && bucket < BLOCK_HIST_BUCKETS - 1) {
+        value >>= 1;
+        bucket++;
+    }
+    hist[bucket]++;
+}
+
+/*! Records the passage of time at the current queue depth of BLOCK,
+    which is then changed by DELTA.  Interrupts must be off. */
+static void change_depth(struct block *block, int delta) {
+    struct block_stats *s = &block->stats;
+    int64_t now = timer_usecs();
+
+    ASSERT(intr_get_level() == INTR_OFF);
+    s->depth_usecs += s->depth * (now - s->depth_since);
+    s->depth_since = now;
+    s->depth += delta;
+    if (s->depth > s->max_depth)
+        s->max_depth = s->depth;
+}
+
+/*! Accounts for REQ's arrival at BLOCK, the device that carries it out. */
+static void account_submit(struct block *block,
+                           const struct block_request *req) {
+    struct block_stats *s = &block->stats;
+    enum intr_level old_level = intr_disable();
+
+    if (s->requests == 0 && s->depth == 0)
+        s->first_usecs = req->submitted;
+    if (req->dev_sector == block->next_sector)
+        s->sequential++;
+    block->next_sector = req->dev_sector + req->cnt;
+    hist_add(s->size, req->cnt);
+    change_depth(block, +1);
+    intr_set_level(old_level);
+}
+
+/*! Accounts for REQ's completion at BLOCK, having been handed to the
+    driver at START and finished at END. */
+static void account_done(struct block *block, const struct block_request *req,
+                         int64_t start, int64_t end) {
+    struct block_stats *s = &block->stats;
+    enum intr_level old_level = intr_disable();
+
+    s->requests++;
+    s->sectors += req->cnt;
+    hist_add(s->wait, start - req->submitted);
+    hist_add(s->service, end - start);
+    change_depth(block, -1);
+    intr_set_level(old_level);
+}
+
+/*! Prints the nonempty buckets of HIST, a histogram of WHAT for the
+    device NAME, on one line. */
+static void print_hist(const char *name, const char *what,
+                       const unsigned long long hist[BLOCK_HIST_BUCKETS]) {
+    int i;
+
+    printf("%s: %s", name, what);
+    for (i = 0; i < BLOCK_HIST_BUCKETS; i++) {
+        if (hist[i] == 0)
+            continue;
+        if (i == 0)
+            printf(" 0:%llu", hist[i]);
+        else if (i == BLOCK_HIST_BUCKETS - 1)
+            printf(" %lu+:%llu", 1ul << (i - 1), hist[i]);
+        else
+            printf(" %lu-%lu:%llu", 1ul << (i - 1), (1ul << i) - 1, hist[i]);
+    }
+    printf("\n");
+}
+
+/*! Reports that REQ has completed. */
+static void complete(struct block_request *req) {
+    if (req->done != NULL)
+        req->done(req);
+    else
+        sema_up(&req->finished);
+}
+
 /*! Returns the block device corresponding to LIST_ELEM, or a null
     pointer if LIST_ELEM is the list end of all_blocks. */
 static struct block * list_elem_to_block(struct list_elem *list_elem) {
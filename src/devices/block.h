@@ -3,6 +3,8 @@
 
 #include <stddef.h>
 #include <inttypes.h>
+#include <list.h>
+#include "threads/synch.h"
 
 /*! Size of a block device sector in bytes.  All IDE disks use this sector
     size, as do most USB and SCSI disks.  It's not worth it to try to cater
@@ -52,22 +54,117 @@ struct block *block_next(struct block *);
 block_sector_t block_size(struct block *);
 void block_read(struct block *, block_sector_t, void *);
 void block_write(struct block *, block_sector_t, const void *);
+void block_read_multi(struct block *, block_sector_t, size_t cnt, void *);
+void block_write_multi(struct block *, block_sector_t, size_t cnt,
+                       const void *);
 const char *block_name(struct block *);
 enum block_type block_type(struct block *);
 
+/*! A request to read or write consecutive sectors, submitted with
+    block_submit() and owned by the block layer until it completes.  If
+    DONE is non-null, it is called on completion, possibly in another
+    thread or in an interrupt handler, so it must not sleep, and may free
+    the request; otherwise, block_wait() waits for completion. */
+struct block_request {
+    struct list_elem elem;      /*!< Element in a device's queue. */
+    bool write;                 /*!< Write to the device, or read from it? */
+    block_sector_t sector;      /*!< First sector, on the submitted device. */
+    size_t cnt;                 /*!< Number of sectors. */
+    void *buffer;               /*!< CNT * BLOCK_SECTOR_SIZE bytes. */
+    void (*done)(struct block_request *);   /*!< Completion callback. */
+    void *aux;                  /*!< For DONE's use. */
+
+    /* Owned by the block layer. */
+    block_sector_t dev_sector;  /*!< First sector on the queued device. */
+    int priority;               /*!< Submitter's effective priority. */
+    int64_t submitted;          /*!< timer_usecs() at submission. */
+    struct semaphore finished;  /*!< Up'd on completion if DONE is null. */
+};
+
+/* Asynchronous I/O. */
+void block_request_init(struct block_request *, bool write,
+                        block_sector_t, size_t cnt, void *buffer,
+                        void (*done)(struct block_request *), void *aux);
+void block_submit(struct block *, struct block_request *);
+void block_wait(struct block_request *);
+
+/*! Why a thread is doing block I/O, as recorded in the I/O trace.  Set
+    with block_set_cause() around the I/O, and restored afterward. */
+enum block_cause {
+    BLOCK_CAUSE_OTHER,          /*!< Not set. */
+    BLOCK_CAUSE_CACHE_FILL,     /*!< Buffer cache miss. */
+    BLOCK_CAUSE_READ_AHEAD,     /*!< Buffer cache read-ahead. */
+    BLOCK_CAUSE_WRITEBACK,      /*!< Buffer cache writing dirty blocks. */
+    BLOCK_CAUSE_DIRECT,         /*!< File data bypassing the cache. */
+    BLOCK_CAUSE_JOURNAL,        /*!< Journal log, replay and superblock. */
+    BLOCK_CAUSE_SWAP_IN,        /*!< Page read from swap. */
+    BLOCK_CAUSE_SWAP_OUT,       /*!< Page written to swap. */
+    BLOCK_CAUSE_CNT
+};
+
+enum block_cause block_set_cause(enum block_cause);
+const char *block_cause_name(enum block_cause);
+
+/*! Buckets in a block I/O histogram.  Bucket 0 counts zeros, bucket I
+    counts values from 2**(I-1) to 2**I - 1, and the last bucket also
+    counts everything larger. */
+#define BLOCK_HIST_BUCKETS 24
+
+/*! I/O statistics of a device that carries out requests itself, rather
+    than mapping them onto another device.  Times are in microseconds. */
+struct block_stats {
+    unsigned long long requests;        /*!< Requests carried out. */
+    unsigned long long sectors;         /*!< Sectors they transferred. */
+    unsigned long long transfers;       /*!< Driver calls, after merging. */
+    unsigned long long sequential;      /*!< Requests that began where the
+                                             previous one submitted ended. */
+    unsigned long long wait[BLOCK_HIST_BUCKETS];    /*!< Time queued. */
+    unsigned long long service[BLOCK_HIST_BUCKETS]; /*!< Time in driver. */
+    unsigned long long size[BLOCK_HIST_BUCKETS];    /*!< Sectors. */
+    int depth;                          /*!< Requests queued or in service. */
+    int max_depth;                      /*!< Highest depth. */
+    int64_t depth_usecs;                /*!< Integral of depth over time. */
+    int64_t depth_since;                /*!< When depth last changed. */
+    int64_t first_usecs;                /*!< When the first request came. */
+};
+
 /* Statistics. */
 void block_print_stats(void);
+void block_print_io_stats(void);
+void block_get_stats(struct block *, struct block_stats *);
 
 /* Lower-level interface to block device drivers. */
 
 struct block_operations {
+    /*! Transfer one sector.  Required unless SUBMIT is given. */
     void (*read)(void *aux, block_sector_t, void *buffer);
     void (*write)(void *aux, block_sector_t, const void *buffer);
+
+    /*! Transfer CNT consecutive sectors at once.  Optional: if null,
+        the block layer calls read or write once per sector. */
+    void (*read_multi)(void *aux, block_sector_t, size_t cnt, void *buffer);
+    void (*write_multi)(void *aux, block_sector_t, size_t cnt,
+                        const void *buffer);
+
+    /*! For devices that are a range of another device, such as
+        partitions: returns that device and converts *SECTOR to a sector
+        on it, so that requests join the other device's queue.  Optional. */
+    struct block *(*map)(void *aux, block_sector_t *sector);
+
+    /*! For devices that can have many requests in flight, such as
+        virtio-blk: starts carrying out REQ, whose sectors begin at
+        REQ->dev_sector, and returns without waiting for it, although
+        it may sleep until the device has room.  The driver then calls
+        block_complete(), possibly from an interrupt handler.  Such
+        devices need no request queue.  Optional. */
+    void (*submit)(void *aux, struct block_request *req);
 };
 
 struct block *block_register(const char *name, enum block_type,
                              const char *extra_info, block_sector_t size,
                              const struct block_operations *, void *aux);
+void block_start_queue(struct block *);
+void block_complete(struct block *, struct block_request *);
 
 #endif /* devices/block.h */
 
@@ -1,7 +1,11 @@
 /*! \file ide.c
 
    The code in this file is an interface to an ATA (IDE)
-   controller.  It attempts to comply to [ATA-3]. */
+   controller.  It attempts to comply to [ATA-3].
+
+   Transfers use bus-master DMA when the channels belong to a PCI IDE
+   controller that supports it, such as the PIIX that QEMU emulates, and
+   programmed I/O otherwise. */
 
 #include "devices/ide.h"
 #include <ctype.h>
@@ -10,10 +14,12 @@
 #include <stdio.h>
 #include "devices/block.h"
 #include "devices/partition.h"
+#include "devices/pci.h"
 #include "devices/timer.h"
 #include "threads/io.h"
 #include "threads/interrupt.h"
 #include "threads/synch.h"
+#include "threads/vaddr.h"
 
 /*! ATA command block port addresses. @{ */
 #define reg_data(CHANNEL) ((CHANNEL)->reg_base + 0)    /*!< Data. */
@@ -38,6 +44,26 @@
 #define STA_BSY 0x80            /*!< Busy. */
 #define STA_DRDY 0x40           /*!< Device Ready. */
 #define STA_DRQ 0x08            /*!< Data Request. */
+#define STA_ERR 0x01            /*!< Error. */
+/*! @} */
+
+/*! Bus master IDE port addresses, relative to the channel's base in the
+    controller's PCI I/O space. @{ */
+#define reg_bm_command(CHANNEL) ((CHANNEL)->bm_base + 0) /*!< Command. */
+#define reg_bm_status(CHANNEL) ((CHANNEL)->bm_base + 2)  /*!< Status. */
+#define reg_bm_prdt(CHANNEL) ((CHANNEL)->bm_base + 4)    /*!< PRD table. */
+/*! @} */
+
+/*! Bus master Command Register bits. @{ */
+#define BM_START 0x01           /*!< Start transfer. */
+#define BM_READ 0x08            /*!< Transfer to memory, i.e. a disk read. */
+/*! @} */
+
+/*! Bus master Status Register bits.  The last two are cleared by
+    writing 1 to them. @{ */
+#define BM_STA_ACTIVE 0x01      /*!< Transfer in progress. */
+#define BM_STA_ERR 0x02         /*!< Transfer failed. */
+#define BM_STA_INTR 0x04        /*!< Device raised its interrupt. */
 /*! @} */
 
 /*! Control Register bits. @{ */
@@ -55,14 +81,41 @@
 #define CMD_IDENTIFY_DEVICE 0xec        /*!< IDENTIFY DEVICE. */
 #define CMD_READ_SECTOR_RETRY 0x20      /*!< READ SECTOR with retries. */
 #define CMD_WRITE_SECTOR_RETRY 0x30     /*!< WRITE SECTOR with retries. */
+#define CMD_READ_DMA 0xc8               /*!< READ DMA. */
+#define CMD_WRITE_DMA 0xca              /*!< WRITE DMA. */
+/*! @} */
+
+/*! Most sectors one command can transfer: the Sector Count register
+    holds 8 bits, with 0 meaning 256. */
+#define IDE_MAX_SECTORS 256
+
+/*! A physical region descriptor, one entry of the table that tells the bus
+    master where in memory to transfer data.  A region may not cross a
+    64 kB boundary, so an IDE_MAX_SECTORS transfer needs at most 3. */
+struct prd {
+    uint32_t addr;              /*!< Physical address of the region. */
+    uint16_t size;              /*!< Size in bytes, with 0 meaning 64 kB. */
+    uint16_t flags;             /*!< PRD_EOT in the last entry. */
+};
+#define PRD_EOT 0x8000          /*!< Marks the end of the table. */
+#define PRD_CNT 4               /*!< Entries in a channel's table. */
+
+/*! Bounds on how long poll_status() spins before it sleeps, in
+    microseconds. @{ */
+#define SPIN_MIN_USECS 10
+#define SPIN_MAX_USECS 2000
 /*! @} */
 
+/*! -no-dma: Use programmed I/O even if DMA is available? */
+bool ide_use_dma = true;
+
 /*! An ATA device. */
 struct ata_disk {
     char name[8];               /*!< Name, e.g. "hda". */
     struct channel *channel;    /*!< Channel that disk is attached to. */
     int dev_no;                 /*!< Device 0 or 1 for master or slave. */
     bool is_ata;                /*!< Is device an ATA disk? */
+    bool dma;                   /*!< Transfer data by bus-master DMA? */
 };
 
 /*! An ATA channel (aka controller).
@@ -77,6 +130,16 @@ struct channel {
                                      any interrupt would be spurious. */
     struct semaphore completion_wait;   /*!< Up'd by interrupt handler. */
 
+    uint16_t bm_base;           /*!< Bus master I/O base, or 0 if none. */
+    /*! PRD table for DMA, aligned so that it does not cross 64 kB. */
+    struct prd prdt[PRD_CNT] __attribute__ ((aligned (32)));
+
+    /* Adaptive polling, see poll_status(). */
+    int64_t spin_usecs;         /*!< How long to spin before sleeping. */
+    int64_t avg_usecs;          /*!< Average wait ended by spinning. */
+    unsigned long long spin_cnt;    /*!< Waits ended by spinning. */
+    unsigned long long sleep_cnt;   /*!< Waits that had to sleep. */
+
     struct ata_disk devices[2];     /*!< The devices on this channel. */
 };
 
@@ -90,11 +153,20 @@ static void reset_channel(struct channel *);
 static bool check_device_type(struct ata_disk *);
 static void identify_ata_device(struct ata_disk *);
 
-static void select_sector(struct ata_disk *, block_sector_t);
-static void issue_pio_command(struct channel *, uint8_t command);
+static uint16_t find_bus_master(void);
+static void select_sector(struct ata_disk *, block_sector_t, size_t cnt);
+static void issue_command(struct channel *, uint8_t command);
 static void input_sector(struct channel *, void *);
 static void output_sector(struct channel *, const void *);
-
+static void pio_read(struct ata_disk *, block_sector_t, size_t cnt, void *);
+static void pio_write(struct ata_disk *, block_sector_t, size_t cnt,
+                      const void *);
+static bool dma_usable(const struct ata_disk *, const void *buffer);
+static void dma_transfer(struct ata_disk *, block_sector_t, size_t cnt,
+                         const void *buffer, bool write);
+
+static bool poll_status(const struct ata_disk *, uint16_t port,
+                        uint8_t mask, int timeout_ms);
 static void wait_until_idle(const struct ata_disk *);
 static bool wait_while_busy(const struct ata_disk *);
 static void select_device(const struct ata_disk *);
@@ -104,6 +176,7 @@ static void interrupt_handler(struct intr_frame *);
 
 /*! Initialize the disk subsystem and detect disks. */
 void ide_init (void) {
+    uint16_t bm_base = ide_use_dma ? find_bus_master() : 0;
     size_t chan_no;
 
     for (chan_no = 0; chan_no < CHANNEL_CNT; chan_no++) {
@@ -127,6 +200,10 @@ void ide_init (void) {
         lock_init(&c->lock);
         c->expecting_interrupt = false;
         sema_init(&c->completion_wait, 0);
+        c->bm_base = bm_base != 0 ? bm_base + chan_no * 8 : 0;
+        c->spin_usecs = SPIN_MAX_USECS;
+        c->avg_usecs = 0;
+        c->spin_cnt = c->sleep_cnt = 0;
  
         /* Initialize devices. */
         for (dev_no = 0; dev_no < 2; dev_no++) {
@@ -136,6 +213,7 @@ void ide_init (void) {
             d->channel = c;
             d->dev_no = dev_no;
             d->is_ata = false;
+            d->dma = false;
         }
 
         /* Register interrupt handler. */
@@ -156,6 +234,41 @@ void ide_init (void) {
     }
 }
 
+/*! Prints how each channel's waits for its disks ended. */
+void ide_print_stats(void) {
+    struct channel *c;
+
+    for (c = channels; c < channels + CHANNEL_CNT; c++) {
+        if (c->spin_cnt + c->sleep_cnt == 0)
+            continue;
+        printf("%s: %llu waits ended while polling, %llu after sleeping; "
+               "polling window %"PRId64" us\n", c->name, c->spin_cnt,
+               c->sleep_cnt, c->spin_usecs);
+    }
+}
+
+/*! Looks for a PCI IDE controller capable of bus mastering that drives
+    the legacy channels.  If there is one, enables its bus master and
+    returns the base of its bus master registers; otherwise, returns 0. */
+static uint16_t find_bus_master(void) {
+    struct pci_dev *dev = NULL;
+
+    while ((dev = pci_find_class(0x01, 0x01, dev)) != NULL) {
+        /* Bit 7 of the programming interface marks a bus master.  Bits 0
+           and 2 clear mean that both channels use the legacy ports and
+           interrupts that we program. */
+        if ((dev->prog_if & 0x85) == 0x80) {
+            uint16_t base = pci_io_bar(dev, 4);
+            if (base != 0) {
+                pci_enable(dev, PCI_CMD_IO | PCI_CMD_MASTER);
+                printf("ide: bus master DMA at I/O port %#x\n", base);
+                return base;
+            }
+        }
+    }
+    return 0;
+}
+
 /* Disk detection and identification. */
 
 static char *descramble_ata_string(char *, int size);
@@ -258,7 +371,7 @@ static void identify_ata_device(struct ata_disk *d) {
        indicating the device's response is ready, and read the data
        into our buffer. */
     select_device_wait(d);
-    issue_pio_command(c, CMD_IDENTIFY_DEVICE);
+    issue_command(c, CMD_IDENTIFY_DEVICE);
     sema_down(&c->completion_wait);
     if (!wait_while_busy(d)) {
         d->is_ata = false;
@@ -270,8 +383,12 @@ static void identify_ata_device(struct ata_disk *d) {
     capacity = *(uint32_t *) &id[60 * 2];
     model = descramble_ata_string(&id[10 * 2], 20);
     serial = descramble_ata_string(&id[27 * 2], 40);
+
+    /* Bit 8 of word 49 says whether the disk supports DMA. */
+    d->dma = c->bm_base != 0 && (*(uint16_t *) &id[49 * 2] & 0x100) != 0;
     snprintf(extra_info, sizeof(extra_info),
-             "model \"%s\", serial \"%s\"", model, serial);
+             "model \"%s\", serial \"%s\"%s", model, serial,
+             d->dma ? ", DMA" : "");
 
     /* Disable access to IDE disks over 1 GB, which are likely physical IDE
        disks rather than virtual ones.  If we don't allow access to those,
@@ -288,6 +405,7 @@ static void identify_ata_device(struct ata_disk *d) {
     /* Register. */
     block = block_register(d->name, BLOCK_RAW, extra_info, capacity,
                          &ide_operations, d);
+    block_start_queue(block);
     partition_scan(block);
 }
 
@@ -315,53 +433,88 @@ static char * descramble_ata_string(char *string, int size) {
     return string;
 }
 
-/*! Reads sector SEC_NO from disk D into BUFFER, which must have room for
-    BLOCK_SECTOR_SIZE bytes.  Internally synchronizes accesses to disks,
-    so external per-disk locking is unneeded. */
-static void ide_read(void *d_, block_sector_t sec_no, void *buffer) {
+/*! Reads the CNT sectors starting at SEC_NO from disk D into BUFFER, which
+    must have room for CNT * BLOCK_SECTOR_SIZE bytes.  Issues one command
+    per IDE_MAX_SECTORS sectors.  Internally synchronizes accesses to
+    disks, so external per-disk locking is unneeded. */
+static void ide_read_multi(void *d_, block_sector_t sec_no, size_t cnt,
+                           void *buffer_) {
     struct ata_disk *d = d_;
     struct channel *c = d->channel;
+    uint8_t *buffer = buffer_;
+
     lock_acquire(&c->lock);
-    select_sector(d, sec_no);
-    issue_pio_command(c, CMD_READ_SECTOR_RETRY);
-    sema_down(&c->completion_wait);
-    if (!wait_while_busy(d))
-        PANIC("%s: disk read failed, sector=%"PRDSNu, d->name, sec_no);
-    input_sector(c, buffer);
+    while (cnt > 0) {
+        size_t n = cnt < IDE_MAX_SECTORS ? cnt : IDE_MAX_SECTORS;
+        if (dma_usable(d, buffer))
+            dma_transfer(d, sec_no, n, buffer, false);
+        else
+            pio_read(d, sec_no, n, buffer);
+        buffer += n * BLOCK_SECTOR_SIZE;
+        sec_no += n;
+        cnt -= n;
+    }
     lock_release(&c->lock);
 }
 
-/*! Write sector SEC_NO to disk D from BUFFER, which must contain
-    BLOCK_SECTOR_SIZE bytes.  Returns after the disk has acknowledged
-    receiving the data.  Internally synchronizes accesses to disks, so external
-    per-disk locking is unneeded. */
-static void ide_write(void *d_, block_sector_t sec_no, const void *buffer) {
+/*! Writes the CNT sectors starting at SEC_NO to disk D from BUFFER, which
+    must contain CNT * BLOCK_SECTOR_SIZE bytes.  Returns after the disk has
+    acknowledged receiving all of the data.  Internally synchronizes
+    accesses to disks, so external per-disk locking is unneeded. */
+static void ide_write_multi(void *d_, block_sector_t sec_no, size_t cnt,
+                            const void *buffer_) {
     struct ata_disk *d = d_;
     struct channel *c = d->channel;
+    const uint8_t *buffer = buffer_;
+
     lock_acquire(&c->lock);
-    select_sector(d, sec_no);
-    issue_pio_command(c, CMD_WRITE_SECTOR_RETRY);
-    if (!wait_while_busy(d))
-        PANIC("%s: disk write failed, sector=%"PRDSNu, d->name, sec_no);
-    output_sector(c, buffer);
-    sema_down(&c->completion_wait);
+    while (cnt > 0) {
+        size_t n = cnt < IDE_MAX_SECTORS ? cnt : IDE_MAX_SECTORS;
+        if (dma_usable(d, buffer))
+            dma_transfer(d, sec_no, n, buffer, true);
+        else
+            pio_write(d, sec_no, n, buffer);
+        buffer += n * BLOCK_SECTOR_SIZE;
+        sec_no += n;
+        cnt -= n;
+    }
     lock_release(&c->lock);
 }
 
+/*! Reads sector SEC_NO from disk D into BUFFER, which must have room for
+    BLOCK_SECTOR_SIZE bytes. */
+static void ide_read(void *d, block_sector_t sec_no, void *buffer) {
+    ide_read_multi(d, sec_no, 1, buffer);
+}
+
+/*! Write sector SEC_NO to disk D from BUFFER, which must contain
+    BLOCK_SECTOR_SIZE bytes.  Returns after the disk has acknowledged
+    receiving the data. */
+static void ide_write(void *d, block_sector_t sec_no, const void *buffer) {
+    ide_write_multi(d, sec_no, 1, buffer);
+}
+
 static struct block_operations ide_operations = {
     ide_read,
-    ide_write
+    ide_write,
+    ide_read_multi,
+    ide_write_multi,
+    NULL,
+    NULL
 };
-
+
 /*! Selects device D, waiting for it to become ready, and then writes SEC_NO
-    to the disk's sector selection registers.  (We use LBA mode.) */
-static void select_sector(struct ata_disk *d, block_sector_t sec_no) {
+    and CNT to the disk's sector selection registers.  (We use LBA mode.)
+    A CNT of IDE_MAX_SECTORS is written as 0, which the disk reads as 256. */
+static void select_sector(struct ata_disk *d, block_sector_t sec_no,
+                          size_t cnt) {
     struct channel *c = d->channel;
 
     ASSERT(sec_no < (1UL << 28));
+    ASSERT(cnt > 0 && cnt <= IDE_MAX_SECTORS);
   
     select_device_wait(d);
-    outb(reg_nsect(c), 1);
+    outb(reg_nsect(c), cnt);
     outb(reg_lbal(c), sec_no);
     outb(reg_lbam(c), sec_no >> 8);
     outb(reg_lbah(c), (sec_no >> 16));
@@ -371,7 +524,7 @@ static void select_sector(struct ata_disk *d, block_sector_t sec_no) {
 
 /*! Writes COMMAND to channel C and prepares for receiving a
     completion interrupt. */
-static void issue_pio_command(struct channel *c, uint8_t command) {
+static void issue_command(struct channel *c, uint8_t command) {
     /* Interrupts must be enabled or our semaphore will never be
        up'd by the completion handler. */
     ASSERT(intr_get_level() == INTR_ON);
@@ -392,23 +545,158 @@ static void output_sector(struct channel *c, const void *sector) {
     outsw(reg_data(c), sector, BLOCK_SECTOR_SIZE / 2);
 }
 
+/*! Reads CNT sectors, at most IDE_MAX_SECTORS, starting at SEC_NO from disk
+    D into BUFFER by programmed I/O.  The disk interrupts once as each
+    sector becomes ready.  D's channel must be locked. */
+static void pio_read(struct ata_disk *d, block_sector_t sec_no, size_t cnt,
+                     void *buffer) {
+    struct channel *c = d->channel;
+    size_t i;
+
+    select_sector(d, sec_no, cnt);
+    issue_command(c, CMD_READ_SECTOR_RETRY);
+    for (i = 0; i < cnt; i++) {
+        sema_down(&c->completion_wait);
+        if (!wait_while_busy(d))
+            PANIC("%s: disk read failed, sector=%"PRDSNu, d->name, sec_no + i);
+        input_sector(c, (uint8_t *) buffer + i * BLOCK_SECTOR_SIZE);
+    }
+}
+
+/*! Writes CNT sectors, at most IDE_MAX_SECTORS, starting at SEC_NO to disk
+    D from BUFFER by programmed I/O.  The disk interrupts once as it
+    accepts each sector.  D's channel must be locked. */
+static void pio_write(struct ata_disk *d, block_sector_t sec_no, size_t cnt,
+                      const void *buffer) {
+    struct channel *c = d->channel;
+    size_t i;
+
+    select_sector(d, sec_no, cnt);
+    issue_command(c, CMD_WRITE_SECTOR_RETRY);
+    for (i = 0; i < cnt; i++) {
+        if (!wait_while_busy(d))
+            PANIC("%s: disk write failed, sector=%"PRDSNu,
+                  d->name, sec_no + i);
+        output_sector(c, (const uint8_t *) buffer + i * BLOCK_SECTOR_SIZE);
+        sema_down(&c->completion_wait);
+    }
+}
+
+/*! Returns true if disk D can transfer to or from BUFFER by DMA.  The bus
+    master needs a physical address, which we only know for kernel
+    addresses, and one that is even. */
+static bool dma_usable(const struct ata_disk *d, const void *buffer) {
+    return d->dma && is_kernel_vaddr(buffer) && ((uintptr_t) buffer & 1) == 0;
+}
+
+/*! Transfers CNT sectors, at most IDE_MAX_SECTORS, starting at SEC_NO
+    between disk D and BUFFER by bus-master DMA: to the disk if WRITE is
+    true, from it otherwise.  The processor is free during the transfer,
+    which completes with a single interrupt.  D's channel must be locked. */
+static void dma_transfer(struct ata_disk *d, block_sector_t sec_no,
+                         size_t cnt, const void *buffer, bool write) {
+    struct channel *c = d->channel;
+    uintptr_t addr = vtop(buffer);
+    size_t size = cnt * BLOCK_SECTOR_SIZE;
+    uint8_t direction = write ? 0 : BM_READ;
+    uint8_t bm_status;
+    struct prd *p;
+
+    /* Describe BUFFER, which is contiguous in physical memory like all of
+       kernel virtual memory, in regions that do not cross 64 kB. */
+    for (p = c->prdt; ; p++) {
+        size_t chunk = 0x10000 - (addr & 0xffff);
+        if (chunk > size)
+            chunk = size;
+        ASSERT(p < c->prdt + PRD_CNT);
+        p->addr = addr;
+        p->size = chunk & 0xffff;
+        p->flags = 0;
+        addr += chunk;
+        size -= chunk;
+        if (size == 0) {
+            p->flags = PRD_EOT;
+            break;
+        }
+    }
+
+    outl(reg_bm_prdt(c), vtop(c->prdt));
+    outb(reg_bm_command(c), direction);
+    outb(reg_bm_status(c), inb(reg_bm_status(c)) | BM_STA_ERR | BM_STA_INTR);
+    select_sector(d, sec_no, cnt);
+    issue_command(c, write ? CMD_WRITE_DMA : CMD_READ_DMA);
+    outb(reg_bm_command(c), direction | BM_START);
+    sema_down(&c->completion_wait);
+
+    outb(reg_bm_command(c), direction);
+    bm_status = inb(reg_bm_status(c));
+    outb(reg_bm_status(c), bm_status | BM_STA_ERR | BM_STA_INTR);
+    if ((bm_status & (BM_STA_ERR | BM_STA_ACTIVE)) || wait_while_busy(d)
+        || (inb(reg_alt_status(c)) & STA_ERR))
+        PANIC("%s: DMA %s failed, sector=%"PRDSNu, d->name,
+              write ? "write" : "read", sec_no);
+}
+
 /* Low-level ATA primitives. */
 
-/*! Wait up to 10 seconds for the controller to become idle, that
+/*! Waits up to TIMEOUT_MS milliseconds for the bits in MASK to clear in
+    the status register of D's channel read from PORT, which is either
+    reg_status() or reg_alt_status().  Returns true if they cleared, false
+    on timeout.
+
+    Most waits end within microseconds, so this first spins on the
+    register, for about four times as long as spinning has recently
+    needed.  A wait that outlasts that window means the disk is doing real
+    work, such as seeking, so this sleeps a timer tick at a time instead
+    and halves the window, on the theory that the next wait will be long
+    too. */
+static bool poll_status(const struct ata_disk *d, uint16_t port,
+                        uint8_t mask, int timeout_ms) {
+    struct channel *c = d->channel;
+    int64_t start = timer_usecs();
+    int64_t waited;
+    int i;
+
+    do {
+        if ((inb(port) & mask) == 0) {
+            waited = timer_usecs() - start;
+            c->avg_usecs = (c->avg_usecs * 7 + waited) / 8;
+            c->spin_usecs = 4 * c->avg_usecs;
+            if (c->spin_usecs < SPIN_MIN_USECS)
+                c->spin_usecs = SPIN_MIN_USECS;
+            if (c->spin_usecs > SPIN_MAX_USECS)
+                c->spin_usecs = SPIN_MAX_USECS;
+            c->spin_cnt++;
+            return true;
+        }
+    } while (timer_usecs() - start < c->spin_usecs);
+
+    c->sleep_cnt++;
+    if (c->spin_usecs / 2 >= SPIN_MIN_USECS)
+        c->spin_usecs /= 2;
+    for (i = 0; i < DIV_ROUND_UP(timeout_ms * TIMER_FREQ, 1000); i++) {
+        if (i == 7 * TIMER_FREQ)
+            printf("%s: busy, waiting...", d->name);
+        timer_sleep(1);
+        if ((inb(port) & mask) == 0) {
+            if (i >= 7 * TIMER_FREQ)
+                printf("ok\n");
+            return true;
+        }
+    }
+    if (i > 7 * TIMER_FREQ)
+        printf("failed\n");
+    return false;
+}
+
+/*! Wait up to 10 milliseconds for the controller to become idle, that
     is, for the BSY and DRQ bits to clear in the status register.
 
     As a side effect, reading the status register clears any
     pending interrupt. */
 static void wait_until_idle(const struct ata_disk *d) {
-    int i;
-
-    for (i = 0; i < 1000; i++) {
-        if ((inb(reg_status(d->channel)) & (STA_BSY | STA_DRQ)) == 0)
-            return;
-        timer_usleep(10);
-    }
-
-    printf("%s: idle timeout\n", d->name);
+    if (!poll_status(d, reg_status(d->channel), STA_BSY | STA_DRQ, 10))
+        printf("%s: idle timeout\n", d->name);
 }
 
 /*! Wait up to 30 seconds for disk D to clear BSY, and then return the status
@@ -416,21 +704,10 @@ static void wait_until_idle(const struct ata_disk *d) {
     to complete its reset. */
 static bool wait_while_busy(const struct ata_disk *d) {
     struct channel *c = d->channel;
-    int i;
-  
-    for (i = 0; i < 3000; i++) {
-        if (i == 700)
-            printf("%s: busy, waiting...", d->name);
-        if (!(inb(reg_alt_status(c)) & STA_BSY)) {
-            if (i >= 700)
-                printf ("ok\n");
-            return (inb(reg_alt_status(c)) & STA_DRQ) != 0;
-        }
-        timer_msleep(10);
-    }
 
-    printf("failed\n");
-    return false;
+    if (!poll_status(d, reg_alt_status(c), STA_BSY, 30 * 1000))
+        return false;
+    return (inb(reg_alt_status(c)) & STA_DRQ) != 0;
 }
 
 /*! Program D's channel so that D is now the selected disk. */
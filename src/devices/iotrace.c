@@ -0,0 +1,114 @@
+/*! \file iotrace.c
+
+   A trace of block requests, kept in a ring buffer so that it holds the
+   most recent ones.  It is off unless the kernel is started with
+   "-iotrace=N", which sizes the ring at N records.  Each request is
+   recorded once, when it is submitted, against the device that carries
+   it out, so a request for a partition appears as one for its disk.  A
+   record notes the submitting thread and the cause it set with
+   block_set_cause().
+
+   The trace is printed as text, one record per line:
+
+       io USECS DEVICE R|W SECTOR COUNT TID CAUSE
+
+   between a "Begin I/O trace" and an "End I/O trace" line.  The
+   "iotrace" action prints it to the console and "iotrace-save" appends
+   it to the scratch device as a file named "iotrace".  utils/pintos-iotrace
+   reads either form. */
+
+#include "devices/iotrace.h"
+#include <debug.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include "devices/timer.h"
+#include "threads/interrupt.h"
+#include "threads/malloc.h"
+#include "threads/thread.h"
+
+/*! One traced request. */
+struct iotrace_record {
+    int64_t usecs;              /*!< timer_usecs() at submission. */
+    struct block *block;        /*!< Device carrying the request out. */
+    block_sector_t sector;      /*!< First sector on BLOCK. */
+    uint32_t cnt;               /*!< Number of sectors. */
+    tid_t tid;                  /*!< Submitting thread. */
+    uint8_t write;              /*!< Write, or read? */
+    uint8_t cause;              /*!< An enum block_cause. */
+};
+
+static struct iotrace_record *ring;     /*!< Ring buffer, or null. */
+static size_t ring_size;                /*!< Records RING holds. */
+static unsigned long long recorded;     /*!< Records ever made. */
+static bool paused;                     /*!< Ignore requests for now? */
+
+/*! Starts tracing the last RECORDS block requests. */
+void iotrace_init(size_t records) {
+    ASSERT(ring == NULL);
+    if (records == 0)
+        return;
+    ring = malloc(records * sizeof *ring);
+    if (ring == NULL)
+        PANIC("can't allocate I/O trace of %zu records", records);
+    ring_size = records;
+}
+
+/*! Records REQ, which is being submitted to BLOCK, the device that will
+    carry it out. */
+void iotrace_record(struct block *block, const struct block_request *req) {
+    struct iotrace_record *r;
+    enum intr_level old_level;
+
+    if (ring == NULL || paused)
+        return;
+
+    old_level = intr_disable();
+    r = &ring[recorded++ % ring_size];
+    r->usecs = req->submitted;
+    r->block = block;
+    r->sector = req->dev_sector;
+    r->cnt = req->cnt;
+    r->tid = thread_tid();
+    r->write = req->write;
+    r->cause = thread_current()->io_cause;
+    intr_set_level(old_level);
+}
+
+/*! Passes each line of the trace, in order and with its new-line, to
+    OUTPUT along with AUX.  Requests made meanwhile, for example by OUTPUT
+    itself, are not traced.  Does nothing if tracing is off. */
+void iotrace_format(void (*output)(const char *line, void *aux), void *aux) {
+    unsigned long long first, i;
+    char line[96];
+
+    if (ring == NULL)
+        return;
+
+    paused = true;
+    first = recorded > ring_size ? recorded - ring_size : 0;
+    snprintf(line, sizeof line, "Begin I/O trace: %llu records, "
+             "%llu dropped.\n", recorded - first, first);
+    output(line, aux);
+    for (i = first; i < recorded; i++) {
+        const struct iotrace_record *r = &ring[i % ring_size];
+        snprintf(line, sizeof line,
+                 "io %"PRId64" %s %c %"PRDSNu" %"PRIu32" %d %s\n",
+                 r->usecs, block_name(r->block), r->write ? 'W' : 'R',
+                 r->sector, r->cnt, r->tid, block_cause_name(r->cause));
+        output(line, aux);
+    }
+    output("End I/O trace.\n", aux);
+    paused = false;
+}
+
+static void print_line(const char *line, void *aux UNUSED) {
+    printf("%s", line);
+}
+
+/*! Prints the trace to the console. */
+void iotrace_print(void) {
+    if (ring == NULL)
+        printf("I/O tracing is off (use -iotrace=N).\n");
+    else
+        iotrace_format(print_line, NULL);
+}
@@ -0,0 +1,12 @@
+#ifndef DEVICES_IOTRACE_H
+#define DEVICES_IOTRACE_H
+
+#include <stddef.h>
+#include "devices/block.h"
+
+void iotrace_init(size_t records);
+void iotrace_record(struct block *, const struct block_request *);
+void iotrace_format(void (*output)(const char *line, void *aux), void *aux);
+void iotrace_print(void);
+
+#endif /* devices/iotrace.h */
@@ -296,8 +296,20 @@ static void partition_write(void *p_, block_sector_t sector,
     block_write(p->block, p->start + sector, buffer);
 }
 
+/*! Returns the device that partition P is part of, and converts *SECTOR
+    from a sector of P to a sector of that device. */
+static struct block * partition_map(void *p_, block_sector_t *sector) {
+    struct partition *p = p_;
+    *sector += p->start;
+    return p->block;
+}
+
 static struct block_operations partition_operations = {
     partition_read,
-    partition_write
+    partition_write,
+    NULL,
+    NULL,
+    partition_map,
+    NULL
 };
 
@@ -0,0 +1,154 @@
+/*! \file pci.c
+
+   Enumeration of the PCI bus through configuration mechanism #1, the
+   pair of I/O ports at 0xcf8 and 0xcfc that every PC chipset since the
+   early 1990s provides.  We only look for devices that our drivers
+   know how to use, so there is no support for bridges beyond scanning
+   every bus number. */
+
+#include "devices/pci.h"
+#include <debug.h>
+#include <stdio.h>
+#include "threads/io.h"
+
+/*! Configuration mechanism #1 ports. @{ */
+#define PCI_CONFIG_ADDRESS 0xcf8        /*!< Selects a config register. */
+#define PCI_CONFIG_DATA 0xcfc           /*!< Reads or writes it. */
+/*! @} */
+
+/*! Most functions we keep track of. */
+#define PCI_MAX_DEVS 32
+
+static struct pci_dev devs[PCI_MAX_DEVS];
+static size_t dev_cnt;
+
+static uint32_t config_address(uint8_t bus, uint8_t slot, uint8_t func,
+                               uint8_t reg);
+static uint32_t config_read(uint8_t bus, uint8_t slot, uint8_t func,
+                            uint8_t reg);
+static void add_function(uint8_t bus, uint8_t slot, uint8_t func);
+
+/*! Scans the PCI bus and records every function found. */
+void pci_init(void) {
+    unsigned bus, slot, func;
+
+    for (bus = 0; bus < 256; bus++) {
+        for (slot = 0; slot < 32; slot++) {
+            uint32_t header;
+
+            if ((config_read(bus, slot, 0, PCI_REG_ID) & 0xffff) == 0xffff)
+                continue;
+            add_function(bus, slot, 0);
+
+            /* Bit 7 of the header type marks a multifunction device. */
+            header = config_read(bus, slot, 0, PCI_REG_HEADER) >> 16;
+            if (header & 0x80) {
+                for (func = 1; func < 8; func++) {
+                    if ((config_read(bus, slot, func, PCI_REG_ID) & 0xffff)
+                        != 0xffff)
+                        add_function(bus, slot, func);
+                }
+            }
+        }
+    }
+}
+
+/*! Returns the first function after PREV with the given CLASS and
+    SUBCLASS, or a null pointer if there is none.  Pass a null PREV to
+    start from the beginning. */
+struct pci_dev * pci_find_class(uint8_t class, uint8_t subclass,
+                                struct pci_dev *prev) {
+    struct pci_dev *d = prev != NULL ? prev + 1 : devs;
+
+    for (; d < devs + dev_cnt; d++) {
+        if (d->class == class && d->subclass == subclass)
+            return d;
+    }
+    return NULL;
+}
+
+/*! Returns the first function after PREV with the given VENDOR_ID and
+    DEVICE_ID, or a null pointer if there is none.  Pass a null PREV to
+    start from the beginning. */
+struct pci_dev * pci_find_id(uint16_t vendor_id, uint16_t device_id,
+                             struct pci_dev *prev) {
+    struct pci_dev *d = prev != NULL ? prev + 1 : devs;
+
+    for (; d < devs + dev_cnt; d++) {
+        if (d->vendor_id == vendor_id && d->device_id == device_id)
+            return d;
+    }
+    return NULL;
+}
+
+/*! Returns the 32-bit configuration register at offset REG of D.
+    REG must be a multiple of 4. */
+uint32_t pci_read_config(const struct pci_dev *d, uint8_t reg) {
+    return config_read(d->bus, d->slot, d->func, reg);
+}
+
+/*! Writes VALUE to the 32-bit configuration register at offset REG of
+    D.  REG must be a multiple of 4. */
+void pci_write_config(const struct pci_dev *d, uint8_t reg, uint32_t value) {
+    outl(PCI_CONFIG_ADDRESS, config_address(d->bus, d->slot, d->func, reg));
+    outl(PCI_CONFIG_DATA, value);
+}
+
+/*! Returns the I/O port base of D's base address register BAR, or 0 if
+    that register is unused or maps memory instead of I/O ports. */
+uint16_t pci_io_bar(const struct pci_dev *d, int bar) {
+    uint32_t value;
+
+    ASSERT(bar >= 0 && bar < 6);
+    value = pci_read_config(d, PCI_REG_BAR0 + 4 * bar);
+    return (value & 1) ? value & 0xfffc : 0;
+}
+
+/*! Sets COMMAND_BITS, a set of PCI_CMD_* bits, in D's command
+    register. */
+void pci_enable(const struct pci_dev *d, uint16_t command_bits) {
+    /* The status register in the upper half ignores writes of 0. */
+    uint32_t value = pci_read_config(d, PCI_REG_COMMAND) & 0xffff;
+    pci_write_config(d, PCI_REG_COMMAND, value | command_bits);
+}
+
+/*! Returns the value to write to PCI_CONFIG_ADDRESS to select register
+    REG of function FUNC of device SLOT on BUS. */
+static uint32_t config_address(uint8_t bus, uint8_t slot, uint8_t func,
+                               uint8_t reg) {
+    ASSERT(reg % 4 == 0);
+    ASSERT(slot < 32 && func < 8);
+    return (0x80000000u | (uint32_t) bus << 16 | (uint32_t) slot << 11
+            | (uint32_t) func << 8 | reg);
+}
+
+/*! Returns a 32-bit configuration register, or all 1-bits if there is
+    no such function. */
+static uint32_t config_read(uint8_t bus, uint8_t slot, uint8_t func,
+                            uint8_t reg) {
+    outl(PCI_CONFIG_ADDRESS, config_address(bus, slot, func, reg));
+    return inl(PCI_CONFIG_DATA);
+}
+
+/*! Records function FUNC of device SLOT on BUS. */
+static void add_function(uint8_t bus, uint8_t slot, uint8_t func) {
+    struct pci_dev *d;
+    uint32_t id, class;
+
+    if (dev_cnt >= PCI_MAX_DEVS) {
+        printf("pci: too many functions, ignoring %02x:%02x.%x\n",
+               bus, slot, func);
+        return;
+    }
+    d = &devs[dev_cnt++];
+    id = config_read(bus, slot, func, PCI_REG_ID);
+    class = config_read(bus, slot, func, PCI_REG_CLASS);
+    d->bus = bus;
+    d->slot = slot;
+    d->func = func;
+    d->vendor_id = id & 0xffff;
+    d->device_id = id >> 16;
+    d->class = class >> 24;
+    d->subclass = class >> 16;
+    d->prog_if = class >> 8;
+}
@@ -0,0 +1,45 @@
+#ifndef DEVICES_PCI_H
+#define DEVICES_PCI_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*! A PCI function, as found by pci_init(). */
+struct pci_dev {
+    uint8_t bus;                /*!< Bus number. */
+    uint8_t slot;               /*!< Device number on the bus. */
+    uint8_t func;               /*!< Function number within the device. */
+    uint16_t vendor_id;         /*!< Vendor ID, e.g. 0x8086 for Intel. */
+    uint16_t device_id;         /*!< Device ID, assigned by the vendor. */
+    uint8_t class;              /*!< Base class, e.g. 0x01 for storage. */
+    uint8_t subclass;           /*!< Subclass, e.g. 0x01 for IDE. */
+    uint8_t prog_if;            /*!< Programming interface. */
+};
+
+/*! Configuration space registers. @{ */
+#define PCI_REG_ID 0x00         /*!< Vendor ID, Device ID. */
+#define PCI_REG_COMMAND 0x04    /*!< Command, Status. */
+#define PCI_REG_CLASS 0x08      /*!< Revision, prog. interface, classes. */
+#define PCI_REG_HEADER 0x0c     /*!< Header type in bits 16...23. */
+#define PCI_REG_BAR0 0x10       /*!< First of six base address registers. */
+#define PCI_REG_IRQ 0x3c        /*!< Interrupt line in bits 0...7. */
+/*! @} */
+
+/*! Command register bits. @{ */
+#define PCI_CMD_IO 0x0001       /*!< Respond to I/O space accesses. */
+#define PCI_CMD_MEMORY 0x0002   /*!< Respond to memory space accesses. */
+#define PCI_CMD_MASTER 0x0004   /*!< Allow bus mastering (DMA). */
+/*! @} */
+
+void pci_init(void);
+struct pci_dev *pci_find_class(uint8_t class, uint8_t subclass,
+                               struct pci_dev *prev);
+struct pci_dev *pci_find_id(uint16_t vendor_id, uint16_t device_id,
+                            struct pci_dev *prev);
+
+uint32_t pci_read_config(const struct pci_dev *, uint8_t reg);
+void pci_write_config(const struct pci_dev *, uint8_t reg, uint32_t);
+uint16_t pci_io_bar(const struct pci_dev *, int bar);
+void pci_enable(const struct pci_dev *, uint16_t command_bits);
+
+#endif /* devices/pci.h */
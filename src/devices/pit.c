@@ -15,9 +15,6 @@
 #define PIT_PORT_COUNTER(CHANNEL) (0x40 + (CHANNEL))  /*!< Counter port. */
 /*! @} */
 
-/*! PIT cycles per second. */
-#define PIT_HZ 1193180
-
 /*! Configure the given CHANNEL in the PIT.  In a PC, the PIT's
     three output channels are hooked up like this:
 
@@ -79,3 +76,18 @@ void pit_configure_channel(int channel, int mode, int frequency) {
     intr_set_level(old_level);
 }
 
+/*! Returns the current count of CHANNEL, which counts down by one each PIT
+    cycle and starts over when it reaches the end of its period.  Must be
+    called with interrupts off, since the count is read in two halves. */
+unsigned pit_read_counter(int channel) {
+    unsigned low, high;
+
+    ASSERT(channel == 0 || channel == 2);
+    ASSERT(intr_get_level() == INTR_OFF);
+
+    /* Latch the count, so that the two halves match. */
+    outb(PIT_PORT_CONTROL, channel << 6);
+    low = inb(PIT_PORT_COUNTER(channel));
+    high = inb(PIT_PORT_COUNTER(channel));
+    return low | high << 8;
+}
@@ -0,0 +1,106 @@
+/*! \file ramdisk.c
+
+   A block device held in memory, named "ram0".  Its contents are lost at
+   shutdown.  Requests are served at memory speed, without a queue, which
+   makes it useful for measuring the layers above the block layer and as
+   a fast scratch or swap device.  Use it for a role with, for example,
+   "-filesys=ram0 -f". */
+
+#include "devices/ramdisk.h"
+#include <debug.h>
+#include <round.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/block.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+
+/*! Sectors per page of storage. */
+#define SECTORS_PER_PAGE (PGSIZE / BLOCK_SECTOR_SIZE)
+
+/*! The RAM disk's storage, one page at a time, since the page allocator
+    seldom has a large run of free pages. */
+static uint8_t **pages;
+
+static struct block_operations ramdisk_operations;
+
+/*! Creates a RAM disk of KB kilobytes, rounded up to whole pages, and
+    registers it with the block layer. */
+void ramdisk_init(size_t kb) {
+    size_t page_cnt = DIV_ROUND_UP(kb * 1024, PGSIZE);
+    size_t i;
+
+    ASSERT(pages == NULL);
+    pages = malloc(page_cnt * sizeof *pages);
+    if (pages == NULL)
+        PANIC("ram0: can't allocate page table for %zu kB", kb);
+    for (i = 0; i < page_cnt; i++) {
+        pages[i] = palloc_get_page(PAL_ZERO);
+        if (pages[i] == NULL)
+            PANIC("ram0: out of memory after %zu of %zu pages", i, page_cnt);
+    }
+
+    block_register("ram0", BLOCK_RAW, "RAM disk", page_cnt * SECTORS_PER_PAGE,
+                   &ramdisk_operations, NULL);
+}
+
+/*! Returns the address of SECTOR's data. */
+static uint8_t * sector_addr(block_sector_t sector) {
+    return (pages[sector / SECTORS_PER_PAGE]
+            + sector % SECTORS_PER_PAGE * BLOCK_SECTOR_SIZE);
+}
+
+/*! Reads the CNT sectors starting at SECTOR into BUFFER, a page's worth
+    at a time. */
+static void ramdisk_read_multi(void *aux UNUSED, block_sector_t sector,
+                               size_t cnt, void *buffer_) {
+    uint8_t *buffer = buffer_;
+
+    while (cnt > 0) {
+        size_t n = SECTORS_PER_PAGE - sector % SECTORS_PER_PAGE;
+        if (n > cnt)
+            n = cnt;
+        memcpy(buffer, sector_addr(sector), n * BLOCK_SECTOR_SIZE);
+        buffer += n * BLOCK_SECTOR_SIZE;
+        sector += n;
+        cnt -= n;
+    }
+}
+
+/*! Writes the CNT sectors starting at SECTOR from BUFFER, a page's worth
+    at a time. */
+static void ramdisk_write_multi(void *aux UNUSED, block_sector_t sector,
+                                size_t cnt, const void *buffer_) {
+    const uint8_t *buffer = buffer_;
+
+    while (cnt > 0) {
+        size_t n = SECTORS_PER_PAGE - sector % SECTORS_PER_PAGE;
+        if (n > cnt)
+            n = cnt;
+        memcpy(sector_addr(sector), buffer, n * BLOCK_SECTOR_SIZE);
+        buffer += n * BLOCK_SECTOR_SIZE;
+        sector += n;
+        cnt -= n;
+    }
+}
+
+/*! Reads sector SECTOR into BUFFER. */
+static void ramdisk_read(void *aux, block_sector_t sector, void *buffer) {
+    ramdisk_read_multi(aux, sector, 1, buffer);
+}
+
+/*! Writes sector SECTOR from BUFFER. */
+static void ramdisk_write(void *aux, block_sector_t sector,
+                          const void *buffer) {
+    ramdisk_write_multi(aux, sector, 1, buffer);
+}
+
+static struct block_operations ramdisk_operations = {
+    ramdisk_read,
+    ramdisk_write,
+    ramdisk_read_multi,
+    ramdisk_write_multi,
+    NULL,
+    NULL
+};
@@ -11,6 +11,8 @@
 #endif
 #ifdef FILESYS
 #include "devices/block.h"
+#include "devices/ide.h"
+#include "devices/virtio-blk.h"
 #include "filesys/filesys.h"
 #endif
 
@@ -108,6 +110,8 @@ static void print_stats(void) {
     thread_print_stats();
 #ifdef FILESYS
     block_print_stats();
+    ide_print_stats();
+    virtio_blk_print_stats();
 #endif
     console_print_stats();
     kbd_print_stats();
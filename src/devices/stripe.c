@@ -0,0 +1,142 @@
+/*! \file stripe.c
+
+   A virtual block device, named "md0", that stripes its sectors across
+   two or more other block devices, as RAID level 0 does.  Sectors are
+   dealt out to the members a chunk of STRIPE_CHUNK sectors at a time, so
+   a large request keeps every member busy at once.  The requests to the
+   members are submitted together and wait in the members' queues, where
+   the chunks that land next to each other on one member are merged.
+   Striping pays when the members are on different IDE channels, such as
+   hda and hdc, since the two disks on one channel take turns. */
+
+#include "devices/stripe.h"
+#include <debug.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/block.h"
+#include "threads/malloc.h"
+
+/*! Sectors per chunk: one page, so that a page of swap or a file system
+    block group stays on one member. */
+#define STRIPE_CHUNK 8
+
+/*! Most members. */
+#define STRIPE_MAX_MEMBERS 8
+
+/*! Most chunk requests in flight from one md0 request.  A larger request
+    is carried out in rounds of this many.  The requests live on the
+    kernel stack, so this must stay small. */
+#define STRIPE_MAX_INFLIGHT 8
+
+static struct block *members[STRIPE_MAX_MEMBERS];
+static size_t member_cnt;
+
+static struct block_operations stripe_operations;
+
+/*! Creates md0 from the devices named in MEMBERS, a comma-separated list
+    such as "hdb,hdc".  md0 holds as many whole chunks of each member as
+    the smallest member has. */
+void stripe_init(const char *members_) {
+    char names[64], *name, *save_ptr;
+    block_sector_t chunks = 0;
+    char extra_info[80];
+    size_t i;
+
+    strlcpy(names, members_, sizeof names);
+    for (name = strtok_r(names, ",", &save_ptr); name != NULL;
+         name = strtok_r(NULL, ",", &save_ptr)) {
+        struct block *block = block_get_by_name(name);
+        if (block == NULL)
+            PANIC("md0: no such block device \"%s\"", name);
+        if (member_cnt >= STRIPE_MAX_MEMBERS)
+            PANIC("md0: more than %d members", STRIPE_MAX_MEMBERS);
+        for (i = 0; i < member_cnt; i++) {
+            if (members[i] == block)
+                PANIC("md0: \"%s\" named twice", name);
+        }
+        members[member_cnt++] = block;
+        if (member_cnt == 1 || block_size(block) / STRIPE_CHUNK < chunks)
+            chunks = block_size(block) / STRIPE_CHUNK;
+    }
+    if (member_cnt < 2)
+        PANIC("md0: striping needs at least 2 devices");
+
+    snprintf(extra_info, sizeof extra_info, "striped across %zu devices",
+             member_cnt);
+    block_register("md0", BLOCK_RAW, extra_info,
+                   chunks * STRIPE_CHUNK * member_cnt, &stripe_operations,
+                   NULL);
+}
+
+/*! Finds the member holding md0's SECTOR.  Returns the member and stores
+    the sector on it in *MEMBER_SECTOR. */
+static struct block * locate(block_sector_t sector,
+                             block_sector_t *member_sector) {
+    block_sector_t chunk = sector / STRIPE_CHUNK;
+    *member_sector = (chunk / member_cnt * STRIPE_CHUNK
+                      + sector % STRIPE_CHUNK);
+    return members[chunk % member_cnt];
+}
+
+/*! Reads (if WRITE is false) or writes (if WRITE is true) the CNT sectors
+    starting at SECTOR, from or to BUFFER, as one request per chunk to the
+    members.  Each round's requests are all submitted before waiting for
+    any of them, so the members work in parallel. */
+static void transfer(bool write, block_sector_t sector, size_t cnt,
+                     uint8_t *buffer) {
+    struct block_request reqs[STRIPE_MAX_INFLIGHT];
+
+    while (cnt > 0) {
+        size_t n;
+
+        for (n = 0; n < STRIPE_MAX_INFLIGHT && cnt > 0; n++) {
+            block_sector_t member_sector;
+            struct block *member = locate(sector, &member_sector);
+            size_t chunk_cnt = STRIPE_CHUNK - sector % STRIPE_CHUNK;
+            if (chunk_cnt > cnt)
+                chunk_cnt = cnt;
+
+            block_request_init(&reqs[n], write, member_sector, chunk_cnt,
+                               buffer, NULL, NULL);
+            block_submit(member, &reqs[n]);
+            buffer += chunk_cnt * BLOCK_SECTOR_SIZE;
+            sector += chunk_cnt;
+            cnt -= chunk_cnt;
+        }
+        while (n > 0)
+            block_wait(&reqs[--n]);
+    }
+}
+
+/*! Reads the CNT sectors starting at SECTOR into BUFFER. */
+static void stripe_read_multi(void *aux UNUSED, block_sector_t sector,
+                              size_t cnt, void *buffer) {
+    transfer(false, sector, cnt, buffer);
+}
+
+/*! Writes the CNT sectors starting at SECTOR from BUFFER.  Returns after
+    every member has acknowledged its part. */
+static void stripe_write_multi(void *aux UNUSED, block_sector_t sector,
+                               size_t cnt, const void *buffer) {
+    transfer(true, sector, cnt, (uint8_t *) buffer);
+}
+
+/*! Reads sector SECTOR into BUFFER. */
+static void stripe_read(void *aux, block_sector_t sector, void *buffer) {
+    stripe_read_multi(aux, sector, 1, buffer);
+}
+
+/*! Writes sector SECTOR from BUFFER. */
+static void stripe_write(void *aux, block_sector_t sector,
+                         const void *buffer) {
+    stripe_write_multi(aux, sector, 1, buffer);
+}
+
+static struct block_operations stripe_operations = {
+    stripe_read,
+    stripe_write,
+    stripe_read_multi,
+    stripe_write_multi,
+    NULL,
+    NULL
+};
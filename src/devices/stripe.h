@@ -0,0 +1,6 @@
+#ifndef DEVICES_STRIPE_H
+#define DEVICES_STRIPE_H
+
+void stripe_init(const char *members);
+
+#endif /* devices/stripe.h */
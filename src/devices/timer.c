@@ -23,6 +23,9 @@
 /*! Number of timer ticks since OS booted. */
 static int64_t ticks;
 
+/*! PIT cycles per timer tick. */
+#define PIT_CYCLES_PER_TICK ((PIT_HZ + TIMER_FREQ / 2) / TIMER_FREQ)
+
 /*! Number of loops per timer tick.  Initialized by timer_calibrate(). */
 static unsigned loops_per_tick;
 
@@ -132,6 +135,25 @@ void timer_ndelay(int64_t ns) {
     real_time_delay(ns, 1000 * 1000 * 1000);
 }
 
+/*! Returns the number of microseconds since the OS booted, to within a few
+    microseconds: the timer ticks plus the part of the current tick that
+    the PIT has counted off.  Never goes backward, even if a tick is due
+    but its interrupt has not been taken yet. */
+int64_t timer_usecs(void) {
+    static int64_t last;
+    enum intr_level old_level = intr_disable();
+    unsigned count = pit_read_counter(0);
+    int64_t usecs = (ticks * (1000 * 1000 / TIMER_FREQ)
+                     + (int64_t) (PIT_CYCLES_PER_TICK - count) * 1000 * 1000
+                       / PIT_HZ);
+
+    if (usecs < last)
+        usecs = last;
+    last = usecs;
+    intr_set_level(old_level);
+    return usecs;
+}
+
 /*! Prints timer statistics. */
 void timer_print_stats(void) {
     printf("Timer: %"PRId64" ticks\n", timer_ticks());
@@ -0,0 +1,447 @@
+/*! \file virtio-blk.c
+
+   A driver for virtio block devices on the PCI bus, such as QEMU's
+   "-drive file=DISK,if=virtio", which it names "vda", "vdb", and so on.
+   It speaks the legacy virtio interface through I/O ports in BAR 0,
+   which QEMU's transitional devices offer, and uses no optional
+   features.
+
+   Requests go straight from block_submit() onto the device's single
+   request queue, a "virtqueue" in memory that the device reads on its
+   own, without a dispatcher thread.  Each request takes three
+   descriptors: a header naming the operation and sector, the data, and
+   a status byte for the device to fill in.  A request can therefore be
+   of any length and as many are in flight as there are descriptors for,
+   from any number of threads.  The device interrupts when it has put
+   finished requests on the queue's "used" ring.  See [VIRTIO] 2.4 and
+   5.2, "Legacy Interface" sections.
+
+   The device needs physical addresses, which are only known for kernel
+   memory.  A request whose buffer is elsewhere is carried out a page
+   at a time through a bounce page, synchronously in the submitting
+   thread, whose page directory maps the buffer, rather than in the
+   interrupt handler. */
+
+#include "devices/virtio-blk.h"
+#include <debug.h>
+#include <round.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/block.h"
+#include "devices/partition.h"
+#include "devices/pci.h"
+#include "threads/interrupt.h"
+#include "threads/io.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/*! PCI IDs of a legacy or transitional virtio block device. @{ */
+#define VIRTIO_VENDOR_ID 0x1af4
+#define VIRTIO_BLK_DEVICE_ID 0x1001
+/*! @} */
+
+/*! Legacy virtio registers, as offsets from the I/O base. @{ */
+#define VIRTIO_HOST_FEATURES 0x00       /*!< Features offered, 32 bits. */
+#define VIRTIO_GUEST_FEATURES 0x04      /*!< Features accepted, 32 bits. */
+#define VIRTIO_QUEUE_PFN 0x08           /*!< Queue page number, 32 bits. */
+#define VIRTIO_QUEUE_SIZE 0x0c          /*!< Queue entries, 16 bits. */
+#define VIRTIO_QUEUE_SELECT 0x0e        /*!< Queue to set up, 16 bits. */
+#define VIRTIO_QUEUE_NOTIFY 0x10        /*!< Queue with new requests. */
+#define VIRTIO_STATUS 0x12              /*!< Device status, 8 bits. */
+#define VIRTIO_ISR 0x13                 /*!< Interrupt status, 8 bits. */
+#define VIRTIO_BLK_CAPACITY 0x14        /*!< Size in sectors, 64 bits. */
+/*! @} */
+
+/*! Device status bits. @{ */
+#define STATUS_ACKNOWLEDGE 0x01         /*!< We have seen the device. */
+#define STATUS_DRIVER 0x02              /*!< We can drive it. */
+#define STATUS_DRIVER_OK 0x04           /*!< We are ready. */
+#define STATUS_FAILED 0x80              /*!< We gave up on it. */
+/*! @} */
+
+/*! Feature bit: the device is read-only. */
+#define VIRTIO_BLK_F_RO 5
+
+/*! Request types and statuses. @{ */
+#define VIRTIO_BLK_T_IN 0               /*!< Read. */
+#define VIRTIO_BLK_T_OUT 1              /*!< Write. */
+#define VIRTIO_BLK_S_OK 0               /*!< Success. */
+/*! @} */
+
+/*! Virtqueue layout.  The legacy interface puts the used ring on the
+    first page boundary after the available ring. @{ */
+#define VRING_ALIGN PGSIZE
+#define VRING_DESC_F_NEXT 1             /*!< Another descriptor follows. */
+#define VRING_DESC_F_WRITE 2            /*!< Device writes, not reads. */
+#define VRING_USED_F_NO_NOTIFY 1        /*!< Device needs no notify. */
+/*! @} */
+
+/*! Descriptors per request: header, data, status. */
+#define DESCS_PER_REQUEST 3
+
+/*! Most virtio block devices we drive. */
+#define VIRTIO_BLK_MAX_DEVS 4
+
+/*! A buffer descriptor. */
+struct vring_desc {
+    uint64_t addr;                      /*!< Physical address. */
+    uint32_t len;                       /*!< Length in bytes. */
+    uint16_t flags;                     /*!< VRING_DESC_F_*. */
+    uint16_t next;                      /*!< Next descriptor in chain. */
+};
+
+/*! Requests made available to the device. */
+struct vring_avail {
+    uint16_t flags;
+    uint16_t idx;                       /*!< Where the next entry goes. */
+    uint16_t ring[];                    /*!< First descriptor of each. */
+};
+
+/*! A request the device has finished. */
+struct vring_used_elem {
+    uint32_t id;                        /*!< Its first descriptor. */
+    uint32_t len;                       /*!< Bytes the device wrote. */
+};
+
+/*! Requests the device has finished. */
+struct vring_used {
+    uint16_t flags;                     /*!< VRING_USED_F_*. */
+    uint16_t idx;                       /*!< Where the next entry goes. */
+    struct vring_used_elem ring[];
+};
+
+/*! The header that begins a request. */
+struct virtio_blk_header {
+    uint32_t type;                      /*!< VIRTIO_BLK_T_*. */
+    uint32_t ioprio;                    /*!< Unused, zero. */
+    uint64_t sector;                    /*!< First sector. */
+};
+
+/*! A request slot: one group of DESCS_PER_REQUEST descriptors, whose
+    first descriptor is DESCS_PER_REQUEST times the slot's index. */
+struct slot {
+    struct virtio_blk_header header;    /*!< Read by the device. */
+    uint8_t status;                     /*!< Written by the device. */
+    struct block_request *req;          /*!< Request in flight, or null. */
+    bool bounced;                       /*!< Part of a bounced request,
+                                             to wake rather than
+                                             complete? */
+};
+
+/*! A virtio block device. */
+struct virtio_blk {
+    char name[8];                       /*!< Name, e.g. "vda". */
+    struct block *block;                /*!< Block device, once registered. */
+    uint16_t io_base;                   /*!< Base of legacy registers. */
+    uint8_t irq;                        /*!< Interrupt vector. */
+
+    uint16_t queue_size;                /*!< Descriptors in the queue. */
+    struct vring_desc *desc;            /*!< Descriptor table. */
+    struct vring_avail *avail;          /*!< Available ring. */
+    struct vring_used *used;            /*!< Used ring. */
+    uint16_t last_used;                 /*!< Next used entry to look at. */
+
+    struct slot *slots;                 /*!< Request slots. */
+    size_t slot_cnt;                    /*!< Number of slots. */
+    struct semaphore free_slots;        /*!< Counts slots without REQ. */
+    size_t next_slot;                   /*!< Where to look for a free one. */
+
+    unsigned long long notifies;        /*!< Queue notifications sent. */
+    unsigned long long interrupts;      /*!< Interrupts taken. */
+};
+
+static struct virtio_blk devices[VIRTIO_BLK_MAX_DEVS];
+static size_t device_cnt;
+
+static struct block_operations virtio_blk_operations;
+
+static bool setup_device(struct virtio_blk *, struct pci_dev *);
+static bool setup_queue(struct virtio_blk *);
+static void submit_bounced(struct virtio_blk *, struct block_request *);
+static void post(struct virtio_blk *, struct block_request *, bool bounced);
+static void interrupt_handler(struct intr_frame *);
+
+/*! Finds the virtio block devices on the PCI bus and registers each
+    one, and its partitions, with the block layer.  Must be called after
+    pci_init(). */
+void virtio_blk_init(void) {
+    struct pci_dev *pci = NULL;
+
+    while ((pci = pci_find_id(VIRTIO_VENDOR_ID, VIRTIO_BLK_DEVICE_ID, pci))
+           != NULL) {
+        struct virtio_blk *d;
+
+        if (device_cnt >= VIRTIO_BLK_MAX_DEVS) {
+            printf("virtio-blk: too many devices, ignoring the rest\n");
+            break;
+        }
+        d = &devices[device_cnt];
+        snprintf(d->name, sizeof d->name, "vd%c", (int) ('a' + device_cnt));
+        setup_device(d, pci);
+    }
+}
+
+/*! Prints statistics for each virtio block device. */
+void virtio_blk_print_stats(void) {
+    size_t i;
+
+    for (i = 0; i < device_cnt; i++)
+        printf("%s: %llu notifies, %llu interrupts, %zu request slots\n",
+               devices[i].name, devices[i].notifies, devices[i].interrupts,
+               devices[i].slot_cnt);
+}
+
+/*! Brings up the device PCI as D and, if it can be used, adds it to
+    DEVICES and registers it.  Returns true if successful. */
+static bool setup_device(struct virtio_blk *d, struct pci_dev *pci) {
+    char extra_info[64];
+    uint32_t features;
+    uint64_t capacity;
+    unsigned irq_line;
+    static uint16_t irqs_registered;
+
+    d->io_base = pci_io_bar(pci, 0);
+    irq_line = pci_read_config(pci, PCI_REG_IRQ) & 0xff;
+    if (d->io_base == 0 || irq_line >= 16) {
+        printf("%s: no I/O ports or interrupt line, ignoring\n", d->name);
+        return false;
+    }
+    d->irq = irq_line + 0x20;
+    pci_enable(pci, PCI_CMD_IO | PCI_CMD_MASTER);
+
+    /* Reset, then tell the device we know what it is, and take none of
+       its optional features. */
+    outb(d->io_base + VIRTIO_STATUS, 0);
+    outb(d->io_base + VIRTIO_STATUS, STATUS_ACKNOWLEDGE | STATUS_DRIVER);
+    features = inl(d->io_base + VIRTIO_HOST_FEATURES);
+    outl(d->io_base + VIRTIO_GUEST_FEATURES, 0);
+
+    if (!setup_queue(d)) {
+        outb(d->io_base + VIRTIO_STATUS, STATUS_FAILED);
+        return false;
+    }
+
+    /* Interrupt lines may be shared, so one handler serves them all. */
+    if (!(irqs_registered & (1u << irq_line))) {
+        irqs_registered |= 1u << irq_line;
+        intr_register_ext(d->irq, interrupt_handler, "virtio-blk");
+    }
+    outb(d->io_base + VIRTIO_STATUS,
+         STATUS_ACKNOWLEDGE | STATUS_DRIVER | STATUS_DRIVER_OK);
+
+    capacity = (inl(d->io_base + VIRTIO_BLK_CAPACITY)
+                | (uint64_t) inl(d->io_base + VIRTIO_BLK_CAPACITY + 4) << 32);
+    if (capacity > (block_sector_t) -1)
+        capacity = (block_sector_t) -1;
+    snprintf(extra_info, sizeof extra_info, "virtio, %u-entry queue%s",
+             d->queue_size,
+             features & (1u << VIRTIO_BLK_F_RO) ? ", read-only" : "");
+    device_cnt++;
+    d->block = block_register(d->name, BLOCK_RAW, extra_info, capacity,
+                              &virtio_blk_operations, d);
+    partition_scan(d->block);
+    return true;
+}
+
+/*! Allocates D's request queue, sized as the device asks, and its
+    request slots, and gives the queue to the device.  Returns false on
+    failure. */
+static bool setup_queue(struct virtio_blk *d) {
+    size_t avail_size, used_size, page_cnt, i;
+    uint8_t *ring;
+
+    outw(d->io_base + VIRTIO_QUEUE_SELECT, 0);
+    d->queue_size = inw(d->io_base + VIRTIO_QUEUE_SIZE);
+    if (d->queue_size < DESCS_PER_REQUEST) {
+        printf("%s: no usable request queue\n", d->name);
+        return false;
+    }
+
+    /* The descriptors, the available ring and the used ring, which the
+       device expects in one physically contiguous, page-aligned run,
+       as our kernel pool gives. */
+    avail_size = (d->queue_size * sizeof *d->desc + sizeof *d->avail
+                  + (d->queue_size + 1) * sizeof d->avail->ring[0]);
+    used_size = (sizeof *d->used
+                 + d->queue_size * sizeof d->used->ring[0] + sizeof (uint16_t));
+    page_cnt = (ROUND_UP(avail_size, VRING_ALIGN)
+                + ROUND_UP(used_size, VRING_ALIGN)) / PGSIZE;
+    ring = palloc_get_multiple(PAL_ZERO, page_cnt);
+    d->slot_cnt = d->queue_size / DESCS_PER_REQUEST;
+    d->slots = calloc(d->slot_cnt, sizeof *d->slots);
+    if (ring == NULL || d->slots == NULL) {
+        printf("%s: out of memory for %u-entry queue\n",
+               d->name, d->queue_size);
+        palloc_free_multiple(ring, page_cnt);
+        free(d->slots);
+        return false;
+    }
+    d->desc = (struct vring_desc *) ring;
+    d->avail = (struct vring_avail *) (ring + d->queue_size * sizeof *d->desc);
+    d->used = (struct vring_used *) (ring + ROUND_UP(avail_size, VRING_ALIGN));
+    d->last_used = 0;
+    d->next_slot = 0;
+    sema_init(&d->free_slots, d->slot_cnt);
+    d->notifies = d->interrupts = 0;
+
+    /* Each slot's descriptors are chained once and for all. */
+    for (i = 0; i < d->slot_cnt; i++) {
+        struct vring_desc *desc = &d->desc[i * DESCS_PER_REQUEST];
+        desc[0].addr = vtop(&d->slots[i].header);
+        desc[0].len = sizeof d->slots[i].header;
+        desc[0].flags = VRING_DESC_F_NEXT;
+        desc[0].next = i * DESCS_PER_REQUEST + 1;
+        desc[1].flags = VRING_DESC_F_NEXT;
+        desc[1].next = i * DESCS_PER_REQUEST + 2;
+        desc[2].addr = vtop(&d->slots[i].status);
+        desc[2].len = sizeof d->slots[i].status;
+        desc[2].flags = VRING_DESC_F_WRITE;
+    }
+
+    outl(d->io_base + VIRTIO_QUEUE_PFN, vtop(ring) / PGSIZE);
+    return true;
+}
+
+/*! Puts REQ on D's queue. */
+static void virtio_blk_submit(void *d_, struct block_request *req) {
+    struct virtio_blk *d = d_;
+
+    if (is_kernel_vaddr(req->buffer))
+        post(d, req, false);
+    else
+        submit_bounced(d, req);
+}
+
+/*! Carries out REQ, whose buffer is not in kernel memory, a page at a
+    time through a bounce page, and waits for it to complete. */
+static void submit_bounced(struct virtio_blk *d, struct block_request *req) {
+    uint8_t *bounce = palloc_get_page(0);
+    size_t done;
+
+    if (bounce == NULL)
+        PANIC("%s: out of memory for bounce page", d->name);
+    for (done = 0; done < req->cnt; ) {
+        uint8_t *p = (uint8_t *) req->buffer + done * BLOCK_SECTOR_SIZE;
+        size_t cnt = req->cnt - done;
+        struct block_request part;
+
+        if (cnt > PGSIZE / BLOCK_SECTOR_SIZE)
+            cnt = PGSIZE / BLOCK_SECTOR_SIZE;
+        if (req->write)
+            memcpy(bounce, p, cnt * BLOCK_SECTOR_SIZE);
+        block_request_init(&part, req->write, req->dev_sector + done, cnt,
+                           bounce, NULL, NULL);
+        part.dev_sector = part.sector;
+        post(d, &part, true);
+        sema_down(&part.finished);
+        if (!req->write)
+            memcpy(p, bounce, cnt * BLOCK_SECTOR_SIZE);
+        done += cnt;
+    }
+    palloc_free_page(bounce);
+    block_complete(d->block, req);
+}
+
+/*! Puts REQ, whose buffer must be in kernel memory, on D's queue, first
+    waiting for a free slot if all of them are in flight.  If BOUNCED,
+    REQ is part of a bounced request, and its FINISHED semaphore is
+    raised when it is done instead of completing it. */
+static void post(struct virtio_blk *d, struct block_request *req,
+                 bool bounced) {
+    struct vring_desc *desc;
+    enum intr_level old_level;
+    struct slot *s;
+    size_t i;
+
+    ASSERT(is_kernel_vaddr(req->buffer));
+    sema_down(&d->free_slots);
+
+    /* Claim a slot.  Slots are freed by the interrupt handler. */
+    old_level = intr_disable();
+    for (i = d->next_slot; d->slots[i].req != NULL;
+         i = (i + 1) % d->slot_cnt)
+        continue;
+    d->next_slot = (i + 1) % d->slot_cnt;
+    s = &d->slots[i];
+    s->req = req;
+    s->bounced = bounced;
+    intr_set_level(old_level);
+
+    s->header.type = req->write ? VIRTIO_BLK_T_OUT : VIRTIO_BLK_T_IN;
+    s->header.ioprio = 0;
+    s->header.sector = req->dev_sector;
+    s->status = 0xff;
+    desc = &d->desc[i * DESCS_PER_REQUEST];
+    desc[1].addr = vtop(req->buffer);
+    desc[1].len = req->cnt * BLOCK_SECTOR_SIZE;
+    desc[1].flags = VRING_DESC_F_NEXT | (req->write ? 0 : VRING_DESC_F_WRITE);
+
+    /* Make the request available.  The device must see the descriptors
+       before the ring entry and the entry before the new index; x86
+       keeps stores in order, so compiler barriers suffice. */
+    old_level = intr_disable();
+    d->avail->ring[d->avail->idx % d->queue_size] = i * DESCS_PER_REQUEST;
+    barrier();
+    d->avail->idx++;
+    barrier();
+    if (!(d->used->flags & VRING_USED_F_NO_NOTIFY)) {
+        outw(d->io_base + VIRTIO_QUEUE_NOTIFY, 0);
+        d->notifies++;
+    }
+    intr_set_level(old_level);
+}
+
+/*! Completes the requests that D has finished. */
+static void reap(struct virtio_blk *d) {
+    while (d->last_used != d->used->idx) {
+        struct vring_used_elem *e;
+        struct block_request *req;
+        struct slot *s;
+        bool bounced;
+
+        barrier();
+        e = &d->used->ring[d->last_used % d->queue_size];
+        ASSERT(e->id % DESCS_PER_REQUEST == 0);
+        s = &d->slots[e->id / DESCS_PER_REQUEST];
+        req = s->req;
+        ASSERT(req != NULL);
+        if (s->status != VIRTIO_BLK_S_OK)
+            PANIC("%s: %s failed at sector %"PRDSNu" (status %d)",
+                  d->name, req->write ? "write" : "read", req->dev_sector,
+                  s->status);
+        bounced = s->bounced;
+        s->req = NULL;
+        d->last_used++;
+        sema_up(&d->free_slots);
+        if (bounced)
+            sema_up(&req->finished);
+        else
+            block_complete(d->block, req);
+    }
+}
+
+/*! Virtio block interrupt handler.  Reading a device's interrupt status
+    register acknowledges the interrupt. */
+static void interrupt_handler(struct intr_frame *f) {
+    size_t i;
+
+    for (i = 0; i < device_cnt; i++) {
+        struct virtio_blk *d = &devices[i];
+        if (d->irq == f->vec_no && (inb(d->io_base + VIRTIO_ISR) & 1)) {
+            d->interrupts++;
+            reap(d);
+        }
+    }
+}
+
+/*! Virtio block operations.  Every request goes through submit. */
+static struct block_operations virtio_blk_operations = {
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    virtio_blk_submit
+};
@@ -0,0 +1,13 @@
+/* iostat.c
+
+   Prints the kernel's disk I/O statistics gathered so far: request
+   sizes, queue waits, service times and queue depths for each disk. */
+
+#include <syscall.h>
+
+int
+main (void)
+{
+  iostat ();
+  return EXIT_SUCCESS;
+}
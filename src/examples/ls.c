@@ -6,7 +6,9 @@
 
    By default, only the name of each file is printed.  If "-l" is
    given as the first argument, the type, size, and inumber of
-   each file is also printed.  This won't work until project 4. */
+   each file is also printed.  This won't work until project 4.
+
+   Entries are fetched with getdents(), a batch per system call. */
 
 #include <syscall.h>
 #include <stdio.h>
@@ -24,38 +26,47 @@ list_dir (const char *dir, bool verbose)
 
   if (isdir (dir_fd))
     {
-      char name[READDIR_MAX_LEN];
+      struct dirent ents[16];
+      unsigned cookie = 0;
+      int cnt;
 
       printf ("%s", dir);
       if (verbose)
         printf (" (inumber %d)", inumber (dir_fd));
       printf (":\n");
 
-      while (readdir (dir_fd, name)) 
+      while ((cnt = getdents (dir_fd, ents, 16, &cookie)) > 0)
         {
-          printf ("%s", name); 
-          if (verbose) 
-            {
-              char full_name[128];
-              int entry_fd;
-
-              snprintf (full_name, sizeof full_name, "%s/%s", dir, name);
-              entry_fd = open (full_name);
+          int i;
 
-              printf (": ");
-              if (entry_fd != -1)
+          for (i = 0; i < cnt; i++)
+            {
+              printf ("%s", ents[i].name);
+              if (verbose)
                 {
-                  if (isdir (entry_fd))
+                  printf (": ");
+                  if (ents[i].is_dir)
                     printf ("directory");
                   else
-                    printf ("%d-byte file", filesize (entry_fd));
-                  printf (", inumber %d", inumber (entry_fd));
+                    {
+                      char full_name[128];
+                      int entry_fd;
+
+                      snprintf (full_name, sizeof full_name, "%s/%s",
+                                dir, ents[i].name);
+                      entry_fd = open (full_name);
+                      if (entry_fd != -1)
+                        {
+                          printf ("%d-byte file", filesize (entry_fd));
+                          close (entry_fd);
+                        }
+                      else
+                        printf ("open failed");
+                    }
+                  printf (", inumber %d", ents[i].inumber);
                 }
-              else
-                printf ("open failed");
-              close (entry_fd);
+              printf ("\n");
             }
-          printf ("\n");
         }
     }
   else 
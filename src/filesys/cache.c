@@ -1,6 +1,7 @@
 #include "devices/block.h"
 #include "devices/timer.h"
 #include "filesys/cache.h"
+#include "filesys/compress.h"
 #include "filesys/filesys.h"
 #include "threads/malloc.h"
 #include "threads/thread.h"
@@ -15,18 +16,35 @@
 #define FS_BUF_INUSE 1
 #define FS_BUF_ACCESSED 2
 #define FS_BUF_DIRTY (4 | FS_BUF_ACCESSED)
+#define FS_BUF_PINNED 8
+
+/* Random picks choice_to_evict() makes before waiting for a slot.
+ * Pinned slots are never evicted, but the journal pins fewer than
+ * BUF_NUM_SLOTS, so some slot is always evictable once it is free. */
+#define EVICT_TRIES (4 * BUF_NUM_SLOTS)
 
 struct cache_slot {
     block_sector_t sect_id;          /* Sector stored here. */
+    block_sector_t group;            /* First block of the compressed
+                                        group it belongs to, or
+                                        CACHE_NO_GROUP. */
     struct lock bflock;              /* Lock to prevent race conditions. */
-    unsigned flags;                  /* Dirty, In use, Accessed. */
-    char content[BLOCK_SECTOR_SIZE]; /* The actual contents on disk. */
+    unsigned flags;                  /* Dirty, In use, Accessed, Pinned. */
+    char *content;                   /* The actual contents on disk, one
+                                        logical block. */
 };
 
 /* One struct cache_slot per slot in the buffer. */
 struct lock full_buf_lock;
 static struct cache_slot fs_buffer[BUF_NUM_SLOTS];
 
+/* Write requests that flush_slots() has in flight, one per slot at
+ * most, and the slots they write from.  flush_lock serializes their
+ * use. */
+static struct lock flush_lock;
+static struct block_request flush_reqs[BUF_NUM_SLOTS];
+static int flush_slot_ids[BUF_NUM_SLOTS];
+
 /* A writeback daemon that occassional backs up the cache to disk. */
 static pid_t daemon_pid;
 static bool daemon_should_live;
@@ -34,15 +52,26 @@ static void cache_daemon(void *aux);
 
 /* Finds the index of the sector in the cache if present */
 static int buff_lookup(block_sector_t);
+static int get_slot(block_sector_t, bool *found);
 
 /* Routines to find an empty slot, or create an empty slot */
 static int force_empty_slot(void);
 static int passive_empty_slot(void);
 static int choice_to_evict(void);
 
-/* Physical writes to the disk, if necessary. */
+/* Reads from and writes into the cache, pinning the sector if asked. */
+static void read_slot(block_sector_t group, block_sector_t sect, void *addr,
+        off_t offset, off_t size);
+static void write_slot(block_sector_t group, block_sector_t sect,
+        const void *addr, off_t offset, off_t size, bool pin);
+
+/* Physical reads and writes, if necessary. */
+static void fill(int);
 static void writeback(int);
+static void writeback_group(int);
 static void writeback_all(void);
+static void flush_slots(bool wait);
+static void finish_flush(int cnt);
 
 /* Thread func for reading ahead in the background, and caller. */
 static void read_ahead(void *aux);
@@ -58,9 +87,11 @@ static void set_dirty(int slot);
 static void clear_dirty(int slot);
 static bool is_dirty(int slot);
 static bool is_inuse(int slot);
+static bool is_pinned(int slot);
 
 /* Synchronization wrappers. */
 static bool slot_try_acquire(int slot_id);
+static int slot_acquire_sect(int slot_id, block_sector_t sect);
 static void slot_release(int slot_id);
 
 /* Debugging checks. */
@@ -72,9 +103,14 @@ static void at_most_one(void);
 void cache_init(void) {
 
      lock_init(&full_buf_lock);
+     lock_init(&flush_lock);
      int i;
      for (i = 0; i < BUF_NUM_SLOTS; i++) {
          lock_init(&fs_buffer[i].bflock);
+         fs_buffer[i].content = malloc(fs_block_size);
+         if (fs_buffer[i].content == NULL) {
+             PANIC("can't allocate buffer cache");
+         }
      }
     daemon_should_live = true;
     /*daemon_pid = thread_create("cache_daemon", PRI_DEFAULT, cache_daemon,
@@ -92,27 +128,44 @@ void cache_destroy(void) {
  * Will consult the cache and only go to the disk if necessary. */
 void cache_read_spec(block_sector_t sect, void *addr, off_t offset,
         off_t size) {
+    read_slot(CACHE_NO_GROUP, sect, addr, offset, size);
+}
+
+/* Like cache_read_spec, for a block of the compressed group that begins
+ * at group.  If the block is not cached, the group is read and
+ * decompressed to fill it. */
+void cache_read_group(block_sector_t group, block_sector_t sect,
+        void *addr, off_t offset, off_t size) {
+    ASSERT(sect - group < BLOCKS_PER_GROUP);
+    read_slot(group, sect, addr, offset, size);
+}
+
+/* Does the work of cache_read_spec and cache_read_group. */
+static void read_slot(block_sector_t group, block_sector_t sect, void *addr,
+        off_t offset, off_t size) {
     ASSERT(offset >= 0);
     ASSERT(size >= 0);
     at_most_one();
-    ASSERT(size + offset <= BLOCK_SECTOR_SIZE);
+    ASSERT(size + offset <= (off_t) fs_block_size);
 
     char *buff_actual;
     int slot_id;
-    ASSERT(sect <= block_size(fs_device));
+    ASSERT(sect < fs_block_cnt());
+
+    bool found;
 
     lock_acquire(&full_buf_lock);
 
-    if ((slot_id = buff_lookup(sect)) != -1) {
+    slot_id = get_slot(sect, &found);
+    if (found) {
         ASSERT(have_slot(slot_id));
         ASSERT(fs_buffer[slot_id].sect_id == sect);
         have_slot(slot_id);
 
         buff_actual = fs_buffer[slot_id].content;
+        fs_buffer[slot_id].group = group;
         lock_release(&full_buf_lock);
     } else {
-        slot_id = force_empty_slot();
-
         ASSERT(have_slot(slot_id));
         ASSERT(0 <= slot_id);
         at_most_one();
@@ -120,9 +173,10 @@ void cache_read_spec(block_sector_t sect, void *addr, off_t offset,
         ASSERT(have_slot(slot_id));
         set_sect(slot_id, sect);
         set_inuse(slot_id);
+        fs_buffer[slot_id].group = group;
         buff_actual = fs_buffer[slot_id].content;
         lock_release(&full_buf_lock);
-        block_read(fs_device, sect, buff_actual);
+        fill(slot_id);
     }
     //async_read(sect + 1);
     at_most_one();
@@ -134,51 +188,128 @@ void cache_read_spec(block_sector_t sect, void *addr, off_t offset,
  * but of course checks if it is in the cache first. */
 void cache_write_spec(block_sector_t sect, const void *addr, off_t offset,
         off_t size) {
+    write_slot(CACHE_NO_GROUP, sect, addr, offset, size, false);
+}
+
+/* Like cache_write_spec, for a block of the compressed group that
+ * begins at group.  The group is compressed and written whole when the
+ * block is written back. */
+void cache_write_group(block_sector_t group, block_sector_t sect,
+        const void *addr, off_t offset, off_t size) {
+    ASSERT(sect - group < BLOCKS_PER_GROUP);
+    write_slot(group, sect, addr, offset, size, false);
+}
+
+/* Like cache_write_spec, but also pins the sector in the cache: it is
+ * not written back to disk, by eviction or otherwise, until
+ * cache_unpin is called.  Used by the journal to hold back metadata
+ * until it has been logged. */
+void cache_write_pinned(block_sector_t sect, const void *addr, off_t offset,
+        off_t size) {
+    write_slot(CACHE_NO_GROUP, sect, addr, offset, size, true);
+}
+
+/* Does the work of cache_write_spec, cache_write_group and
+ * cache_write_pinned. */
+static void write_slot(block_sector_t group, block_sector_t sect,
+        const void *addr, off_t offset, off_t size, bool pin) {
     ASSERT(offset >= 0);
     ASSERT(size >= 0);
-    ASSERT(size + offset <= BLOCK_SECTOR_SIZE);
+    ASSERT(size + offset <= (off_t) fs_block_size);
     char *buff_actual;
     int slot_id;
+    bool found;
     lock_acquire(&full_buf_lock);
     at_most_one();
-    if ((slot_id = buff_lookup(sect)) != -1) {
+    slot_id = get_slot(sect, &found);
+    if (found) {
 
         ASSERT(have_slot(slot_id));
         ASSERT(fs_buffer[slot_id].sect_id == sect);
         ASSERT(is_inuse(slot_id));
 
         buff_actual = fs_buffer[slot_id].content;
+        fs_buffer[slot_id].group = group;
         set_dirty(slot_id);
         lock_release(&full_buf_lock);
     } else {
-        slot_id = force_empty_slot();
-
         ASSERT(have_slot(slot_id));
         ASSERT(slot_id >= 0);
         ASSERT(slot_id < BUF_NUM_SLOTS);
 
         fs_buffer[slot_id].sect_id = sect;
+        fs_buffer[slot_id].group = group;
         set_inuse(slot_id);
         set_dirty(slot_id);
         buff_actual = fs_buffer[slot_id].content;
         lock_release(&full_buf_lock);
-        if (offset > 0 || offset + size < BLOCK_SECTOR_SIZE) {
-            block_read(fs_device, sect, buff_actual);
+        if (offset > 0 || offset + size < (off_t) fs_block_size) {
+            fill(slot_id);
         } else {
-            memset(buff_actual, 0, BLOCK_SECTOR_SIZE);
+            memset(buff_actual, 0, fs_block_size);
         }
     }
     ASSERT(is_dirty(slot_id));
+    if (pin) {
+        fs_buffer[slot_id].flags |= FS_BUF_PINNED;
+    }
     memcpy(buff_actual + offset, addr, size);
     slot_release(slot_id);
 }
 
 void cache_read(block_sector_t sect, void *addr) {
-    cache_read_spec(sect, addr, 0, BLOCK_SECTOR_SIZE);
+    cache_read_spec(sect, addr, 0, fs_block_size);
 }
 
 void cache_write(block_sector_t sect, const void *addr) {
-    cache_write_spec(sect, addr, 0, BLOCK_SECTOR_SIZE);
+    cache_write_spec(sect, addr, 0, fs_block_size);
+}
+
+/* Lets the sector sect be written back again, if it is cached. */
+void cache_unpin(block_sector_t sect) {
+    int slot_id;
+    lock_acquire(&full_buf_lock);
+    slot_id = buff_lookup(sect);
+    lock_release(&full_buf_lock);
+    if (slot_id != -1) {
+        fs_buffer[slot_id].flags &= ~FS_BUF_PINNED;
+        slot_release(slot_id);
+    }
+}
+
+/* Writes the cached copy of sect back to disk if it is dirty, so that
+ * the disk holds its latest contents. */
+void cache_sync(block_sector_t sect) {
+    int slot_id;
+    lock_acquire(&full_buf_lock);
+    slot_id = buff_lookup(sect);
+    lock_release(&full_buf_lock);
+    if (slot_id != -1) {
+        if (!is_pinned(slot_id)) {
+            writeback(slot_id);
+        }
+        slot_release(slot_id);
+    }
+}
+
+/* Drops the cached copy of sect, if any, without writing it back, even
+ * if it is pinned.  For when the whole sector is about to be
+ * overwritten on disk, or has been freed. */
+void cache_discard(block_sector_t sect) {
+    int slot_id;
+    lock_acquire(&full_buf_lock);
+    slot_id = buff_lookup(sect);
+    if (slot_id != -1) {
+        set_unused(slot_id);
+        slot_release(slot_id);
+    }
+    lock_release(&full_buf_lock);
+}
+
+/* Writes every dirty, unpinned sector back to disk.  Unlike the
+ * writebacks done at shutdown, waits for slots that are busy. */
+void cache_flush(void) {
+    flush_slots(true);
 }
         
 /* Regularly scheduled writebacks*/
@@ -191,7 +322,8 @@ void cache_daemon(void *aux UNUSED) {
 }
 
 /* Finds the slot that the sector is loaded into, returns
- * -1 on inability to locate it. */
+ * -1 on inability to locate it. If the slot is busy, waits for it
+ * rather than let the sector be loaded into a second slot. */
 int buff_lookup(block_sector_t sect) {
     ASSERT(have_buffer());
     int i;
@@ -201,21 +333,48 @@ int buff_lookup(block_sector_t sect) {
         }
         if (fs_buffer[i].sect_id == sect) {
             ASSERT(!have_slot(i));
-            if(slot_try_acquire(i)) {
+            if (slot_try_acquire(i)) {
+                return i;
+            }
+            if (slot_acquire_sect(i, sect) != -1) {
                 return i;
-            } else {
-                return -1;
             }
+            /* Evicted while we waited; look again. */
+            i = -1;
         }
     }
     return -1;
 }
 
+/* Returns the slot holding sect, held, and sets *found to true, or
+ * else an empty slot, held, to load it into and sets *found to false.
+ * If the buffer lock had to be let go while looking for an empty slot,
+ * sect may have been loaded meanwhile, so this looks for it again. */
+int get_slot(block_sector_t sect, bool *found) {
+    int slot_id;
+    for (;;) {
+        slot_id = buff_lookup(sect);
+        *found = slot_id != -1;
+        if (*found) {
+            return slot_id;
+        }
+        slot_id = force_empty_slot();
+        if (slot_id != -1) {
+            return slot_id;
+        }
+    }
+}
+
+/* Returns an empty slot, held, evicting a sector if need be, or -1 if
+ * the buffer lock had to be let go while waiting for a slot. */
 int force_empty_slot(void) {
     ASSERT(have_buffer());
     int ret = passive_empty_slot();
     if (ret == -1) {
         ret = choice_to_evict();
+        if (ret == -1) {
+            return -1;
+        }
         ASSERT(have_slot(ret));
         writeback(ret);
         set_unused(ret);
@@ -240,42 +399,164 @@ int passive_empty_slot(void) {
     return -1;
 }
 
+/* Picks a slot to evict at random and returns it, held.  Pinned slots
+ * hold metadata that must not reach the disk before the journal has
+ * committed it, so they are never picked.  If EVICT_TRIES picks find
+ * nothing, waits for a busy slot that is not pinned, letting go of the
+ * buffer lock meanwhile, and returns -1. */
 int choice_to_evict(void) {
     random_init((unsigned) timer_ticks());
     int num;
-    do {
+    int tries;
+    for (tries = 0; tries < EVICT_TRIES; tries++) {
         at_most_one();
         num = (int) (random_ulong() % BUF_NUM_SLOTS);
         ASSERT(!have_slot(num));
-    } while (!slot_try_acquire(num));
-    ASSERT(num >= 0);
+        if (!slot_try_acquire(num)) {
+            continue;
+        }
+        if (!is_pinned(num)) {
+            return num;
+        }
+        slot_release(num);
+    }
+
+    for (num = 0; num < BUF_NUM_SLOTS && is_pinned(num); num++) {
+        continue;
+    }
     ASSERT(num < BUF_NUM_SLOTS);
-    return num;
+    lock_release(&full_buf_lock);
+    lock_acquire(&fs_buffer[num].bflock);
+    slot_release(num);
+    lock_acquire(&full_buf_lock);
+    return -1;
+}
+
+/* Reads the contents of cache_slot from disk, through its compressed
+ * group if it has one. */
+void fill(int cache_slot) {
+    struct cache_slot *s = &fs_buffer[cache_slot];
+    enum block_cause old_cause = block_set_cause(BLOCK_CAUSE_CACHE_FILL);
+    ASSERT(have_slot(cache_slot));
+    if (s->group != CACHE_NO_GROUP) {
+        compress_read(s->group, s->sect_id - s->group, s->content);
+    } else {
+        fs_block_read(s->sect_id, s->content);
+    }
+    block_set_cause(old_cause);
 }
 
 void writeback(int cache_slot) {
     ASSERT(have_slot(cache_slot));
     if (is_dirty(cache_slot)) {
-        block_write(fs_device, fs_buffer[cache_slot].sect_id,
-                fs_buffer[cache_slot].content);
-        clear_dirty(cache_slot);
+        enum block_cause old_cause = block_set_cause(BLOCK_CAUSE_WRITEBACK);
+        if (fs_buffer[cache_slot].group != CACHE_NO_GROUP) {
+            writeback_group(cache_slot);
+        } else {
+            fs_block_write(fs_buffer[cache_slot].sect_id,
+                    fs_buffer[cache_slot].content);
+            clear_dirty(cache_slot);
+        }
+        block_set_cause(old_cause);
     }
     set_inuse(cache_slot);
 }
 
+/* Writes back the dirty block in cache_slot as part of its compressed
+ * group, together with every other dirty block of the group whose slot
+ * can be had without waiting, so that the group is compressed and
+ * written once rather than once per block. */
+void writeback_group(int cache_slot) {
+    const void *blocks[COMPRESS_MAX_BLOCKS] = { NULL };
+    int siblings[COMPRESS_MAX_BLOCKS];
+    int sibling_cnt = 0;
+    block_sector_t group = fs_buffer[cache_slot].group;
+    int i;
+
+    ASSERT(fs_buffer[cache_slot].sect_id - group < BLOCKS_PER_GROUP);
+    blocks[fs_buffer[cache_slot].sect_id - group] =
+        fs_buffer[cache_slot].content;
+    for (i = 0; i < BUF_NUM_SLOTS; i++) {
+        struct cache_slot *s = &fs_buffer[i];
+        if (i == cache_slot || s->group != group || !is_dirty(i)) {
+            continue;
+        }
+        if (!lock_try_acquire(&s->bflock)) {
+            continue;
+        }
+        /* Check again, now that the slot cannot change. */
+        if (is_inuse(i) && is_dirty(i) && !is_pinned(i) &&
+                s->group == group && s->sect_id - group < BLOCKS_PER_GROUP) {
+            blocks[s->sect_id - group] = s->content;
+            siblings[sibling_cnt++] = i;
+        } else {
+            slot_release(i);
+        }
+    }
+    compress_write(group, blocks);
+    clear_dirty(cache_slot);
+    for (i = 0; i < sibling_cnt; i++) {
+        clear_dirty(siblings[i]);
+        slot_release(siblings[i]);
+    }
+}
+
 void writeback_all(void) {
-    int slot;
     at_most_one();
+    flush_slots(false);
+}
+
+/* Writes back every dirty, unpinned slot, skipping busy slots unless
+ * wait is true.  The writes are submitted together, so that the disk
+ * queue can order and merge them, and have all completed on return, so
+ * callers such as the journal can rely on them being on disk.  Blocks
+ * of compressed groups are written one group at a time, as usual.
+ *
+ * While it holds slots with writes in flight, this only tries for
+ * further slots; if one is busy, it first finishes the writes and lets
+ * their slots go, so that it never waits for a slot while holding
+ * another. */
+void flush_slots(bool wait) {
+    enum block_cause old_cause = block_set_cause(BLOCK_CAUSE_WRITEBACK);
+    int cnt = 0;
+    int slot;
+
+    lock_acquire(&flush_lock);
     for (slot = 0; slot < BUF_NUM_SLOTS; slot++) {
-        lock_acquire(&full_buf_lock);
-        ASSERT(!have_slot(slot));
-        bool got = slot_try_acquire(slot);
-        lock_release(&full_buf_lock);
-        if (got) {
+        struct cache_slot *s = &fs_buffer[slot];
+        if (!lock_try_acquire(&s->bflock)) {
+            if (!wait) {
+                continue;
+            }
+            finish_flush(cnt);
+            cnt = 0;
+            lock_acquire(&s->bflock);
+        }
+        if (!is_inuse(slot) || !is_dirty(slot) || is_pinned(slot)) {
+            slot_release(slot);
+        } else if (s->group != CACHE_NO_GROUP) {
             writeback(slot);
             slot_release(slot);
+        } else {
+            fs_block_submit(&flush_reqs[cnt], true, s->sect_id, 1,
+                    s->content);
+            flush_slot_ids[cnt++] = slot;
         }
     }
+    finish_flush(cnt);
+    lock_release(&flush_lock);
+    block_set_cause(old_cause);
+}
+
+/* Waits for the first cnt flush requests, then marks their slots clean
+ * and releases them. */
+void finish_flush(int cnt) {
+    int i;
+    for (i = 0; i < cnt; i++) {
+        block_wait(&flush_reqs[i]);
+        clear_dirty(flush_slot_ids[i]);
+        slot_release(flush_slot_ids[i]);
+    }
 }
 
 /* Flag manipulation. */
@@ -300,7 +581,7 @@ void set_dirty(int slot) {
 
 void clear_dirty(int slot) {
     ASSERT(have_slot(slot));
-    fs_buffer[slot].flags &= !FS_BUF_DIRTY;
+    fs_buffer[slot].flags &= ~(FS_BUF_DIRTY & ~FS_BUF_ACCESSED);
 }
 
 bool is_dirty(int slot) {
@@ -311,6 +592,10 @@ bool is_inuse(int slot) {
     return fs_buffer[slot].flags & FS_BUF_INUSE;
 }
 
+bool is_pinned(int slot) {
+    return fs_buffer[slot].flags & FS_BUF_PINNED;
+}
+
 /* Synchronization */
 bool slot_try_acquire(int slot_id) {
     ASSERT(0 <= slot_id);
@@ -322,6 +607,22 @@ bool slot_try_acquire(int slot_id) {
     return out;
 }
 
+/* Waits for slot_id while holding the buffer lock, letting it go in
+ * the meantime. Returns slot_id if the slot still holds sect once
+ * acquired, otherwise releases it and returns -1. */
+int slot_acquire_sect(int slot_id, block_sector_t sect) {
+    ASSERT(have_buffer());
+    ASSERT(!have_slot(slot_id));
+    lock_release(&full_buf_lock);
+    lock_acquire(&fs_buffer[slot_id].bflock);
+    lock_acquire(&full_buf_lock);
+    if (is_inuse(slot_id) && fs_buffer[slot_id].sect_id == sect) {
+        return slot_id;
+    }
+    slot_release(slot_id);
+    return -1;
+}
+
 void slot_release(int slot_id) {
     ASSERT(0 <= slot_id);
     ASSERT(slot_id < BUF_NUM_SLOTS);
@@ -335,13 +636,14 @@ void read_ahead(void *aux) {
     block_sector_t sect = *(block_sector_t *) aux;
     int slot_id;
     char *buff_actual;
-    if (sect > block_size(fs_device)) {
+    if (sect >= fs_block_cnt()) {
         /* Don't want to read past the bounds of the device. */
         return;
     }
+    bool found;
     lock_acquire(&full_buf_lock);
-    if ((slot_id = buff_lookup(sect)) == -1) {
-        slot_id = force_empty_slot();
+    slot_id = get_slot(sect, &found);
+    if (!found) {
         lock_release(&full_buf_lock);
 
         ASSERT(have_slot(slot_id));
@@ -350,10 +652,12 @@ void read_ahead(void *aux) {
 
         set_sect(slot_id, sect);
         fs_buffer[slot_id].sect_id = sect;
+        fs_buffer[slot_id].group = CACHE_NO_GROUP;
         set_inuse(slot_id);
         ASSERT(fs_buffer[slot_id].flags == FS_BUF_INUSE);
         buff_actual = fs_buffer[slot_id].content;
-        block_read(fs_device, sect, buff_actual);
+        block_set_cause(BLOCK_CAUSE_READ_AHEAD);
+        fs_block_read(sect, buff_actual);
         slot_release(slot_id);
     } else {
         slot_release(slot_id);
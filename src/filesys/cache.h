@@ -14,8 +14,26 @@ void cache_read_spec(block_sector_t sect, void *target, off_t start,
 void cache_write_spec(block_sector_t sect, const void *source, off_t start,
         off_t size);
 
-/* Sane defaults for start and size. */
+/* Blocks of compressed files, which belong to the group that begins at
+ * block GROUP, or to none if GROUP is CACHE_NO_GROUP. */
+#define CACHE_NO_GROUP ((block_sector_t) -1)
+void cache_read_group(block_sector_t group, block_sector_t sect,
+        void *target, off_t start, off_t size);
+void cache_write_group(block_sector_t group, block_sector_t sect,
+        const void *source, off_t start, off_t size);
+
+/* Whole blocks. */
 void cache_read(block_sector_t sect, void *target);
 void cache_write(block_sector_t sect, const void *source);
 
+/* Holding back and forcing writes, for the journal. */
+void cache_write_pinned(block_sector_t sect, const void *source, off_t start,
+        off_t size);
+void cache_unpin(block_sector_t sect);
+void cache_flush(void);
+
+/* Keeping the cache coherent with I/O that bypasses it. */
+void cache_sync(block_sector_t sect);
+void cache_discard(block_sector_t sect);
+
 #endif /* FILESYS_CACHE_H */
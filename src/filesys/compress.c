@@ -0,0 +1,298 @@
+/*
+ * Compressed block groups.
+ *
+ * The data of a compressed file is stored a block group at a time: the
+ * BLOCKS_PER_GROUP blocks, one page in all, that append_sector() hands
+ * out together.  When the buffer cache writes back dirty blocks of such
+ * a file, it passes compress_write() all the dirty blocks of the group
+ * it can get hold of.  The whole group is compressed with lz_compress()
+ * and written to the first device sectors of the group, behind a
+ * header.  A group that does not compress by at least one sector is
+ * written as is.  The group keeps all of its blocks either way, so
+ * compression saves no space on disk, only device transfers, which with
+ * programmed I/O cost processor time for every byte.
+ *
+ * Which groups were written compressed is recorded out of band, in the
+ * packed map: one bit per block, set for the first block of each group
+ * last written compressed, kept in blocks allocated when the file system
+ * is formatted and written through as soon as a bit changes.  The bit
+ * describes whatever was last written at that place on disk, so it is
+ * left alone when a group is freed.  A bit is set before a compressed
+ * group is written and cleared only after a group is written as is, so
+ * a crash in between leaves a set bit over raw data, never the reverse.
+ * The header's magic number and checksum catch that case, but never
+ * decide on their own that a group is compressed, so file data that
+ * happens to look like a header still reads back as is.
+ *
+ * compress_read() does the reverse of compress_write() to fill one
+ * cache slot.  The last few groups read
+ * or written are kept decompressed, so that filling the other blocks of
+ * a group does not go back to the disk and writing part of a group need
+ * not read the rest.  These staged copies always match the disk.
+ */
+
+#include "filesys/compress.h"
+#include <debug.h>
+#include <lz.h>
+#include <round.h>
+#include <stdio.h>
+#include <string.h>
+#include "filesys/free-map.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+
+/* Identifies a compressed group. */
+#define GROUP_MAGIC 0x4c5a4750
+
+/* Number of decompressed groups kept. */
+#define STAGE_CNT 4
+
+/* Marks an unused stage. */
+#define STAGE_EMPTY ((block_sector_t) -1)
+
+/* Header at the start of a compressed group. */
+struct group_header {
+    uint32_t magic;             /* GROUP_MAGIC. */
+    uint32_t size;              /* Bytes of compressed data that follow. */
+    uint32_t checksum;          /* Of the size and the compressed data. */
+};
+
+/* Most compressed data worth writing: anything larger saves no sector. */
+#define MAX_PAYLOAD \
+    (PGSIZE - BLOCK_SECTOR_SIZE - sizeof (struct group_header))
+
+/* A decompressed group. */
+struct stage {
+    block_sector_t group;       /* First block, or STAGE_EMPTY. */
+    unsigned long stamp;        /* Time of last use, for replacement. */
+    uint8_t *data;              /* Contents, PGSIZE bytes. */
+};
+
+static struct stage stages[STAGE_CNT];
+static unsigned long clock;     /* Advanced on each use of a stage. */
+static uint8_t *scratch;        /* Compressed form of a group. */
+static void *work;              /* Scratch memory for lz_compress(). */
+static struct lock compress_lock;
+
+/* Packed map: bit B is set if the group that begins at block B was last
+ * written compressed. */
+static uint8_t *packed;
+static block_sector_t map_start;    /* First block of the packed map. */
+
+/* Statistics. */
+static unsigned long long groups_written;   /* Groups written. */
+static unsigned long long groups_packed;    /* ...of which compressed. */
+static unsigned long long bytes_in;         /* Bytes given to write. */
+static unsigned long long bytes_out;        /* Bytes actually written. */
+static unsigned long long groups_read;      /* Groups read from disk. */
+
+static struct stage *stage_get(block_sector_t group, bool fill);
+static void load(struct stage *);
+static size_t map_sectors(void);
+static bool is_packed(block_sector_t group);
+static void set_packed(block_sector_t group, bool);
+static uint32_t checksum(const struct group_header *);
+
+/* Sets up the stages and scratch buffers. */
+void compress_init(void) {
+    int i;
+
+    lock_init(&compress_lock);
+    for (i = 0; i < STAGE_CNT; i++) {
+        stages[i].group = STAGE_EMPTY;
+        stages[i].data = malloc(PGSIZE);
+        if (stages[i].data == NULL)
+            PANIC("can't allocate compression buffers");
+    }
+    scratch = malloc(PGSIZE);
+    work = malloc(LZ_WORK_SIZE);
+    if (scratch == NULL || work == NULL)
+        PANIC("can't allocate compression buffers");
+}
+
+/* Allocates and clears a packed map for a file system being formatted.
+ * Returns its first block, for the superblock. */
+block_sector_t compress_create(void) {
+    size_t blocks = DIV_ROUND_UP(map_sectors() * BLOCK_SECTOR_SIZE,
+                                 fs_block_size);
+    block_sector_t start;
+    size_t i;
+
+    if (!free_map_allocate(blocks, &start))
+        PANIC("packed map creation failed");
+    memset(scratch, 0, fs_block_size);
+    for (i = 0; i < blocks; i++)
+        fs_block_write(start + i, scratch);
+    return start;
+}
+
+/* Reads the packed map that begins at block MAP. */
+void compress_open(block_sector_t map) {
+    map_start = map;
+    packed = malloc(map_sectors() * BLOCK_SECTOR_SIZE);
+    if (packed == NULL)
+        PANIC("can't allocate packed map");
+    fs_block_read_sectors(map_start, 0, map_sectors(), packed);
+}
+
+/* Prints how well compression did, if it was used. */
+void compress_print_stats(void) {
+    if (groups_written == 0 && groups_read == 0)
+        return;
+    printf("Compression: %llu groups written, %llu compressed, "
+           "%llu of %llu bytes; %llu groups read\n",
+           groups_written, groups_packed, bytes_out, bytes_in, groups_read);
+}
+
+/* Copies block IDX of the group that begins at block GROUP into
+ * BLOCK. */
+void compress_read(block_sector_t group, unsigned idx, void *block) {
+    struct stage *s;
+
+    ASSERT(idx < BLOCKS_PER_GROUP);
+    lock_acquire(&compress_lock);
+    s = stage_get(group, true);
+    memcpy(block, s->data + idx * fs_block_size, fs_block_size);
+    lock_release(&compress_lock);
+}
+
+/* Writes the group that begins at block GROUP, compressed if that
+ * saves anything.  BLOCKS[I] holds the new contents of block I of the
+ * group, or is a null pointer if block I is unchanged. */
+void compress_write(block_sector_t group,
+                    const void *blocks[COMPRESS_MAX_BLOCKS]) {
+    struct group_header *h = (struct group_header *) scratch;
+    struct stage *s;
+    bool whole = true;
+    size_t size;
+    unsigned i;
+
+    for (i = 0; i < BLOCKS_PER_GROUP; i++)
+        if (blocks[i] == NULL)
+            whole = false;
+
+    lock_acquire(&compress_lock);
+    s = stage_get(group, !whole);
+    for (i = 0; i < BLOCKS_PER_GROUP; i++)
+        if (blocks[i] != NULL)
+            memcpy(s->data + i * fs_block_size, blocks[i], fs_block_size);
+
+    size = lz_compress(s->data, PGSIZE, h + 1, MAX_PAYLOAD, work);
+    groups_written++;
+    bytes_in += PGSIZE;
+    if (size > 0) {
+        size_t sectors = DIV_ROUND_UP(sizeof *h + size, BLOCK_SECTOR_SIZE);
+        set_packed(group, true);
+        h->magic = GROUP_MAGIC;
+        h->size = size;
+        h->checksum = checksum(h);
+        memset((uint8_t *) (h + 1) + size, 0,
+               sectors * BLOCK_SECTOR_SIZE - sizeof *h - size);
+        fs_block_write_sectors(group, 0, sectors, scratch);
+        groups_packed++;
+        bytes_out += sectors * BLOCK_SECTOR_SIZE;
+    } else {
+        fs_block_write_multi(group, BLOCKS_PER_GROUP, s->data);
+        set_packed(group, false);
+        bytes_out += PGSIZE;
+    }
+    lock_release(&compress_lock);
+}
+
+/* Drops the staged copy of the group that begins at block GROUP, which
+ * is about to be freed.  Its packed map bit stays as it is, since it
+ * still describes what is on the disk there. */
+void compress_forget(block_sector_t group) {
+    int i;
+
+    lock_acquire(&compress_lock);
+    for (i = 0; i < STAGE_CNT; i++)
+        if (stages[i].group == group)
+            stages[i].group = STAGE_EMPTY;
+    lock_release(&compress_lock);
+}
+
+/* Returns the stage holding GROUP.  If there is none, takes over the
+ * least recently used one, reading GROUP from disk into it if FILL is
+ * true. */
+static struct stage *stage_get(block_sector_t group, bool fill) {
+    struct stage *s = NULL;
+    int i;
+
+    ASSERT(lock_held_by_current_thread(&compress_lock));
+    for (i = 0; i < STAGE_CNT; i++) {
+        if (stages[i].group == group) {
+            s = &stages[i];
+            break;
+        }
+        if (s == NULL || stages[i].stamp < s->stamp)
+            s = &stages[i];
+    }
+    if (s->group != group) {
+        s->group = group;
+        if (fill)
+            load(s);
+    }
+    s->stamp = ++clock;
+    return s;
+}
+
+/* Reads S's group from disk and decompresses it if need be. */
+static void load(struct stage *s) {
+    struct group_header *h = (struct group_header *) scratch;
+
+    groups_read++;
+    if (!is_packed(s->group)) {
+        fs_block_read_multi(s->group, BLOCKS_PER_GROUP, s->data);
+        return;
+    }
+    fs_block_read_sectors(s->group, 0, 1, scratch);
+    if (h->magic == GROUP_MAGIC && h->size <= MAX_PAYLOAD) {
+        size_t sectors = DIV_ROUND_UP(sizeof *h + h->size, BLOCK_SECTOR_SIZE);
+        if (sectors > 1)
+            fs_block_read_sectors(s->group, 1, sectors - 1,
+                                  scratch + BLOCK_SECTOR_SIZE);
+        if (h->checksum == checksum(h)
+            && lz_decompress(h + 1, h->size, s->data, PGSIZE))
+            return;
+    }
+
+    /* A crash came between setting the bit and writing the group. */
+    fs_block_read_multi(s->group, BLOCKS_PER_GROUP, s->data);
+}
+
+/* Returns the number of device sectors in the packed map. */
+static size_t map_sectors(void) {
+    return DIV_ROUND_UP(fs_block_cnt(), BLOCK_SECTOR_SIZE * 8);
+}
+
+/* Returns whether the group that begins at block GROUP was last written
+ * compressed. */
+static bool is_packed(block_sector_t group) {
+    return (packed[group / 8] >> (group % 8)) & 1;
+}
+
+/* Records whether the group that begins at block GROUP is now written
+ * compressed, writing the sector of the packed map that holds its bit
+ * if that changes it. */
+static void set_packed(block_sector_t group, bool value) {
+    size_t sector = group / (BLOCK_SECTOR_SIZE * 8);
+
+    ASSERT(lock_held_by_current_thread(&compress_lock));
+    if (is_packed(group) == value)
+        return;
+    packed[group / 8] ^= 1 << (group % 8);
+    fs_block_write_sectors(map_start, sector, 1,
+                           packed + sector * BLOCK_SECTOR_SIZE);
+}
+
+/* Returns the FNV-1a hash of H's size and the data that follows H. */
+static uint32_t checksum(const struct group_header *h) {
+    const uint8_t *p = (const uint8_t *) (h + 1);
+    uint32_t sum = 2166136261u ^ h->size;
+    size_t i;
+
+    for (i = 0; i < h->size; i++)
+        sum = (sum ^ p[i]) * 16777619u;
+    return sum;
+}
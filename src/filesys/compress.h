@@ -0,0 +1,21 @@
+#ifndef FILESYS_COMPRESS_H
+#define FILESYS_COMPRESS_H
+
+#include "devices/block.h"
+#include "filesys/filesys.h"
+
+/* Most blocks in a group, at the smallest block size. */
+#define COMPRESS_MAX_BLOCKS (PGSIZE / FS_BLOCK_MIN)
+
+void compress_init(void);
+block_sector_t compress_create(void);
+void compress_open(block_sector_t map);
+void compress_print_stats(void);
+
+/* Block groups of compressed files, which begin at block GROUP. */
+void compress_read(block_sector_t group, unsigned idx, void *block);
+void compress_write(block_sector_t group,
+                    const void *blocks[COMPRESS_MAX_BLOCKS]);
+void compress_forget(block_sector_t group);
+
+#endif /* filesys/compress.h */
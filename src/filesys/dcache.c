@@ -0,0 +1,166 @@
+/*
+ * Directory entry cache.
+ *
+ * Maps a (parent directory inode sector, name) pair to the inode
+ * sector the name refers to, so that resolving a path whose components
+ * have been seen recently needs no directory reads at all.  Names that
+ * were looked up and not found are cached too, as negative entries.
+ *
+ * The cache is kept coherent by the directory code: every dir_add()
+ * and dir_remove() invalidates the name it changes while holding the
+ * directory's lock, and removing a directory drops everything cached
+ * under it, since its sector may later be reused.
+ */
+
+#include "filesys/dcache.h"
+#include <debug.h>
+#include <hash.h>
+#include <list.h>
+#include <string.h>
+#include "filesys/directory.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+
+/* Maximum number of cached names. */
+#define DCACHE_MAX_ENTRIES 512
+
+struct dcache_entry {
+    struct hash_elem elem;          /* Element in dcache. */
+    struct list_elem lru_elem;      /* Element in lru, most recent first. */
+    block_sector_t parent;          /* Directory containing NAME. */
+    char name[NAME_MAX + 1];        /* Name within PARENT. */
+    block_sector_t child;           /* Inode of NAME, or DCACHE_NEGATIVE. */
+};
+
+static struct hash dcache;
+static struct list lru;
+static struct lock dcache_lock;
+
+static unsigned dcache_hash(const struct hash_elem *e, void *aux);
+static bool dcache_less(const struct hash_elem *e1,
+        const struct hash_elem *e2, void *aux);
+static struct dcache_entry *find(block_sector_t parent, const char *name);
+static void drop(struct dcache_entry *);
+
+/* Initializes the directory entry cache. */
+void dcache_init(void) {
+    if (!hash_init(&dcache, dcache_hash, dcache_less, NULL))
+        PANIC("dcache: hash table creation failed");
+    list_init(&lru);
+    lock_init(&dcache_lock);
+}
+
+/* Looks up NAME in the directory at sector PARENT.  On a hit, stores the
+ * inode sector of NAME in *CHILD, or DCACHE_NEGATIVE if NAME is known
+ * not to exist, and returns true.  Returns false on a miss. */
+bool dcache_lookup(block_sector_t parent, const char *name,
+        block_sector_t *child) {
+    struct dcache_entry *de;
+
+    lock_acquire(&dcache_lock);
+    de = find(parent, name);
+    if (de != NULL) {
+        *child = de->child;
+        list_remove(&de->lru_elem);
+        list_push_front(&lru, &de->lru_elem);
+    }
+    lock_release(&dcache_lock);
+    return de != NULL;
+}
+
+/* Records that NAME in the directory at sector PARENT refers to the
+ * inode at sector CHILD, or does not exist if CHILD is DCACHE_NEGATIVE.
+ * The caller must hold PARENT's directory lock, so that the answer
+ * cannot be invalidated between reading it and caching it. */
+void dcache_insert(block_sector_t parent, const char *name,
+        block_sector_t child) {
+    struct dcache_entry *de;
+
+    if (strlen(name) > NAME_MAX)
+        return;
+
+    lock_acquire(&dcache_lock);
+    de = find(parent, name);
+    if (de != NULL) {
+        de->child = child;
+        list_remove(&de->lru_elem);
+    } else {
+        if (hash_size(&dcache) >= DCACHE_MAX_ENTRIES) {
+            drop(list_entry(list_back(&lru), struct dcache_entry, lru_elem));
+        }
+        de = malloc(sizeof *de);
+        if (de == NULL) {
+            lock_release(&dcache_lock);
+            return;
+        }
+        de->parent = parent;
+        strlcpy(de->name, name, sizeof de->name);
+        de->child = child;
+        hash_insert(&dcache, &de->elem);
+    }
+    list_push_front(&lru, &de->lru_elem);
+    lock_release(&dcache_lock);
+}
+
+/* Forgets anything cached about NAME in the directory at PARENT. */
+void dcache_invalidate(block_sector_t parent, const char *name) {
+    struct dcache_entry *de;
+
+    lock_acquire(&dcache_lock);
+    de = find(parent, name);
+    if (de != NULL)
+        drop(de);
+    lock_release(&dcache_lock);
+}
+
+/* Forgets every name cached in the directory at PARENT. */
+void dcache_invalidate_dir(block_sector_t parent) {
+    struct list_elem *e, *next;
+
+    lock_acquire(&dcache_lock);
+    for (e = list_begin(&lru); e != list_end(&lru); e = next) {
+        struct dcache_entry *de = list_entry(e, struct dcache_entry,
+                lru_elem);
+        next = list_next(e);
+        if (de->parent == parent)
+            drop(de);
+    }
+    lock_release(&dcache_lock);
+}
+
+/* Returns the entry for NAME in PARENT, or NULL. */
+static struct dcache_entry *find(block_sector_t parent, const char *name) {
+    struct dcache_entry key;
+    struct hash_elem *e;
+
+    if (strlen(name) > NAME_MAX)
+        return NULL;
+    key.parent = parent;
+    strlcpy(key.name, name, sizeof key.name);
+    e = hash_find(&dcache, &key.elem);
+    return e != NULL ? hash_entry(e, struct dcache_entry, elem) : NULL;
+}
+
+/* Removes DE from the cache and frees it. */
+static void drop(struct dcache_entry *de) {
+    ASSERT(lock_held_by_current_thread(&dcache_lock));
+    hash_delete(&dcache, &de->elem);
+    list_remove(&de->lru_elem);
+    free(de);
+}
+
+/* Hashes the parent sector and name of a cache entry. */
+static unsigned dcache_hash(const struct hash_elem *e, void *aux UNUSED) {
+    const struct dcache_entry *de = hash_entry(e, struct dcache_entry, elem);
+    return hash_string(de->name) ^ hash_int((int) de->parent);
+}
+
+/* Orders cache entries by parent sector, then name. */
+static bool dcache_less(const struct hash_elem *e1,
+        const struct hash_elem *e2, void *aux UNUSED) {
+    const struct dcache_entry *de1 = hash_entry(e1, struct dcache_entry, elem);
+    const struct dcache_entry *de2 = hash_entry(e2, struct dcache_entry, elem);
+    if (de1->parent != de2->parent)
+        return de1->parent < de2->parent;
+    return strcmp(de1->name, de2->name) < 0;
+}
@@ -0,0 +1,23 @@
+#ifndef FILESYS_DCACHE_H
+#define FILESYS_DCACHE_H
+
+#include <stdbool.h>
+#include "devices/block.h"
+
+/* Child sector recorded for a name known not to exist. */
+#define DCACHE_NEGATIVE ((block_sector_t) -1)
+
+/* Start up. */
+void dcache_init(void);
+
+/* Looking up and recording names. */
+bool dcache_lookup(block_sector_t parent, const char *name,
+        block_sector_t *child);
+void dcache_insert(block_sector_t parent, const char *name,
+        block_sector_t child);
+
+/* Invalidation. */
+void dcache_invalidate(block_sector_t parent, const char *name);
+void dcache_invalidate_dir(block_sector_t parent);
+
+#endif /* filesys/dcache.h */
@@ -1,23 +1,34 @@
 #include "filesys/directory.h"
+#include "filesys/dcache.h"
 #include <stdio.h>
 #include <string.h>
 #include <list.h>
+#include <hash.h>
+#include <round.h>
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
 #include "threads/malloc.h"
 #include "threads/thread.h"
 #include "filesys/free-map.h"
+#include "filesys/journal.h"
 #include "filesys/inode.h"
 #include "lib/user/syscall.h"
 #include "threads/synch.h"
 
 /*! A directory. */
 struct dir {
-    struct lock dlock;                  // Lock for creation/deletion of files
     struct inode *inode;                /*!< Backing store. */
     off_t pos;                          /*!< Current position. */
+    int format;                         /*!< DIR_FORMAT_*, once known. */
 };
 
+/* Values of struct dir's FORMAT.  It starts out unknown and is read
+ * from the directory the first time it is needed, so that opening a
+ * directory to pass through it on a cached path costs no reads. */
+#define DIR_FORMAT_UNKNOWN 0
+#define DIR_FORMAT_LINEAR 1
+#define DIR_FORMAT_INDEXED 2
+
 /*! A single directory entry. */
 struct dir_entry {
     block_sector_t inode_sector;        /*!< Sector number of header. */
@@ -25,17 +36,164 @@ struct dir_entry {
     bool in_use;                        /*!< In use or free? */
 };
 
+/* Directories come in two on-disk formats.
+ *
+ * Linear directories, the original format, are a flat array of
+ * struct dir_entry that is searched from the start on every lookup.
+ * They are still read and updated, but no longer created.  The inode
+ * remembers the lowest offset that may hold a free entry, so adding a
+ * name does not rescan the occupied prefix, and free entries at the
+ * end are truncated away.
+ *
+ * Indexed directories use extendible hashing over the name hash.
+ * Block 0 of the directory file is a struct dir_header.  The low
+ * GLOBAL_DEPTH bits of a name's hash index a table of block numbers,
+ * which is stored 128 entries to a block in the table blocks listed in
+ * the header.  Each table entry names a struct dir_bucket block holding
+ * up to DIR_BUCKET_ENTRIES entries.  A full bucket is split in two on
+ * the next bit of the hash, doubling the table first if needed, so a
+ * lookup reads the header, one table block and one bucket no matter
+ * how large the directory grows.
+ *
+ * Removing names reverses this: a bucket that shares few enough
+ * entries with its buddy (the bucket that differs only in the top bit
+ * of their local depth) is merged into it, and the table is halved
+ * when no bucket uses its top bit.  Blocks freed that way go on a list
+ * threaded through their first word for reuse, and are truncated off
+ * the directory file once they reach its end. */
+
+/* Identifies an indexed directory.  It can never be mistaken for the
+ * sector number at the start of a linear directory's "." entry. */
+#define DIR_MAGIC 0x44495248
+
+/* Table entries per table block. */
+#define DIR_TABLE_PER_BLOCK (BLOCK_SECTOR_SIZE / sizeof(uint32_t))
+
+/* Most hash bits the table can use, and the table blocks the header
+ * must name to hold a table that large.  Directory files keep a
+ * 512-byte internal layout whatever the file system's block size. */
+#define DIR_MAX_DEPTH 13
+#define DIR_TABLE_BLOCKS ((1u << DIR_MAX_DEPTH) / DIR_TABLE_PER_BLOCK)
+
+/* Buddy buckets are merged once they hold at most this many entries
+ * between them, leaving room for adds before the next split. */
+#define DIR_MERGE_ENTRIES (DIR_BUCKET_ENTRIES / 2)
+
+/* Entries per bucket. */
+#define DIR_BUCKET_ENTRIES 25
+
+/* Journal sectors, besides the directory's own blocks, that growing or
+ * shrinking a directory file may log: its inode, its index blocks and
+ * the free map.  Each block added may need a free map sector more. */
+#define DIR_RESIZE_SECTORS 6
+
+/*! Block 0 of an indexed directory. */
+struct dir_header {
+    unsigned magic;                     /*!< DIR_MAGIC. */
+    uint32_t global_depth;              /*!< Hash bits used by the table. */
+    uint32_t entry_cnt;                 /*!< Entries in use. */
+    uint32_t block_cnt;                 /*!< Blocks in the directory file. */
+    uint32_t table[DIR_TABLE_BLOCKS];   /*!< Blocks holding the table. */
+    uint32_t free_head;                 /*!< First free block, or 0. */
+    char unused[BLOCK_SECTOR_SIZE - 20 -
+        DIR_TABLE_BLOCKS * sizeof(uint32_t)];
+};
+
+/*! A bucket of an indexed directory. */
+struct dir_bucket {
+    uint32_t local_depth;               /*!< Hash bits shared by entries. */
+    uint32_t used_cnt;                  /*!< Entries in use. */
+    struct dir_entry entries[DIR_BUCKET_ENTRIES];
+    char unused[BLOCK_SECTOR_SIZE - 8 -
+        DIR_BUCKET_ENTRIES * sizeof(struct dir_entry)];
+};
+
+static bool indexed_lookup(const struct dir *, const char *name,
+        struct dir_entry *ep);
+static bool indexed_add(struct dir *, const char *name,
+        block_sector_t inode_sector);
+static bool indexed_remove(struct dir *, const char *name,
+        struct dir_entry *ep);
+static size_t indexed_readdir(struct dir *, off_t *pos,
+        struct dir_entry *entries, size_t cnt);
+static bool listed(const struct dir_entry *);
+static void linear_trim(struct dir *);
+
+/* Returns true if DIR uses the indexed format. */
+static bool is_indexed(const struct dir *dir_) {
+    struct dir *dir = (struct dir *) dir_;
+    if (dir->format == DIR_FORMAT_UNKNOWN) {
+        unsigned magic = 0;
+        inode_read_at(dir->inode, &magic, sizeof magic, 0);
+        dir->format = magic == DIR_MAGIC ?
+            DIR_FORMAT_INDEXED : DIR_FORMAT_LINEAR;
+    }
+    return dir->format == DIR_FORMAT_INDEXED;
+}
+
 /*! Creates a directory with space for ENTRY_CNT entries in the
     given SECTOR.  Returns true if successful, false on failure. */
 bool dir_create(block_sector_t sector, size_t entry_cnt, block_sector_t par) {
-    if(inode_create(sector, entry_cnt * sizeof(struct dir_entry), 
-            true, par)) {
+    struct dir_header *h;
+    struct dir_bucket *bucket;
+    struct inode *inode;
+    uint32_t depth = 0, i;
+    bool success = false;
+
+    ASSERT(sizeof(struct dir_header) == BLOCK_SECTOR_SIZE);
+    ASSERT(sizeof(struct dir_bucket) == BLOCK_SECTOR_SIZE);
+
+    /* Start with enough buckets for ENTRY_CNT entries plus "." and
+     * "..", so that small directories never need to split. */
+    while (depth < 7 &&
+           (1u << depth) * DIR_BUCKET_ENTRIES < entry_cnt + 2)
+        depth++;
+
+    /* But no more than the journal has room to log in one operation:
+     * the inode and every block, each of which may grow the file. */
+    while (depth > 0 && !journal_extend(1 + 2 * (2 + (1u << depth)) +
+                DIR_RESIZE_SECTORS))
+        depth--;
+
+    h = calloc(1, sizeof *h);
+    bucket = calloc(1, sizeof *bucket);
+    if (h == NULL || bucket == NULL || !inode_create(sector, 0, true, par))
+        goto done;
+    inode = inode_open(sector);
+    if (inode == NULL)
+        goto done;
+
+    /* Header in block 0, the table in block 1, buckets after that. */
+    h->magic = DIR_MAGIC;
+    h->global_depth = depth;
+    h->entry_cnt = 0;
+    h->block_cnt = 2 + (1u << depth);
+    h->table[0] = 1;
+    bucket->local_depth = depth;
+    success = true;
+    for (i = 0; i < (1u << depth); i++) {
+        uint32_t blk = 2 + i;
+        success = success &&
+            inode_write_at(inode, &blk, sizeof blk,
+                    BLOCK_SECTOR_SIZE + i * sizeof blk) == sizeof blk &&
+            inode_write_at(inode, bucket, sizeof *bucket,
+                    blk * BLOCK_SECTOR_SIZE) == sizeof *bucket;
+    }
+    success = success &&
+        inode_write_at(inode, h, sizeof *h, 0) == sizeof *h;
+    inode_close(inode);
+
+    if (success) {
         struct dir *d = dir_open(inode_open(sector));
-        if (dir_add(d, ".", sector) && dir_add(d, "..", par)) {
-            return true;
-        }
+        success = d != NULL && dir_add(d, ".", sector) &&
+            dir_add(d, "..", par);
+        dir_close(d);
     }
-    return false;
+
+done:
+    free(h);
+    free(bucket);
+    return success;
 }
 
 /* Makes a directory at the specified path with the specified name, where
@@ -43,14 +201,9 @@ bool dir_create(block_sector_t sector, size_t entry_cnt, block_sector_t par) {
  * entry_cnt entries */
 bool dir_mkdir(const char *name, size_t entry_cnt) {
     block_sector_t inode_sector = 0;
-    char *dname = malloc(strlen(name));
-    if (dname == NULL)
-        return false;
+    char dname[NAME_MAX + 1];
+    journal_begin();
     struct dir *d = dir_open_name(name, dname);
-    if (d == NULL) {
-        free(dname);
-        return false;
-    }
 
     // Create the new directory
     bool success = (d != NULL &&
@@ -61,7 +214,7 @@ bool dir_mkdir(const char *name, size_t entry_cnt) {
     if (!success && inode_sector != 0)
         free_map_release(inode_sector, 1);
     dir_close(d);
-    free(dname);
+    journal_end();
     return success;
 }
 
@@ -72,7 +225,7 @@ struct dir * dir_open(struct inode *inode) {
     if (inode != NULL && dir != NULL) {
         dir->inode = inode;
         dir->pos = 0;
-        lock_init(&dir->dlock);
+        dir->format = DIR_FORMAT_UNKNOWN;
         return dir;
     }
     else {
@@ -111,7 +264,9 @@ struct inode * dir_get_inode(struct dir *dir) {
     If successful, returns true, sets *EP to the directory entry
     if EP is non-null, and sets *OFSP to the byte offset of the
     directory entry if OFSP is non-null.
-    otherwise, returns false and ignores EP and OFSP. */
+    otherwise, returns false and ignores EP and OFSP.
+    OFSP is only meaningful for linear directories.  The caller
+    must hold DIR's inode's directory lock. */
 static bool lookup(const struct dir *dir, const char *name,
                    struct dir_entry *ep, off_t *ofsp) {
     struct dir_entry e;
@@ -120,6 +275,10 @@ static bool lookup(const struct dir *dir, const char *name,
     ASSERT(dir != NULL);
     ASSERT(name != NULL);
 
+    if (is_indexed(dir)) {
+        return indexed_lookup(dir, name, ep);
+    }
+
     for(ofs = 0; inode_read_at(dir->inode, &e, sizeof(e), ofs) == sizeof(e);
              ofs += sizeof(e)) {
         if (e.in_use && !strcmp(name, e.name)) {
@@ -135,30 +294,29 @@ static bool lookup(const struct dir *dir, const char *name,
     return false;
 }
 
-bool dir_entry_name(const struct dir *dir, size_t i, char *name) {
-    size_t ofs = i * sizeof(struct dir_entry);
-    struct dir_entry e;
-    if (inode_read_at(dir->inode, &e, sizeof(e), ofs) == sizeof(e)) {
-        if (e.in_use) {
-            strlcpy(name, e.name, READDIR_MAX_LEN);
-            return true;
-        }
-    }
-    return false;
-}
-
 /*! Searches DIR for a file with the given NAME and returns true if one
     exists, false otherwise.  On success, sets *INODE to an inode for the
-    file, otherwise to a null pointer.  The caller must close *INODE. */
+    file, otherwise to a null pointer.  The caller must close *INODE.
+    Consults the directory entry cache first, and caches the outcome of
+    any search that has to read the directory. */
 bool dir_lookup(const struct dir *dir, const char *name,
         struct inode **inode_p) {
+    block_sector_t parent, child;
     struct dir_entry e;
 
     ASSERT(dir != NULL);
     ASSERT(name != NULL);
 
-    if (lookup(dir, name, &e, NULL)) {
-        *inode_p = inode_open(e.inode_sector);
+    parent = inode_get_inumber(dir->inode);
+    if (!dcache_lookup(parent, name, &child)) {
+        inode_lock_dir(dir->inode);
+        child = lookup(dir, name, &e, NULL) ?
+            e.inode_sector : DCACHE_NEGATIVE;
+        dcache_insert(parent, name, child);
+        inode_unlock_dir(dir->inode);
+    }
+    if (child != DCACHE_NEGATIVE) {
+        *inode_p = inode_open(child);
         if (inode_is_removed(*inode_p)) {
             *inode_p = NULL;
         }
@@ -186,20 +344,26 @@ bool dir_add(struct dir *dir, const char *name, block_sector_t inode_sector) {
     if (*name == '\0' || strlen(name) > NAME_MAX)
         return false;
 
-    lock_acquire(&(dir->dlock));
+    inode_lock_dir(dir->inode);
     /* Check that NAME is not in use. */
     if (lookup(dir, name, NULL, NULL)) {
         goto done;
     }
 
-    /* Set OFS to offset of free slot.
+    if (is_indexed(dir)) {
+        success = indexed_add(dir, name, inode_sector);
+        goto cache;
+    }
+
+    /* Set OFS to offset of free slot, starting from the inode's hint.
      * If there are no free slots, then it will be set to the
      * current end-of-file.
      *
      * inode_read_at() will only return a short read at end of file.
      * Otherwise, we'd need to verify that we didn't get a short
      * read due to something intermittent such as low memory. */
-    for(ofs = 0; inode_read_at(dir->inode, &e, sizeof(e), ofs) == sizeof(e);
+    for(ofs = inode_dir_hint(dir->inode);
+            inode_read_at(dir->inode, &e, sizeof(e), ofs) == sizeof(e);
             ofs += sizeof(e)) {
         if (!e.in_use)
             break;
@@ -210,9 +374,16 @@ bool dir_add(struct dir *dir, const char *name, block_sector_t inode_sector) {
     strlcpy(e.name, name, sizeof e.name);
     e.inode_sector = inode_sector;
     success = inode_write_at(dir->inode, &e, sizeof(e), ofs) == sizeof(e);
+    if (success)
+        inode_set_dir_hint(dir->inode, ofs + sizeof(e));
 
+cache:
+    if (success)
+        dcache_insert(inode_get_inumber(dir->inode), name, inode_sector);
+    else
+        dcache_invalidate(inode_get_inumber(dir->inode), name);
 done:
-    lock_release((&dir->dlock));
+    inode_unlock_dir(dir->inode);
     return success;
 }
 
@@ -227,7 +398,7 @@ bool dir_remove(struct dir *dir, const char *name) {
     ASSERT(dir != NULL);
     ASSERT(name != NULL);
 
-    lock_acquire(&dir->dlock);
+    inode_lock_dir(dir->inode);
     /* Find directory entry. */
     if (!lookup(dir, name, &e, &ofs)) {
         goto done;
@@ -239,108 +410,234 @@ bool dir_remove(struct dir *dir, const char *name) {
         goto done;
 
     /* Erase directory entry. */
-    e.in_use = false;
-    if (inode_write_at(dir->inode, &e, sizeof(e), ofs) != sizeof(e))
-        goto done;
+    if (is_indexed(dir)) {
+        if (!indexed_remove(dir, name, &e))
+            goto done;
+    } else {
+        e.in_use = false;
+        if (inode_write_at(dir->inode, &e, sizeof(e), ofs) != sizeof(e))
+            goto done;
+        if (ofs < inode_dir_hint(dir->inode))
+            inode_set_dir_hint(dir->inode, ofs);
+        if (ofs + (off_t) sizeof(e) == inode_length(dir->inode))
+            linear_trim(dir);
+    }
 
     /* Remove inode. */
+    dcache_insert(inode_get_inumber(dir->inode), name, DCACHE_NEGATIVE);
     inode_remove(inode);
     success = true;
 
 done:
     inode_close(inode);
-    lock_release(&dir->dlock);
+    inode_unlock_dir(dir->inode);
     return success;
 }
 
+/* Truncates the free entries at the end of linear DIR. */
+static void linear_trim(struct dir *dir) {
+    struct dir_entry e;
+    off_t length = inode_length(dir->inode);
+
+    while (length >= (off_t) sizeof e &&
+           inode_read_at(dir->inode, &e, sizeof e, length - sizeof e) ==
+               sizeof e && !e.in_use)
+        length -= sizeof e;
+    inode_truncate(dir->inode, length);
+    if (inode_dir_hint(dir->inode) > length)
+        inode_set_dir_hint(dir->inode, length);
+}
+
+/* Returns true if E should be reported when listing a directory. */
+static bool listed(const struct dir_entry *e) {
+    return e->in_use && strcmp(e->name, ".") && strcmp(e->name, "..");
+}
+
+/* Number of linear entries read from the directory file at a time. */
+#define DIR_READ_CHUNK (BLOCK_SECTOR_SIZE / sizeof(struct dir_entry))
+
+/* Copies up to CNT listed entries of linear directory DIR, starting at
+ * byte offset *POS, into ENTRIES, reading the file a chunk at a time.
+ * Advances *POS past the last entry examined and returns the number
+ * of entries copied. */
+static size_t linear_readdir(struct dir *dir, off_t *pos,
+        struct dir_entry *entries, size_t cnt) {
+    struct dir_entry *chunk = malloc(DIR_READ_CHUNK * sizeof *chunk);
+    size_t copied = 0;
+
+    if (chunk == NULL)
+        return 0;
+    while (copied < cnt) {
+        off_t bytes = inode_read_at(dir->inode, chunk,
+                DIR_READ_CHUNK * sizeof *chunk, *pos);
+        size_t n = bytes / sizeof *chunk;
+        size_t i;
+
+        if (n == 0)
+            break;
+        for (i = 0; i < n && copied < cnt; i++)
+            if (listed(&chunk[i]))
+                entries[copied++] = chunk[i];
+        *pos += i * sizeof *chunk;
+    }
+    free(chunk);
+    return copied;
+}
+
+/*! Reads up to CNT entries of DIR, skipping "." and "..", into RECORDS,
+    starting from position *POS.  *POS starts at 0 and is otherwise an
+    opaque value returned by a previous call; on return it refers to the
+    entry after the last one read.  Returns the number of entries read,
+    which is 0 once the directory is exhausted. */
+size_t dir_readdir_batch(struct dir *dir, off_t *pos,
+        struct dir_record *records, size_t cnt) {
+    struct dir_entry *entries;
+    size_t n, i;
+
+    if (cnt == 0)
+        return 0;
+    entries = malloc(cnt * sizeof *entries);
+    if (entries == NULL)
+        return 0;
+
+    inode_lock_dir(dir->inode);
+    if (is_indexed(dir))
+        n = indexed_readdir(dir, pos, entries, cnt);
+    else
+        n = linear_readdir(dir, pos, entries, cnt);
+    inode_unlock_dir(dir->inode);
+
+    for (i = 0; i < n; i++) {
+        records[i].inumber = entries[i].inode_sector;
+        strlcpy(records[i].name, entries[i].name, sizeof records[i].name);
+    }
+    free(entries);
+    return n;
+}
+
 /*! Reads the next directory entry in DIR and stores the name in NAME.
-    Returns true if successful, false if the directory contains no more
-    entries. */
+    Skips "." and "..".  Returns true if successful, false if the
+    directory contains no more entries. */
 bool dir_readdir(struct dir *dir, char name[NAME_MAX + 1]) {
-    struct dir_entry e;
+    struct dir_record record;
 
-    while(inode_read_at(dir->inode, &e, sizeof(e), dir->pos) == sizeof(e)) {
-        dir->pos += sizeof(e);
-        if (e.in_use) {
-            strlcpy(name, e.name, NAME_MAX + 1);
-            return true;
-        } 
+    if (dir_readdir_batch(dir, &dir->pos, &record, 1) == 0)
+        return false;
+    strlcpy(name, record.name, NAME_MAX + 1);
+    return true;
+}
+
+/* Path names are resolved in place, one component at a time, holding
+ * a reference only to the inode of the directory being searched.  No
+ * copy of the path and no struct dir is allocated along the way. */
+
+/* Copies the next component of the path at *SRCP into PART, skipping
+ * any slashes before it, and advances *SRCP past the component.
+ * Returns 1 on success, 0 at the end of the path, or -1 if the
+ * component is longer than NAME_MAX. */
+static int next_part(char part[NAME_MAX + 1], const char **srcp) {
+    const char *src = *srcp;
+    char *dst = part;
+
+    while (*src == '/')
+        src++;
+    if (*src == '\0') {
+        *srcp = src;
+        return 0;
     }
-    return false;
+    while (*src != '/' && *src != '\0') {
+        if (dst == part + NAME_MAX)
+            return -1;
+        *dst++ = *src++;
+    }
+    *dst = '\0';
+    *srcp = src;
+    return 1;
 }
 
-/* Given a path, opens the parent directory of the specified file and returns
- * a pointer to it. If an invalid path is given, returns NULL */
-struct dir * dir_open_parent(const char * name, block_sector_t cwd) {
-    char *copied_name = malloc(strlen(name));
-    if (copied_name == NULL)
-        return NULL;
+/* Looks up NAME in the directory stored in INODE and returns its
+ * inode, which the caller must close, or a null pointer if INODE is
+ * not a directory or holds no such name. */
+static struct inode *lookup_in(struct inode *inode, const char *name) {
+    struct dir dir = { inode, 0, DIR_FORMAT_UNKNOWN };
+    struct inode *child;
 
-    char **buf = malloc(strlen(name));
-    if (buf == NULL)
+    if (!inode_is_dir(inode))
         return NULL;
+    dir_lookup(&dir, name, &child);
+    return child;
+}
+
+/* Returns a new reference to the inode where resolving NAME starts:
+ * the root for absolute paths, the current directory otherwise. */
+static struct inode *walk_start(const char *name) {
+    if (*name == '/')
+        return inode_open(ROOT_DIR_SECTOR);
+    return inode_reopen(thread_current()->dir);
+}
 
-    bool absolute = (name[0] == '/');
-    struct dir *d, *old;
+/* Resolves every component of NAME but the last, which is copied into
+ * FNAME.  Returns the inode of the directory that should contain it,
+ * which the caller must close, or a null pointer if some component is
+ * missing, too long or not a directory, or if NAME has no last
+ * component because it is empty or ends in a slash. */
+static struct inode *walk_parent(const char *name, char fname[NAME_MAX + 1]) {
+    struct inode *inode = walk_start(name);
+    const char *p = name;
+    char part[NAME_MAX + 1];
+    int r;
 
-    strlcpy(copied_name, name, strlen(name) + 1);
-    if (absolute) {
-        d = dir_open_root();
-    } else {
-        d = dir_open(inode_open(cwd));
-    }
-
-    // Tokenize string, then open each directory starting from the root
-    // or the current working directory.
-    struct inode *i;
-    char *tok = strtok_r(copied_name, "/", buf);
-    while (tok != NULL) {
-        old = d;
-        dir_lookup(d, tok, &i);
-        d = dir_open(i);
-        tok = strtok_r(NULL, "/", buf);
-        if (tok == NULL) {
-            d = old;
-            break;
-        }
-        if (d == NULL) {
-            free(copied_name);
-            free(buf);
+    if (next_part(fname, &p) <= 0)
+        goto fail;
+    while ((r = next_part(part, &p)) > 0) {
+        struct inode *child = lookup_in(inode, fname);
+        inode_close(inode);
+        inode = child;
+        if (inode == NULL)
             return NULL;
-        }
-        dir_close(old);
+        memcpy(fname, part, sizeof part);
     }
-    free(buf);
-    free(copied_name);
-    return d;
+    if (r == 0 && p[-1] != '/' && inode_is_dir(inode))
+        return inode;
+
+fail:
+    inode_close(inode);
+    return NULL;
 }
 
-/* Determines whether a given name is a filename or a path */
-bool dir_is_path(const char *name) {
-    return (strchr(name, '/') != NULL);
+/* Resolves path NAME and returns the inode it names, which the caller
+ * must close, or a null pointer if it does not exist.  A path of only
+ * slashes names the root.  A trailing slash requires a directory. */
+struct inode *dir_walk(const char *name) {
+    struct inode *inode;
+    const char *p = name;
+    char part[NAME_MAX + 1];
+    int r;
+
+    if (*name == '\0')
+        return NULL;
+    inode = walk_start(name);
+    while (inode != NULL && (r = next_part(part, &p)) != 0) {
+        struct inode *child = r > 0 ? lookup_in(inode, part) : NULL;
+        inode_close(inode);
+        inode = child;
+    }
+    if (inode != NULL && p[-1] == '/' && !inode_is_dir(inode)) {
+        inode_close(inode);
+        return NULL;
+    }
+    return inode;
 }
 
+/* Makes the directory named NAME the current directory. */
 bool dir_chdir(const char *name) {
-    char *dname = malloc(strlen(name));
-    if (dname == NULL)
-        return false;
-    struct dir *d = dir_open_name(name, dname);
-    if (d == NULL) {
-        free (dname);
-        return false;
-    }
+    struct inode *inode = dir_walk(name);
 
-    struct inode *i;
-    if (!dir_lookup(d, dname, &i)) {
-        return false;
-    }
-    d = dir_open(i);
-    if (d == NULL) {
-        free(dname);
+    if (!inode_is_dir(inode)) {
+        inode_close(inode);
         return false;
     }
-    thread_current()->dir = d->inode;
-    free(dname);
+    thread_current()->dir = inode;
     return true;
 }
 
@@ -349,31 +646,400 @@ bool in_deleted_dir(void) {
     return inode_is_removed(cwd_inode);
 }
 
-/* Given the path name of a directory, opens that directory and separates 
- * the file name from the path, putting it into fname */
-struct dir *dir_open_name(const char *name, char *fname) {
-    struct dir *dir;
-    char *copied_name = malloc(strlen(name));
-    if (copied_name == NULL)
-        return NULL;
+/* Opens the directory that should contain the last component of path
+ * NAME, and copies that component into FNAME.  Returns a null pointer
+ * if the directory does not exist or NAME has no last component. */
+struct dir *dir_open_name(const char *name, char fname[NAME_MAX + 1]) {
+    return dir_open(walk_parent(name, fname));
+}
 
-    strlcpy(copied_name, name, strlen(name) + 1);
-    // Open the specified directory. If not given a name requiring
-    // directory traversal, opens the current working directory.
-    block_sector_t cwd = inode_get_inumber(thread_current()->dir);
-    if (dir_is_path(copied_name)) {
-        dir = dir_open_parent(copied_name, cwd);
-    } else {
-        dir = dir_open(inode_open(cwd));
+/* Indexed directories. */
+
+/* Reads block BLK of DIR into BUF.  Returns true if successful. */
+static bool read_block(const struct dir *dir, uint32_t blk, void *buf) {
+    return inode_read_at(dir->inode, buf, BLOCK_SECTOR_SIZE,
+            blk * BLOCK_SECTOR_SIZE) == BLOCK_SECTOR_SIZE;
+}
+
+/* Writes BUF to block BLK of DIR.  Returns true if successful. */
+static bool write_block(struct dir *dir, uint32_t blk, const void *buf) {
+    return inode_write_at(dir->inode, buf, BLOCK_SECTOR_SIZE,
+            blk * BLOCK_SECTOR_SIZE) == BLOCK_SECTOR_SIZE;
+}
+
+/* Returns the bucket block at index IDX of the table described by H. */
+static uint32_t table_get(const struct dir *dir, const struct dir_header *h,
+        uint32_t idx) {
+    uint32_t blk = 0;
+    inode_read_at(dir->inode, &blk, sizeof blk,
+            h->table[idx / DIR_TABLE_PER_BLOCK] * BLOCK_SECTOR_SIZE +
+            (idx % DIR_TABLE_PER_BLOCK) * sizeof blk);
+    return blk;
+}
+
+/* Points index IDX of the table described by H at bucket block BLK. */
+static bool table_set(struct dir *dir, const struct dir_header *h,
+        uint32_t idx, uint32_t blk) {
+    return inode_write_at(dir->inode, &blk, sizeof blk,
+            h->table[idx / DIR_TABLE_PER_BLOCK] * BLOCK_SECTOR_SIZE +
+            (idx % DIR_TABLE_PER_BLOCK) * sizeof blk) == sizeof blk;
+}
+
+/* Returns the number of blocks that hold a table of global depth
+ * DEPTH. */
+static uint32_t table_blocks(uint32_t depth) {
+    return DIV_ROUND_UP(1u << depth, DIR_TABLE_PER_BLOCK);
+}
+
+/* Returns the table index for NAME under H's global depth. */
+static uint32_t table_index(const struct dir_header *h, const char *name) {
+    return hash_string(name) & ((1u << h->global_depth) - 1);
+}
+
+/* Returns a block for a new bucket or table block of indexed DIR,
+ * reusing a free block if there is one and growing the directory
+ * otherwise.  Updates header H, which the caller writes back. */
+static uint32_t alloc_block(struct dir *dir, struct dir_header *h) {
+    uint32_t blk = h->free_head;
+
+    if (blk == 0)
+        return h->block_cnt++;
+    if (inode_read_at(dir->inode, &h->free_head, sizeof h->free_head,
+                blk * BLOCK_SECTOR_SIZE) != sizeof h->free_head)
+        h->free_head = 0;
+    return blk;
+}
+
+/* Returns block BLK of indexed DIR to the free list, then truncates
+ * any free blocks at the end of the directory file.  Updates header H,
+ * which the caller writes back. */
+static void release_block(struct dir *dir, struct dir_header *h,
+        uint32_t blk) {
+    uint32_t prev, cur, next;
+
+    if (inode_write_at(dir->inode, &h->free_head, sizeof h->free_head,
+                blk * BLOCK_SECTOR_SIZE) != sizeof h->free_head)
+        return;
+    h->free_head = blk;
+
+    /* Unlink the last block of the file while it is on the list. */
+    for (;;) {
+        prev = 0;
+        for (cur = h->free_head; cur != 0 && cur != h->block_cnt - 1;
+                cur = next) {
+            inode_read_at(dir->inode, &next, sizeof next,
+                    cur * BLOCK_SECTOR_SIZE);
+            prev = cur;
+        }
+        if (cur == 0)
+            break;
+        inode_read_at(dir->inode, &next, sizeof next,
+                cur * BLOCK_SECTOR_SIZE);
+        if (prev == 0)
+            h->free_head = next;
+        else
+            inode_write_at(dir->inode, &next, sizeof next,
+                    prev * BLOCK_SECTOR_SIZE);
+        h->block_cnt--;
     }
-    // Find the actual name of the directory
-    char *aname = strrchr(copied_name, '/');
-    if (aname != NULL) {
-        aname ++;
-    } else {
-        aname = copied_name;
+    inode_truncate(dir->inode, h->block_cnt * BLOCK_SECTOR_SIZE);
+}
+
+/* Searches BUCKET for NAME and returns its slot, or -1. */
+static int bucket_find(const struct dir_bucket *bucket, const char *name) {
+    int i;
+    for (i = 0; i < DIR_BUCKET_ENTRIES; i++) {
+        if (bucket->entries[i].in_use && !strcmp(bucket->entries[i].name, name))
+            return i;
+    }
+    return -1;
+}
+
+/* Searches indexed DIR for NAME, copying its entry to *EP if EP is
+ * non-null.  Reads the header, one table block and one bucket. */
+static bool indexed_lookup(const struct dir *dir, const char *name,
+        struct dir_entry *ep) {
+    struct dir_header *h = malloc(sizeof *h);
+    struct dir_bucket *bucket = malloc(sizeof *bucket);
+    bool found = false;
+    int slot;
+
+    if (h != NULL && bucket != NULL && read_block(dir, 0, h) &&
+        read_block(dir, table_get(dir, h, table_index(h, name)), bucket)) {
+        slot = bucket_find(bucket, name);
+        if (slot >= 0) {
+            if (ep != NULL)
+                *ep = bucket->entries[slot];
+            found = true;
+        }
+    }
+    free(h);
+    free(bucket);
+    return found;
+}
+
+/* Doubles the table of indexed DIR, whose header is H, by appending a
+ * copy of the current table.  Returns false if the table is already
+ * as large as the header allows. */
+static bool double_table(struct dir *dir, struct dir_header *h) {
+    uint32_t old_size = 1u << h->global_depth;
+    uint32_t i;
+
+    if (h->global_depth >= DIR_MAX_DEPTH)
+        return false;
+
+    /* Make room for the second half of the table. */
+    for (i = old_size; i < 2 * old_size; i += DIR_TABLE_PER_BLOCK) {
+        if (i % DIR_TABLE_PER_BLOCK == 0)
+            h->table[i / DIR_TABLE_PER_BLOCK] = alloc_block(dir, h);
+    }
+    for (i = 0; i < old_size; i++) {
+        if (!table_set(dir, h, old_size + i, table_get(dir, h, i)))
+            return false;
     }
-    strlcpy(fname, aname, strlen(aname) + 1);
-    free(copied_name);
-    return dir;
+    h->global_depth++;
+    return true;
+}
+
+/* Splits the full bucket at block BLK, which table index IDX refers
+ * to, into itself and a new bucket on the next bit of the hash. */
+static bool split_bucket(struct dir *dir, struct dir_header *h,
+        struct dir_bucket *bucket, uint32_t blk, uint32_t idx) {
+    struct dir_bucket *sibling;
+    uint32_t new_blk, bit, i;
+    uint32_t depth = h->global_depth, new_blocks = 1;
+    bool success;
+
+    /* Make sure the journal can take every table block, the new blocks
+     * and the bucket, its sibling and the header, or fail as at the
+     * depth limit. */
+    if (bucket->local_depth == depth && depth < DIR_MAX_DEPTH) {
+        new_blocks += table_blocks(depth + 1) - table_blocks(depth);
+        depth++;
+    }
+    if (!journal_extend(table_blocks(depth) + 2 * new_blocks + 3 +
+                DIR_RESIZE_SECTORS))
+        return false;
+
+    if (bucket->local_depth == h->global_depth && !double_table(dir, h))
+        return false;
+
+    sibling = calloc(1, sizeof *sibling);
+    if (sibling == NULL)
+        return false;
+    new_blk = alloc_block(dir, h);
+    bit = 1u << bucket->local_depth;
+    bucket->local_depth++;
+    sibling->local_depth = bucket->local_depth;
+
+    /* Move every entry whose hash has the new bit set. */
+    for (i = 0; i < DIR_BUCKET_ENTRIES; i++) {
+        struct dir_entry *e = &bucket->entries[i];
+        if (e->in_use && (hash_string(e->name) & bit)) {
+            sibling->entries[i] = *e;
+            sibling->used_cnt++;
+            e->in_use = false;
+            bucket->used_cnt--;
+        }
+    }
+
+    /* Write the new bucket before pointing the table at it. */
+    success = write_block(dir, new_blk, sibling) &&
+        write_block(dir, blk, bucket);
+    for (i = idx & (bit - 1); success && i < (1u << h->global_depth);
+            i += bit) {
+        if (i & bit)
+            success = table_set(dir, h, i, new_blk);
+    }
+    free(sibling);
+    return success && write_block(dir, 0, h);
+}
+
+/* Adds NAME to indexed DIR, splitting buckets as they fill. */
+static bool indexed_add(struct dir *dir, const char *name,
+        block_sector_t inode_sector) {
+    struct dir_header *h = malloc(sizeof *h);
+    struct dir_bucket *bucket = malloc(sizeof *bucket);
+    bool success = false;
+
+    if (h == NULL || bucket == NULL || !read_block(dir, 0, h))
+        goto done;
+    for (;;) {
+        uint32_t idx = table_index(h, name);
+        uint32_t blk = table_get(dir, h, idx);
+        int i;
+
+        if (!read_block(dir, blk, bucket))
+            goto done;
+        for (i = 0; i < DIR_BUCKET_ENTRIES; i++) {
+            struct dir_entry *e = &bucket->entries[i];
+            if (!e->in_use) {
+                e->in_use = true;
+                e->inode_sector = inode_sector;
+                strlcpy(e->name, name, sizeof e->name);
+                bucket->used_cnt++;
+                h->entry_cnt++;
+                success = write_block(dir, blk, bucket) &&
+                    write_block(dir, 0, h);
+                goto done;
+            }
+        }
+        if (!split_bucket(dir, h, bucket, blk, idx))
+            goto done;
+    }
+
+done:
+    free(h);
+    free(bucket);
+    return success;
+}
+
+/* Halves the table of indexed DIR, whose header is H, for as long as
+ * its two halves are identical, releasing table blocks it no longer
+ * needs. */
+static void halve_table(struct dir *dir, struct dir_header *h) {
+    while (h->global_depth > 0) {
+        uint32_t half = 1u << (h->global_depth - 1);
+        uint32_t i;
+
+        for (i = 0; i < half; i++) {
+            if (table_get(dir, h, i) != table_get(dir, h, half + i))
+                return;
+        }
+        if (!journal_extend(table_blocks(h->global_depth) + 1 +
+                    DIR_RESIZE_SECTORS))
+            return;
+        for (i = half; i < 2 * half; i += DIR_TABLE_PER_BLOCK) {
+            if (i % DIR_TABLE_PER_BLOCK == 0) {
+                release_block(dir, h, h->table[i / DIR_TABLE_PER_BLOCK]);
+                h->table[i / DIR_TABLE_PER_BLOCK] = 0;
+            }
+        }
+        h->global_depth--;
+    }
+}
+
+/* Merges BUCKET, at block BLK and holding names whose hashes end in the
+ * low local depth bits of HASH, with its buddy for as long as the two
+ * hold at most DIR_MERGE_ENTRIES entries between them.  Returns true
+ * if any buckets were merged. */
+static bool merge_buckets(struct dir *dir, struct dir_header *h,
+        struct dir_bucket *bucket, uint32_t blk, uint32_t hash) {
+    struct dir_bucket *buddy = malloc(sizeof *buddy);
+    bool merged = false;
+
+    if (buddy == NULL)
+        return false;
+    while (bucket->local_depth > 0) {
+        uint32_t bit = 1u << (bucket->local_depth - 1);
+        uint32_t idx = hash & ((bit << 1) - 1);
+        uint32_t buddy_blk = table_get(dir, h, idx ^ bit);
+        uint32_t keep_blk, gone_blk, i, j;
+
+        if (buddy_blk == blk || !read_block(dir, buddy_blk, buddy) ||
+            buddy->local_depth != bucket->local_depth ||
+            bucket->used_cnt + buddy->used_cnt > DIR_MERGE_ENTRIES)
+            break;
+
+        /* Merging is optional, so stop if the journal cannot take the
+         * table, both buckets, the header and the shrinking file. */
+        if (!journal_extend(table_blocks(h->global_depth) + 3 +
+                    DIR_RESIZE_SECTORS))
+            break;
+
+        /* Gather both buckets' entries into BUCKET, to be stored in the
+         * block that the lower index refers to. */
+        for (i = j = 0; i < DIR_BUCKET_ENTRIES; i++) {
+            if (!buddy->entries[i].in_use)
+                continue;
+            while (bucket->entries[j].in_use)
+                j++;
+            bucket->entries[j] = buddy->entries[i];
+        }
+        bucket->used_cnt += buddy->used_cnt;
+        bucket->local_depth--;
+        keep_blk = (idx & bit) ? buddy_blk : blk;
+        gone_blk = (idx & bit) ? blk : buddy_blk;
+        if (!write_block(dir, keep_blk, bucket))
+            break;
+        for (i = (idx | bit) & ((bit << 1) - 1);
+                i < (1u << h->global_depth); i += bit << 1) {
+            table_set(dir, h, i, keep_blk);
+        }
+        release_block(dir, h, gone_blk);
+        blk = keep_blk;
+        merged = true;
+    }
+    free(buddy);
+    return merged;
+}
+
+/* Removes NAME from indexed DIR, copying its old entry to *EP, and
+ * merges the emptied bucket with its buddy when they fit in one. */
+static bool indexed_remove(struct dir *dir, const char *name,
+        struct dir_entry *ep) {
+    struct dir_header *h = malloc(sizeof *h);
+    struct dir_bucket *bucket = malloc(sizeof *bucket);
+    bool success = false;
+    uint32_t blk;
+    int slot;
+
+    if (h == NULL || bucket == NULL || !read_block(dir, 0, h))
+        goto done;
+    blk = table_get(dir, h, table_index(h, name));
+    if (!read_block(dir, blk, bucket))
+        goto done;
+    slot = bucket_find(bucket, name);
+    if (slot < 0)
+        goto done;
+    *ep = bucket->entries[slot];
+    bucket->entries[slot].in_use = false;
+    bucket->used_cnt--;
+    h->entry_cnt--;
+    success = write_block(dir, blk, bucket);
+    if (success && merge_buckets(dir, h, bucket, blk, hash_string(name)))
+        halve_table(dir, h);
+    success = success && write_block(dir, 0, h);
+
+done:
+    free(h);
+    free(bucket);
+    return success;
+}
+
+/* Copies up to CNT listed entries of indexed directory DIR, starting
+ * at position *POS, into ENTRIES, visiting each bucket once, from the
+ * lowest table index that refers to it.  The position encodes a table
+ * index and a slot within its bucket, and is advanced past the last
+ * entry examined.  Returns the number of entries copied. */
+static size_t indexed_readdir(struct dir *dir, off_t *pos,
+        struct dir_entry *entries, size_t cnt) {
+    struct dir_header *h = malloc(sizeof *h);
+    struct dir_bucket *bucket = malloc(sizeof *bucket);
+    size_t copied = 0;
+
+    if (h == NULL || bucket == NULL || !read_block(dir, 0, h))
+        goto done;
+    while (copied < cnt &&
+           (uint32_t) *pos / DIR_BUCKET_ENTRIES < (1u << h->global_depth)) {
+        uint32_t idx = *pos / DIR_BUCKET_ENTRIES;
+        uint32_t slot = *pos % DIR_BUCKET_ENTRIES;
+
+        if (!read_block(dir, table_get(dir, h, idx), bucket))
+            break;
+        if ((idx >> bucket->local_depth) != 0) {
+            /* Already visited through a lower index. */
+            *pos = (idx + 1) * DIR_BUCKET_ENTRIES;
+            continue;
+        }
+        for (; slot < DIR_BUCKET_ENTRIES && copied < cnt; slot++)
+            if (listed(&bucket->entries[slot]))
+                entries[copied++] = bucket->entries[slot];
+        *pos = idx * DIR_BUCKET_ENTRIES + slot;
+    }
+
+done:
+    free(h);
+    free(bucket);
+    return copied;
 }
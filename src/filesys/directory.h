@@ -4,6 +4,7 @@
 #include <stdbool.h>
 #include <stddef.h>
 #include "devices/block.h"
+#include "filesys/off_t.h"
 
 /*! Maximum length of a file name component.
     This is the traditional UNIX maximum length.
@@ -13,6 +14,12 @@
 
 struct inode;
 
+/*! A directory entry as reported by dir_readdir_batch(). */
+struct dir_record {
+    block_sector_t inumber;             /*!< Sector of the entry's inode. */
+    char name[NAME_MAX + 1];            /*!< Null terminated file name. */
+};
+
 /* Opening and closing directories. */
 bool dir_create(block_sector_t sector, size_t entry_cnt, block_sector_t par);
 struct dir *dir_open(struct inode *);
@@ -29,11 +36,12 @@ bool dir_lookup(const struct dir *, const char *name, struct inode **);
 bool dir_add(struct dir *, const char *name, block_sector_t);
 bool dir_remove(struct dir *, const char *name);
 bool dir_readdir(struct dir *, char name[NAME_MAX + 1]);
-bool dir_entry_name(const struct dir *, size_t  i, char *name);
+size_t dir_readdir_batch(struct dir *, off_t *pos, struct dir_record *,
+        size_t cnt);
 
-struct dir *dir_open_parent(const char *name, block_sector_t cwd);
-bool dir_is_path(const char *name);
-struct dir *dir_open_name(const char *name, char *fname);
+/* Resolving path names. */
+struct inode *dir_walk(const char *name);
+struct dir *dir_open_name(const char *name, char fname[NAME_MAX + 1]);
 
 #endif /* filesys/directory.h */
 
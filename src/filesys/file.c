@@ -10,8 +10,13 @@ struct file {
     struct inode *inode;        /*!< File's inode. */
     off_t pos;                  /*!< Current position. */
     bool deny_write;            /*!< Has file_deny_write() been called? */
+    bool direct;                /*!< Bypass the buffer cache? */
 };
 
+static off_t read_at(struct file *, void *, off_t size, off_t file_ofs);
+static off_t write_at(struct file *, const void *, off_t size,
+                      off_t file_ofs);
+
 /*! Opens a file for the given INODE, of which it takes ownership,
     and returns the new file.  Returns a null pointer if an
     allocation fails or if INODE is null. */
@@ -21,6 +26,7 @@ struct file * file_open(struct inode *inode) {
         file->inode = inode;
         file->pos = 0;
         file->deny_write = false;
+        file->direct = false;
         return file;
     } else {
         inode_close(inode);
@@ -54,7 +60,7 @@ struct inode * file_get_inode(struct file *file) {
     than SIZE if end of file is reached.  Advances FILE's position by the
     number of bytes read. */
 off_t file_read(struct file *file, void *buffer, off_t size) {
-    off_t bytes_read = inode_read_at(file->inode, buffer, size, file->pos);
+    off_t bytes_read = read_at(file, buffer, size, file->pos);
     file->pos += bytes_read;
     return bytes_read;
 }
@@ -65,7 +71,7 @@ off_t file_read(struct file *file, void *buffer, off_t size) {
     is unaffected. */
 off_t file_read_at(struct file *file, void *buffer, off_t size,
                    off_t file_ofs) {
-    off_t out = inode_read_at(file->inode, buffer, size, file_ofs);
+    off_t out = read_at(file, buffer, size, file_ofs);
     return out;
 }
 
@@ -75,8 +81,7 @@ off_t file_read_at(struct file *file, void *buffer, off_t size,
     file in that case, but file growth is not yet implemented.)
     Advances FILE's position by the number of bytes read. */
 off_t file_write(struct file *file, const void *buffer, off_t size) {
-    off_t bytes_written = inode_write_at(file->inode, buffer, size, 
-            file->pos);
+    off_t bytes_written = write_at(file, buffer, size, file->pos);
     file->pos += bytes_written;
     return bytes_written;
 }
@@ -88,6 +93,51 @@ off_t file_write(struct file *file, const void *buffer, off_t size) {
     The file's current position is unaffected. */
 off_t file_write_at(struct file *file, const void *buffer, off_t size,
                     off_t file_ofs) {
+    return write_at(file, buffer, size, file_ofs);
+}
+
+/*! Copies SIZE bytes from IN, starting at its current position, into
+    OUT, starting at its current position, entirely within the kernel.
+    Returns the number of bytes copied, which may be less than SIZE if
+    end of file is reached, or -1 if IN and OUT are the same file and
+    the ranges overlap or if nothing could be written to OUT.  Advances both positions by the number of bytes
+    copied. */
+off_t file_copy(struct file *out, struct file *in, off_t size) {
+    off_t bytes_copied = inode_copy_range(out->inode, out->pos, in->inode,
+                                          in->pos, size);
+    if (bytes_copied > 0) {
+        in->pos += bytes_copied;
+        out->pos += bytes_copied;
+    }
+    return bytes_copied;
+}
+
+/*! Sets whether reads and writes of FILE bypass the buffer cache where
+    they cover whole blocks, as suits large streaming transfers. */
+void file_set_direct(struct file *file, bool direct) {
+    ASSERT(file != NULL);
+    file->direct = direct;
+}
+
+/*! Returns true if reads and writes of FILE bypass the buffer cache. */
+bool file_is_direct(struct file *file) {
+    ASSERT(file != NULL);
+    return file->direct;
+}
+
+/* Reads from FILE's inode, directly if FILE is in direct mode. */
+static off_t read_at(struct file *file, void *buffer, off_t size,
+                     off_t file_ofs) {
+    if (file->direct)
+        return inode_read_direct(file->inode, buffer, size, file_ofs);
+    return inode_read_at(file->inode, buffer, size, file_ofs);
+}
+
+/* Writes to FILE's inode, directly if FILE is in direct mode. */
+static off_t write_at(struct file *file, const void *buffer, off_t size,
+                      off_t file_ofs) {
+    if (file->direct)
+        return inode_write_direct(file->inode, buffer, size, file_ofs);
     return inode_write_at(file->inode, buffer, size, file_ofs);
 }
 
@@ -1,33 +1,82 @@
 #include "filesys/filesys.h"
 #include <debug.h>
+#include <inttypes.h>
+#include <round.h>
 #include <stdio.h>
 #include <string.h>
 #include "threads/malloc.h" 
 #include "threads/thread.h"
 #include "filesys/cache.h"
+#include "filesys/compress.h"
+#include "filesys/dcache.h"
 #include "filesys/file.h"
 #include "filesys/free-map.h"
 #include "filesys/inode.h"
+#include "filesys/journal.h"
 #include "filesys/directory.h"
 
+/*! Identifies a file system superblock. */
+#define SUPER_MAGIC 0x50465342
+
+/*! On-disk superblock, in the first device sector of block
+    SUPER_SECTOR whatever the block size. */
+struct super_block {
+    unsigned magic;                     /*!< SUPER_MAGIC. */
+    uint32_t block_size;                /*!< Bytes per logical block. */
+    uint32_t block_cnt;                 /*!< Logical blocks in the file
+                                             system. */
+    uint32_t packed_map;                /*!< First block of the map of
+                                             compressed groups. */
+    char unused[BLOCK_SECTOR_SIZE - 16];
+};
+
 /*! Partition that contains the file system. */
 struct block *fs_device;
 
+/*! Logical block size, in bytes. */
+unsigned fs_block_size;
+
+/*! Device sectors per logical block. */
+static unsigned block_sectors;
+
+/*! First block of the packed map, see filesys/compress.c. */
+static block_sector_t packed_map;
+
+/*! Whether new ordinary files are compressed. */
+bool fs_compress_files;
+
 static void do_format(void);
+static void read_super(void);
+static void write_super(void);
 
 /*! Initializes the file system module.
-    If FORMAT is true, reformats the file system. */
-void filesys_init(bool format) {
+    If FORMAT is true, reformats the file system with BLOCK_SIZE-byte
+    blocks. */
+void filesys_init(bool format, unsigned block_size) {
     fs_device = block_get_role(BLOCK_FILESYS);
     if (fs_device == NULL)
         PANIC("No file system device found, can't initialize file system.");
+    if (format) {
+        if (block_size < FS_BLOCK_MIN || block_size > FS_BLOCK_MAX ||
+            (block_size & (block_size - 1)) != 0)
+            PANIC("bad file system block size %u", block_size);
+        fs_block_size = block_size;
+        block_sectors = block_size / BLOCK_SECTOR_SIZE;
+        write_super();
+    } else {
+        read_super();
+    }
     cache_init();
+    compress_init();
+    dcache_init();
     inode_init();
     free_map_init();
 
     if (format) 
         do_format();
 
+    journal_open();
+    compress_open(packed_map);
     free_map_open();
     thread_current()->dir = inode_open(ROOT_DIR_SECTOR);
 }
@@ -35,7 +84,9 @@ void filesys_init(bool format) {
 /*! Shuts down the file system module, writing any unwritten data to disk.
     */
 void filesys_done(void) {
+    journal_close();
     cache_destroy();
+    compress_print_stats();
     free_map_close();
 }
 
@@ -44,84 +95,174 @@ void filesys_done(void) {
     or if internal memory allocation fails. */
 bool filesys_create(const char *name, off_t initial_size) {
     block_sector_t inode_sector = 0;
-    char *fname = malloc(strlen(name));
-    if (fname == NULL)
-        return false;
+    char fname[NAME_MAX + 1];
+    journal_begin();
     struct dir *dir = dir_open_name(name, fname);
 
     bool success = (dir != NULL &&
                     free_map_allocate(1, &inode_sector) &&
-                    inode_create(inode_sector, initial_size, false, 0) &&
+                    inode_create(inode_sector, 0, false, 0) &&
                     dir_add(dir, fname, inode_sector));
     if (!success && inode_sector != 0) 
         free_map_release(inode_sector, 1);
     dir_close(dir);
-    free(fname);
+    journal_end();
 
+    /* Allocate the data afterward, in as many journaled operations as
+     * it takes, rather than in one that a large file would overflow. */
+    if (success && initial_size > 0) {
+        struct inode *inode = inode_open(inode_sector);
+        success = inode != NULL && inode_grow(inode, initial_size);
+        inode_close(inode);
+        if (!success)
+            filesys_remove(name);
+    }
     return success;
 }
 
 /*! Opens the file with the given NAME.  Returns the new file if successful
     or a null pointer otherwise.  Fails if no file named NAME exists,
-    or if an internal memory allocation fails. */
+    if NAME is a directory, or if an internal memory allocation fails. */
 struct file * filesys_open(const char *name) {
-    char *fname = malloc(strlen(name));
-    if (fname == NULL)
-        return false;
-    struct dir *dir = dir_open_name(name, fname);
-    struct inode *inode = NULL;
-    if (dir != NULL)
-        dir_lookup(dir, fname, &inode);
-    dir_close(dir);
-    free(fname);
+    struct inode *inode = dir_walk(name);
 
-
-    if(inode_is_dir(inode)) {
-        return false;
-    } else {
-        return file_open(inode);
+    if (inode_is_dir(inode)) {
+        inode_close(inode);
+        return NULL;
     }
+    return file_open(inode);
 }
 
+/*! Opens the directory with the given NAME.  Returns a null pointer if
+    NAME does not exist or is not a directory. */
 struct dir *filesys_open_dir(const char *name) {
-    // Special case, because of the empty fname.
-    if (!strcmp("/", name)) {
-        return dir_open_root();
-    }
-    char *fname = malloc(strlen(name));
-    if (fname == NULL)
-        return false;
-    struct dir *dir = dir_open_name(name, fname);
-    struct inode *inode = NULL;
-    if (dir != NULL)
-        dir_lookup(dir, fname, &inode);
-    dir_close(dir);
-    free(fname);
+    struct inode *inode = dir_walk(name);
 
-    if (inode_is_dir(inode)) {
-        return dir_open(inode);
-    } else {
+    if (!inode_is_dir(inode)) {
+        inode_close(inode);
         return NULL;
     }
+    return dir_open(inode);
 }
 
 /*! Deletes the file named NAME.  Returns true if successful, false on
  *  failure.  Fails if no file named NAME exists, or if an internal
  *  memory allocation fails. */
 bool filesys_remove(const char *name) {
-    char *fname = malloc(strlen(name));
-    ASSERT(fname);
+    char fname[NAME_MAX + 1];
+    journal_begin();
     struct dir *dir = dir_open_name(name, fname);
     bool success = dir != NULL && dir_remove(dir, fname);
     dir_close(dir);
+    journal_end();
 
     return success;
 }
-
+
+/*! Returns the number of logical blocks in the file system. */
+block_sector_t fs_block_cnt(void) {
+    return block_size(fs_device) / block_sectors;
+}
+
+/*! Reads logical block BLOCK into BUFFER, which must have room for
+    fs_block_size bytes. */
+void fs_block_read(block_sector_t block, void *buffer) {
+    fs_block_read_multi(block, 1, buffer);
+}
+
+/*! Writes fs_block_size bytes from BUFFER to logical block BLOCK. */
+void fs_block_write(block_sector_t block, const void *buffer) {
+    fs_block_write_multi(block, 1, buffer);
+}
+
+/*! Reads the CNT consecutive logical blocks starting at BLOCK into
+    BUFFER, which must have room for CNT * fs_block_size bytes. */
+void fs_block_read_multi(block_sector_t block, size_t cnt, void *buffer) {
+    ASSERT(block + cnt <= fs_block_cnt());
+    block_read_multi(fs_device, block * block_sectors, cnt * block_sectors,
+                     buffer);
+}
+
+/*! Writes CNT * fs_block_size bytes from BUFFER to the CNT consecutive
+    logical blocks starting at BLOCK. */
+void fs_block_write_multi(block_sector_t block, size_t cnt,
+                          const void *buffer) {
+    ASSERT(block + cnt <= fs_block_cnt());
+    block_write_multi(fs_device, block * block_sectors, cnt * block_sectors,
+                      buffer);
+}
+
+/*! Submits REQ to read (if WRITE is false) or write (if WRITE is true)
+    the CNT logical blocks starting at BLOCK, from or to BUFFER, without
+    waiting for it to complete.  Wait with block_wait(). */
+void fs_block_submit(struct block_request *req, bool write,
+                     block_sector_t block, size_t cnt, void *buffer) {
+    ASSERT(block + cnt <= fs_block_cnt());
+    block_request_init(req, write, block * block_sectors, cnt * block_sectors,
+                       buffer, NULL, NULL);
+    block_submit(fs_device, req);
+}
+
+/*! Reads SECTOR_CNT device sectors into BUFFER, starting SECTOR_OFS
+    sectors into the blocks that begin at BLOCK.  For data stored in
+    less than whole blocks. */
+void fs_block_read_sectors(block_sector_t block, size_t sector_ofs,
+                           size_t sector_cnt, void *buffer) {
+    ASSERT(block + DIV_ROUND_UP(sector_ofs + sector_cnt, block_sectors)
+           <= fs_block_cnt());
+    block_read_multi(fs_device, block * block_sectors + sector_ofs,
+                     sector_cnt, buffer);
+}
+
+/*! Writes SECTOR_CNT device sectors from BUFFER, starting SECTOR_OFS
+    sectors into the blocks that begin at BLOCK. */
+void fs_block_write_sectors(block_sector_t block, size_t sector_ofs,
+                            size_t sector_cnt, const void *buffer) {
+    ASSERT(block + DIV_ROUND_UP(sector_ofs + sector_cnt, block_sectors)
+           <= fs_block_cnt());
+    block_write_multi(fs_device, block * block_sectors + sector_ofs,
+                      sector_cnt, buffer);
+}
+
+/*! Reads the superblock and sets the block size from it. */
+static void read_super(void) {
+    struct super_block sb;
+    block_read(fs_device, SUPER_SECTOR, &sb);
+    if (sb.magic != SUPER_MAGIC)
+        PANIC("file system not formatted (use -f)");
+    if (sb.block_size < FS_BLOCK_MIN || sb.block_size > FS_BLOCK_MAX ||
+        (sb.block_size & (sb.block_size - 1)) != 0)
+        PANIC("corrupt superblock: block size %"PRIu32, sb.block_size);
+    fs_block_size = sb.block_size;
+    block_sectors = fs_block_size / BLOCK_SECTOR_SIZE;
+    if (sb.block_cnt != fs_block_cnt())
+        PANIC("superblock is for a device of %"PRIu32" blocks, not %"PRIu32,
+              sb.block_cnt, fs_block_cnt());
+    if (sb.packed_map == SUPER_SECTOR || sb.packed_map >= sb.block_cnt)
+        PANIC("corrupt superblock: packed map at block %"PRIu32,
+              sb.packed_map);
+    packed_map = sb.packed_map;
+}
+
+/*! Writes a superblock for the block size being formatted with. */
+static void write_super(void) {
+    struct super_block sb;
+    ASSERT(sizeof sb == BLOCK_SECTOR_SIZE);
+    memset(&sb, 0, sizeof sb);
+    sb.magic = SUPER_MAGIC;
+    sb.block_size = fs_block_size;
+    sb.block_cnt = fs_block_cnt();
+    sb.packed_map = packed_map;
+    block_write(fs_device, SUPER_SECTOR, &sb);
+}
+
 /*! Formats the file system. */
 static void do_format(void) {
     printf("Formatting file system...");
     free_map_create();
+    journal_create();
+    packed_map = compress_create();
+    write_super();
     if (!dir_create(ROOT_DIR_SECTOR, 16, ROOT_DIR_SECTOR))
         PANIC("root directory creation failed");
     free_map_close();
@@ -2,17 +2,52 @@
 #define FILESYS_FILESYS_H
 
 #include <stdbool.h>
+#include <stddef.h>
+#include "devices/block.h"
 #include "filesys/off_t.h"
+#include "threads/vaddr.h"
 
-/*! Sectors of system file inodes. @{ */
-#define FREE_MAP_SECTOR 0       /*!< Free map file inode sector. */
-#define ROOT_DIR_SECTOR 1       /*!< Root directory file inode sector. */
+/*! The file system is laid out in logical blocks of fs_block_size bytes,
+    a power of two from FS_BLOCK_MIN to FS_BLOCK_MAX chosen when it is
+    formatted.  Block numbers are block_sector_t's, and "sector" means a
+    logical block everywhere above the cache. @{ */
+#define FS_BLOCK_MIN BLOCK_SECTOR_SIZE
+#define FS_BLOCK_MAX 4096
+extern unsigned fs_block_size;
+/*! @} */
+
+/*! Files are allocated blocks a group at a time: a page's worth of
+    blocks, contiguous on disk and mapped to consecutive, group-aligned
+    offsets in the file. */
+#define BLOCKS_PER_GROUP (PGSIZE / fs_block_size)
+
+/*! Whether new ordinary files are compressed. */
+extern bool fs_compress_files;
+
+/*! Blocks of the superblock and the system file inodes. @{ */
+#define SUPER_SECTOR 0          /*!< File system superblock. */
+#define FREE_MAP_SECTOR 1       /*!< Free map file inode sector. */
+#define ROOT_DIR_SECTOR 2       /*!< Root directory file inode sector. */
+#define JOURNAL_SECTOR 3        /*!< Journal superblock sector. */
 /*! @} */
 
 /*! Block device that contains the file system. */
 struct block *fs_device;
 
-void filesys_init(bool format);
+/* Logical block I/O, bypassing the cache. */
+block_sector_t fs_block_cnt(void);
+void fs_block_read(block_sector_t, void *);
+void fs_block_write(block_sector_t, const void *);
+void fs_block_read_multi(block_sector_t, size_t cnt, void *);
+void fs_block_write_multi(block_sector_t, size_t cnt, const void *);
+void fs_block_submit(struct block_request *, bool write, block_sector_t,
+                     size_t cnt, void *);
+void fs_block_read_sectors(block_sector_t, size_t sector_ofs,
+                           size_t sector_cnt, void *);
+void fs_block_write_sectors(block_sector_t, size_t sector_ofs,
+                            size_t sector_cnt, const void *);
+
+void filesys_init(bool format, unsigned block_size);
 void filesys_done(void);
 bool filesys_create(const char *name, off_t initial_size);
 struct file *filesys_open(const char *name);
@@ -4,17 +4,20 @@
 #include "filesys/file.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
+#include "filesys/journal.h"
 
 static struct file *free_map_file;   /*!< Free map file. */
 static struct bitmap *free_map;      /*!< Free map, one bit per sector. */
 
 /*! Initializes the free map. */
 void free_map_init(void) {
-    free_map = bitmap_create(block_size(fs_device));
+    free_map = bitmap_create(fs_block_cnt());
     if (free_map == NULL)
         PANIC("bitmap creation failed--file system device is too large");
+    bitmap_mark(free_map, SUPER_SECTOR);
     bitmap_mark(free_map, FREE_MAP_SECTOR);
     bitmap_mark(free_map, ROOT_DIR_SECTOR);
+    bitmap_mark(free_map, JOURNAL_SECTOR);
 }
 
 /*! Allocates CNT consecutive sectors from the free map and stores the first
@@ -24,7 +27,7 @@ void free_map_init(void) {
 bool free_map_allocate(size_t cnt, block_sector_t *sectorp) {
     block_sector_t sector = bitmap_scan_and_flip(free_map, 0, cnt, false);
     if (sector != BITMAP_ERROR && free_map_file != NULL &&
-        !bitmap_write(free_map, free_map_file)) {
+        !bitmap_write_range(free_map, free_map_file, sector, cnt)) {
         bitmap_set_multiple(free_map, sector, cnt, false); 
         sector = BITMAP_ERROR;
     }
@@ -37,7 +40,8 @@ bool free_map_allocate(size_t cnt, block_sector_t *sectorp) {
 void free_map_release(block_sector_t sector, size_t cnt) {
     ASSERT(bitmap_all(free_map, sector, cnt));
     bitmap_set_multiple(free_map, sector, cnt, false);
-    bitmap_write(free_map, free_map_file);
+    bitmap_write_range(free_map, free_map_file, sector, cnt);
+    journal_revoke(sector, cnt);
 }
 
 /*! Opens the free map file and reads it from disk. */
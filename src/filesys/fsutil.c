@@ -3,28 +3,173 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <inttypes.h>
 #include <ustar.h>
+#include "devices/block.h"
+#include "devices/iotrace.h"
 #include "filesys/directory.h"
 #include "filesys/file.h"
 #include "filesys/filesys.h"
+#include "devices/timer.h"
 #include "threads/malloc.h"
 #include "threads/palloc.h"
 #include "threads/vaddr.h"
 
+/*! Sector of the scratch device at which "append" and "iotrace-save"
+    add the next file to the ustar archive there. */
+static block_sector_t append_sector = 0;
+
 /*! List files in the root directory. */
 void fsutil_ls(char **argv UNUSED) {
     struct dir *dir;
-    char name[NAME_MAX + 1];
+    struct dir_record records[16];
+    off_t pos = 0;
+    size_t n, i;
 
     printf("Files in the root directory:\n");
     dir = dir_open_root();
     if (dir == NULL)
         PANIC("root dir open failed");
-    while (dir_readdir(dir, name))
-        printf("%s\n", name);
+    while ((n = dir_readdir_batch(dir, &pos, records,
+                    sizeof records / sizeof *records)) > 0)
+        for (i = 0; i < n; i++)
+            printf("%s\n", records[i].name);
+    dir_close(dir);
     printf("End of listing.\n");
 }
 
+/* Deepest path and number of opens timed by fsutil_bench_open(). */
+#define BENCH_DEPTH 16
+#define BENCH_OPENS 10000
+
+/*! Times BENCH_OPENS open/close pairs on a file at each depth from 1 to
+    BENCH_DEPTH below a scratch directory, then removes the tree. */
+void fsutil_bench_open(char **argv UNUSED) {
+    char path[4 + 2 * BENCH_DEPTH + 3];
+    size_t dir_len[BENCH_DEPTH + 1];
+    int depth, i;
+
+    printf("Timing open/close by path depth...\n");
+    strlcpy(path, "/bo", sizeof path);
+    if (!dir_mkdir(path, 16))
+        PANIC("%s: mkdir failed", path);
+    dir_len[0] = strlen(path);
+    for (depth = 1; depth <= BENCH_DEPTH; depth++) {
+        /* Place a file in the deepest directory so far, reached
+         * through DEPTH directories, then add the next directory. */
+        strlcat(path, "/f", sizeof path);
+        if (!filesys_create(path, 0))
+            PANIC("%s: create failed", path);
+        path[strlen(path) - 1] = 'd';
+        if (depth < BENCH_DEPTH && !dir_mkdir(path, 16))
+            PANIC("%s: mkdir failed", path);
+        dir_len[depth] = strlen(path);
+    }
+
+    for (depth = 1; depth <= BENCH_DEPTH; depth++) {
+        int64_t start;
+
+        path[dir_len[depth - 1]] = '\0';
+        strlcat(path, "/f", sizeof path);
+        start = timer_ticks();
+        for (i = 0; i < BENCH_OPENS; i++) {
+            struct file *file = filesys_open(path);
+            if (file == NULL)
+                PANIC("%s: open failed", path);
+            file_close(file);
+        }
+        printf("depth %2d: %d opens in %"PRId64" ticks\n",
+               depth, BENCH_OPENS, timer_elapsed(start));
+    }
+
+    /* Remove the tree, deepest first. */
+    for (depth = BENCH_DEPTH; depth >= 1; depth--) {
+        path[dir_len[depth - 1]] = '\0';
+        strlcat(path, "/f", sizeof path);
+        filesys_remove(path);
+        path[dir_len[depth - 1]] = '\0';
+        filesys_remove(path);
+    }
+    printf("End of timing.\n");
+}
+
+/*! Prints the disk I/O statistics gathered so far. */
+void fsutil_iostat(char **argv UNUSED) {
+    block_print_io_stats();
+}
+
+/*! Prints the block I/O trace to the console. */
+void fsutil_iotrace(char **argv UNUSED) {
+    iotrace_print();
+}
+
+/*! The file "iotrace-save" is writing to the scratch device. */
+struct trace_file {
+    struct block *dst;          /*!< Scratch device. */
+    char *buffer;               /*!< Sector being filled. */
+    size_t ofs;                 /*!< Bytes in BUFFER so far. */
+    block_sector_t sector;      /*!< Where BUFFER goes. */
+    off_t size;                 /*!< Bytes of trace so far. */
+};
+
+/*! Adds LINE to the trace_file AUX, writing each sector as it fills. */
+static void put_trace_line(const char *line, void *aux) {
+    struct trace_file *tf = aux;
+    size_t len = strlen(line);
+
+    tf->size += len;
+    while (len > 0) {
+        size_t chunk = BLOCK_SECTOR_SIZE - tf->ofs;
+        if (chunk > len)
+            chunk = len;
+        memcpy(tf->buffer + tf->ofs, line, chunk);
+        tf->ofs += chunk;
+        line += chunk;
+        len -= chunk;
+        if (tf->ofs == BLOCK_SECTOR_SIZE) {
+            if (tf->sector >= block_size(tf->dst))
+                PANIC("iotrace: out of space on scratch device");
+            block_write(tf->dst, tf->sector++, tf->buffer);
+            tf->ofs = 0;
+        }
+    }
+}
+
+/*! Appends the block I/O trace to the ustar archive on the scratch
+    device, as a file named "iotrace".  The data goes first, while the
+    trace is held still, and the header last, once the size is known. */
+void fsutil_iotrace_save(char **argv UNUSED) {
+    struct trace_file tf;
+
+    printf("Saving I/O trace to scratch device...\n");
+    tf.dst = block_get_role(BLOCK_SCRATCH);
+    if (tf.dst == NULL)
+        PANIC("couldn't open scratch device");
+    tf.buffer = malloc(BLOCK_SECTOR_SIZE);
+    if (tf.buffer == NULL)
+        PANIC("couldn't allocate buffer");
+    tf.ofs = 0;
+    tf.sector = append_sector + 1;
+    tf.size = 0;
+
+    iotrace_format(put_trace_line, &tf);
+    if (tf.ofs > 0) {
+        memset(tf.buffer + tf.ofs, 0, BLOCK_SECTOR_SIZE - tf.ofs);
+        if (tf.sector >= block_size(tf.dst))
+            PANIC("iotrace: out of space on scratch device");
+        block_write(tf.dst, tf.sector++, tf.buffer);
+    }
+
+    ustar_make_header("iotrace", USTAR_REGULAR, tf.size, tf.buffer);
+    block_write(tf.dst, append_sector, tf.buffer);
+    append_sector = tf.sector;
+
+    /* End-of-archive marker, as in fsutil_append(). */
+    memset(tf.buffer, 0, BLOCK_SECTOR_SIZE);
+    block_write(tf.dst, append_sector, tf.buffer);
+    free(tf.buffer);
+}
+
 /*! Prints the contents of file ARGV[1] to the system console as
     hex and ASCII. */
 void fsutil_cat(char **argv) {
@@ -152,8 +297,6 @@ void fsutil_extract(char **argv UNUSED) {
     position is independent of that used for fsutil_extract(), so
     `extract' should precede all `append's. */
 void fsutil_append(char **argv) {
-    static block_sector_t sector = 0;
-
     const char *file_name = argv[1];
     void *buffer;
     struct file *src;
@@ -182,19 +325,19 @@ void fsutil_append(char **argv) {
     /* Write ustar header to first sector. */
     if (!ustar_make_header(file_name, USTAR_REGULAR, size, buffer))
         PANIC("%s: name too long for ustar format", file_name);
-    block_write(dst, sector++, buffer);
+    block_write(dst, append_sector++, buffer);
 
     /* Do copy. */
     int chunk_size;
     while (size > 0) {
         chunk_size = size > BLOCK_SECTOR_SIZE ? BLOCK_SECTOR_SIZE : size;
-        if (sector >= block_size(dst))
+        if (append_sector >= block_size(dst))
             PANIC("%s: out of space on scratch device", file_name);
         if (file_read(src, buffer, chunk_size) != chunk_size)
             PANIC("%s: read failed with %"PROTd" bytes unread", file_name,
                     size);
         memset(buffer + chunk_size, 0, BLOCK_SECTOR_SIZE - chunk_size);
-        block_write(dst, sector++, buffer);
+        block_write(dst, append_sector++, buffer);
         size -= chunk_size;
     }
 
@@ -202,8 +345,8 @@ void fsutil_append(char **argv) {
        sectors full of zeros.  Don't advance our position past
        them, though, in case we have more files to append. */
     memset(buffer, 0, BLOCK_SECTOR_SIZE);
-    block_write(dst, sector, buffer);
-    block_write(dst, sector, buffer + 1);
+    block_write(dst, append_sector, buffer);
+    block_write(dst, append_sector, buffer + 1);
 
     /* Finish up. */
     file_close(src);
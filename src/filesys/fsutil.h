@@ -6,6 +6,10 @@ void fsutil_cat(char **argv);
 void fsutil_rm(char **argv);
 void fsutil_extract(char **argv);
 void fsutil_append(char **argv);
+void fsutil_bench_open(char **argv);
+void fsutil_iostat(char **argv);
+void fsutil_iotrace(char **argv);
+void fsutil_iotrace_save(char **argv);
 
 #endif /* filesys/fsutil.h */
 
@@ -2,31 +2,35 @@
 #include <list.h>
 #include <debug.h>
 #include <round.h>
+#include <stddef.h>
 #include <string.h>
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
 #include "filesys/cache.h"
+#include "filesys/compress.h"
+#include "filesys/dcache.h"
+#include "filesys/journal.h"
 #include "threads/malloc.h"
+#include "threads/palloc.h"
 #include "threads/synch.h"
 #include "threads/thread.h"
+#include "threads/vaddr.h"
 
 /*! Identifies an inode. */
 #define INODE_MAGIC 0x494e4f44
 
-static void extend_to(struct inode *inode, off_t offset);
+static bool extend_to(struct inode *inode, off_t offset, bool zero);
+static bool grow(struct inode *inode, off_t length, bool zero);
 
 /* Number of i_blocks. */
 #define N_BLOCKS 15
 
-/* Number of blocks in a group. We allocate blocks one group at a time
- * to improve locality of data, while still enabling extensibility.
- * This should be chosen such that BLOCKS_PER_GROUP * BLOCK_SECTOR_SIZE
- * is a multiple of a page size.
- */
-#define BLOCKS_PER_GROUP 8
+/* Number of block pointers in an indirect block. */
+#define PTRS_PER_BLOCK (fs_block_size / sizeof(block_sector_t))
 
 /*! On-disk inode.
-    Must be exactly BLOCK_SECTOR_SIZE bytes long. */
+    Must be exactly BLOCK_SECTOR_SIZE bytes long.  It occupies the start
+    of its block; the rest of the block is unused. */
 struct inode_disk {
     // File size in bytes.
     off_t length;
@@ -48,6 +52,9 @@ struct inode_disk {
     block_sector_t i_block[N_BLOCKS];
     // Whether this inode is a directory
     bool is_dir;
+    // Whether the data is stored in compressed groups.  Shares the word
+    // of is_dir.
+    bool compressed;
     // If this inode is a directory, represents the parent directory.
     // Invalid for files due to hard linking
     block_sector_t parent;
@@ -59,79 +66,95 @@ struct inode_disk {
 static bool append_sector(struct inode_disk *disk_inode,
         block_sector_t *result);
 
+static bool append_zeros(struct inode_disk *disk_inode);
+
 /* Removes the last sector from an inode. */
-static bool pop_sector(struct inode *inode);
+static void pop_sector(struct inode_disk *disk_inode);
 
 static void acquire(struct inode *inode);
 static void release(struct inode *inode);
+static bool is_metadata(const struct inode *inode);
+static off_t direct_io(struct inode *inode, uint8_t *buffer, off_t size,
+        off_t offset, bool write);
+
+/* Returns the first block of the group holding SECTOR, which is block
+ * VBLOCK of its file.  Blocks are handed out a group at a time, in
+ * order, so each group starts at a multiple of BLOCKS_PER_GROUP. */
+static inline block_sector_t group_of(block_sector_t sector,
+        unsigned vblock) {
+    return sector - vblock % BLOCKS_PER_GROUP;
+}
+
+/* Most blocks added to a file by one journaled operation, few enough
+ * that the inode, index blocks and free map sectors they change fit in
+ * the operation's share of a transaction. */
+#define GROW_STEP_BLOCKS (4 * BLOCKS_PER_GROUP)
+
+/* A block of zeros, for filling new blocks. */
+static const char zeros[FS_BLOCK_MAX];
+
+/* Most blocks moved by one direct transfer: a bounce page's worth. */
+#define DIRECT_RUN_BLOCKS (PGSIZE / fs_block_size)
 
 /*! Returns the number of sectors to allocate for an inode SIZE
     bytes long. */
 static inline size_t bytes_to_sectors(off_t size) {
-    return DIV_ROUND_UP(size, BLOCK_SECTOR_SIZE);
+    return DIV_ROUND_UP(size, fs_block_size);
 }
 
 /*! In-memory inode. */
 struct inode {
     struct list_elem elem;       /*!< Element in inode list. */
     struct lock in_lock;
+    struct lock dir_lock;        /*!< Held while reading or changing
+                                      the directory in this inode. */
     bool is_dir;
+    bool compressed;             /*!< Data stored in compressed groups. */
     block_sector_t sector;       /*!< Sector number of disk location. */
     int open_cnt;                /*!< Number of openers. */
     bool removed;                /*!< True if deleted, false otherwise. */
     int deny_write_cnt;          /*!< 0: writes ok, >0: deny writes. */
     off_t length;      /*!< Inode content. */
+    off_t dir_hint;              /*!< No free directory entry lies
+                                      before this offset. */
 };
 
-/*! Returns the block device sector that contains byte offset POS
-    within INODE.
-    Returns -1 if INODE does not contain data for a byte at offset
-    POS. */
-static block_sector_t byte_to_sector(const struct inode *inode, off_t pos) {
+/* Returns the sector holding block VBLOCK of the file described by
+ * DISK_INODE, which must have at least VBLOCK + 1 blocks. */
+static block_sector_t block_at(const struct inode_disk *disk_inode,
+        unsigned vblock) {
     block_sector_t result;
     off_t start;
 
-    ASSERT(inode != NULL);
-    // Read in the data.
-    struct inode_disk buffer;
-    struct inode_disk *disk_inode = &buffer;
-    ASSERT(disk_inode);
-    cache_read(inode->sector, disk_inode);
-    if (pos >= disk_inode->length) {
-        return -1;
-    }
-    // The virtual block we want (the block offset within the file if
-    // the file was linear).
-    unsigned vblock = pos / BLOCK_SECTOR_SIZE;
-    // Find the actual block sector that corresponds to pos.
+    // Find the actual block sector that corresponds to vblock.
     if (vblock <= N_BLOCKS - 4) {
         // If vblock is in the range 0..N_BLOCKS - 4, then we can directly
         // get the block that we want.
         result = disk_inode->i_block[vblock];
-    } else if (vblock <= BLOCK_SECTOR_SIZE / 4 + (N_BLOCKS - 4)) {
+    } else if (vblock <= PTRS_PER_BLOCK + (N_BLOCKS - 4)) {
         // If vblock is in the range:
-        // NBLOCKS - 3..BLOCK_SECTOR_SIZE / 4 + N_BLOCKS - 4
+        // NBLOCKS - 3..PTRS_PER_BLOCK + N_BLOCKS - 4
         // then it is accessed through 1-indirect addressing.
         // This requires one disk access to get the block sector.
         block_sector_t indirect_1 = disk_inode->i_block[N_BLOCKS - 3];
         start = vblock - (N_BLOCKS - 3);
         cache_read_spec(indirect_1, &result, start * sizeof(block_sector_t),
                 sizeof(block_sector_t));
-    } else if (vblock <= (BLOCK_SECTOR_SIZE / 4) * (BLOCK_SECTOR_SIZE / 4) +
-            BLOCK_SECTOR_SIZE / 4 + (N_BLOCKS - 4)) {
+    } else if (vblock <= PTRS_PER_BLOCK * PTRS_PER_BLOCK +
+            PTRS_PER_BLOCK + (N_BLOCKS - 4)) {
         // Otherwise, if vblock is in the range:
-        // BLOCK_SECTOR_SIZE / 4 + N_BLOCKS - 4 through
-        // (BLOCK_SECTOR_SIZE / 4)^2 + BLOCK_SECTOR_SIZE / 4 + N_BLOCKS - 4
+        // PTRS_PER_BLOCK + N_BLOCKS - 4 through
+        // PTRS_PER_BLOCK^2 + PTRS_PER_BLOCK + N_BLOCKS - 4
         // then it is accessed through 2-indirect addressing. This requires
         // two disk accesses to get the block sector.
         block_sector_t indirect2 = disk_inode->i_block[N_BLOCKS - 2];
         block_sector_t indirect1;
-        start = (vblock - BLOCK_SECTOR_SIZE / 4 - (N_BLOCKS - 3)) /
-            (BLOCK_SECTOR_SIZE / 4);
+        start = (vblock - PTRS_PER_BLOCK - (N_BLOCKS - 3)) /
+            PTRS_PER_BLOCK;
         cache_read_spec(indirect2, &indirect1,
                 start * sizeof(block_sector_t), sizeof(block_sector_t));
-        start = (vblock - BLOCK_SECTOR_SIZE / 4 - (N_BLOCKS - 3)) %
-            (BLOCK_SECTOR_SIZE / 4);
+        start = (vblock - PTRS_PER_BLOCK - (N_BLOCKS - 3)) %
+            PTRS_PER_BLOCK;
         cache_read_spec(indirect1, &result,
                 start * sizeof(block_sector_t), sizeof(block_sector_t));
     } else {
@@ -140,20 +163,63 @@ static block_sector_t byte_to_sector(const struct inode *inode, off_t pos) {
     return result;
 }
 
+/*! Returns the block device sector that contains byte offset POS
+    within INODE.
+    Returns -1 if INODE does not contain data for a byte at offset
+    POS. */
+static block_sector_t byte_to_sector(const struct inode *inode, off_t pos) {
+    ASSERT(inode != NULL);
+    // Read in the data.
+    struct inode_disk buffer;
+    struct inode_disk *disk_inode = &buffer;
+    ASSERT(disk_inode);
+    cache_read_spec(inode->sector, disk_inode, 0, sizeof *disk_inode);
+    if (pos >= disk_inode->length) {
+        return -1;
+    }
+    // The virtual block we want (the block offset within the file if
+    // the file was linear).
+    return block_at(disk_inode, pos / fs_block_size);
+}
+
 /*! List of open inodes, so that opening a single inode twice
     returns the same `struct inode'. */
 static struct list open_inodes;
 
+/*! Inodes whose last opener has closed them, most recently closed
+    first.  Opening one again takes it back without allocating memory
+    or reading the disk.  Removed inodes are never kept, and since a
+    sector can also be freed without inode_remove(), e.g. when dir_add()
+    fails after dir_create(), inode_create() drops any inode kept for
+    the sector it writes. */
+static struct list closed_inodes;
+static size_t closed_cnt;
+
+/* Most inodes kept in closed_inodes. */
+#define CLOSED_INODES_MAX 64
+
+/*! Protects both lists and each inode's open count.  Never held while
+    waiting for the disk or for an inode's own lock. */
+static struct lock inodes_lock;
+
+static bool shrink_closed(size_t keep);
+static void forget_closed(block_sector_t sector);
+
 /*! Initializes the inode module. */
 void inode_init(void) {
     list_init(&open_inodes);
+    list_init(&closed_inodes);
+    lock_init(&inodes_lock);
 }
 
 /*! Initializes an inode with LENGTH bytes of data and
     writes the new inode to sector SECTOR on the file system
     device.
     Returns true if successful.
-    Returns false if memory or disk allocation fails. */
+    Returns false if memory or disk allocation fails.
+    The data is allocated in the same journaled operation, so while the
+    journal is open LENGTH should be small; larger files are created
+    empty and grown with inode_grow(). */
 bool inode_create(block_sector_t sector, off_t length, bool is_dir,
         block_sector_t parent) {
     struct inode_disk *disk_inode = NULL;
@@ -168,6 +234,8 @@ bool inode_create(block_sector_t sector, off_t length, bool is_dir,
     if (disk_inode == NULL) {
         return false;
     }
+    forget_closed(sector);
+    journal_begin();
     size_t sectors = bytes_to_sectors(length);
     disk_inode->length = length;
     disk_inode->magic = INODE_MAGIC;
@@ -175,22 +243,21 @@ bool inode_create(block_sector_t sector, off_t length, bool is_dir,
     disk_inode->next_block = 0;
     disk_inode->group_blocks_free = 0;
     disk_inode->is_dir = is_dir;
+    disk_inode->compressed = fs_compress_files && !is_dir &&
+        sector != FREE_MAP_SECTOR;
     disk_inode->parent = parent;
     unsigned i;
-    char *zeros = calloc(BLOCK_SECTOR_SIZE, sizeof(char));
-    block_sector_t block;
     for (i = 0; i < sectors; i++) {
-        if (append_sector(disk_inode, &block)) {
-            // Fill the new block with zeros.
-            cache_write(block, zeros);
-        } else {
+        if (!append_zeros(disk_inode)) {
+            journal_end();
+            free(disk_inode);
             return false;
         }
     }
     // Write inode to disk.
-    cache_write(sector, disk_inode);
+    journal_write(sector, disk_inode, 0, sizeof *disk_inode);
+    journal_end();
     free(disk_inode);
-    free(zeros);
     return true;
 }
 
@@ -200,43 +267,74 @@ bool inode_create(block_sector_t sector, off_t length, bool is_dir,
 struct inode * inode_open(block_sector_t sector) {
     struct list_elem *e;
     struct inode *inode;
+    struct inode_disk disk_inode;
 
-    /* Check whether this inode is already open. */
+    lock_acquire(&inodes_lock);
+    /* Check whether this inode is already open.  It may still be
+     * loading, in which case its loader holds its lock. */
     for (e = list_begin(&open_inodes); e != list_end(&open_inodes);
          e = list_next(e)) {
         inode = list_entry(e, struct inode, elem);
         if (inode->sector == sector) {
-            inode_reopen(inode);
+            inode->open_cnt++;
+            lock_release(&inodes_lock);
+            acquire(inode);
+            release(inode);
+            return inode;
+        }
+    }
+
+    /* Or was closed recently. */
+    for (e = list_begin(&closed_inodes); e != list_end(&closed_inodes);
+         e = list_next(e)) {
+        inode = list_entry(e, struct inode, elem);
+        if (inode->sector == sector) {
+            list_remove(&inode->elem);
+            closed_cnt--;
+            inode->open_cnt = 1;
+            list_push_front(&open_inodes, &inode->elem);
+            lock_release(&inodes_lock);
             return inode;
         }
     }
 
-    /* Allocate memory. */
+    /* Allocate memory, giving up the closed inodes if it is short. */
     inode = (struct inode *) malloc(sizeof(struct inode));
-    if (inode == NULL)
+    if (inode == NULL && shrink_closed(0))
+        inode = (struct inode *) malloc(sizeof(struct inode));
+    if (inode == NULL) {
+        lock_release(&inodes_lock);
         return NULL;
+    }
 
-    /* Initialize. */
+    /* Initialize, and publish the inode with its lock held, so that
+     * anyone else opening it waits for it to load rather than every
+     * open and close waiting for the disk. */
     list_push_front(&open_inodes, &inode->elem);
     inode->sector = sector;
     inode->open_cnt = 1;
     inode->deny_write_cnt = 0;
     inode->removed = false;
     lock_init(&inode->in_lock);
-    struct inode_disk *buf = malloc(sizeof(struct inode_disk));
-    cache_read(inode->sector, buf);
-    inode->is_dir = buf->is_dir;
-    inode->length = buf->length;
-    free(buf);
+    lock_init(&inode->dir_lock);
+    inode->dir_hint = 0;
+    acquire(inode);
+    lock_release(&inodes_lock);
+
+    cache_read_spec(inode->sector, &disk_inode, 0, sizeof disk_inode);
+    inode->is_dir = disk_inode.is_dir;
+    inode->compressed = disk_inode.compressed;
+    inode->length = disk_inode.length;
+    release(inode);
     return inode;
 }
 
 /*! Reopens and returns INODE. */
 struct inode * inode_reopen(struct inode *inode) {
     if (inode != NULL) {
-        acquire(inode);
+        lock_acquire(&inodes_lock);
         inode->open_cnt++;
-        release(inode);
+        lock_release(&inodes_lock);
     }
     return inode;
 }
@@ -247,36 +345,85 @@ block_sector_t inode_get_inumber(const struct inode *inode) {
 }
 
 /*! Closes INODE and writes it to disk.
-    If this was the last reference to INODE, frees its memory.
-    If INODE was also a removed inode, frees its blocks. */
+    If this was the last reference to INODE, keeps it among the recently
+    closed inodes, unless it was removed, in which case frees its memory
+    and its blocks.  The open count is protected by inodes_lock alone,
+    so closing never waits for I/O on INODE. */
 void inode_close(struct inode *inode) {
     /* Ignore null pointer. */
     if (inode == NULL)
         return;
-    acquire(inode);
+    lock_acquire(&inodes_lock);
     /* Release resources if this was the last opener. */
     if (--inode->open_cnt == 0) {
         /* Remove from inode list and release lock. */
         list_remove(&inode->elem);
+        if (!inode->removed) {
+            list_push_front(&closed_inodes, &inode->elem);
+            closed_cnt++;
+            shrink_closed(CLOSED_INODES_MAX);
+            lock_release(&inodes_lock);
+            return;
+        }
+        lock_release(&inodes_lock);
 
         /* Deallocate blocks if removed. */
         if (inode->removed) {
+            journal_begin();
             /*
             struct inode_disk buffer;
             struct inode_disk *disk_inode = &buffer;
-            cache_read(inode->sector, disk_inode);
+            cache_read_spec(inode->sector, disk_inode, 0, sizeof *disk_inode);
             unsigned i;
             for (i = 0; i < disk_inode->blocks_used; i++) {
                 pop_sector(inode);
             }
             */
+            /* Names cached under a directory must not outlive it, since
+             * its sector may be reused. */
+            if (inode->is_dir)
+                dcache_invalidate_dir(inode->sector);
             free_map_release(inode->sector, 1);
+            journal_end();
         }
-        release(inode);
         free(inode);
     } else {
-        release(inode);
+        lock_release(&inodes_lock);
+    }
+}
+
+/* Frees the least recently closed inodes until at most KEEP are left.
+ * Returns true if any were freed. */
+static bool shrink_closed(size_t keep) {
+    bool freed = false;
+
+    ASSERT(lock_held_by_current_thread(&inodes_lock));
+    while (closed_cnt > keep) {
+        struct list_elem *e = list_pop_back(&closed_inodes);
+        free(list_entry(e, struct inode, elem));
+        closed_cnt--;
+        freed = true;
+    }
+    return freed;
+}
+
+/* Frees the closed inode kept for SECTOR, if any, because SECTOR is
+ * about to hold a new inode. */
+static void forget_closed(block_sector_t sector) {
+    struct list_elem *e;
+
+    lock_acquire(&inodes_lock);
+    for (e = list_begin(&closed_inodes); e != list_end(&closed_inodes);
+         e = list_next(e)) {
+        struct inode *inode = list_entry(e, struct inode, elem);
+        if (inode->sector == sector) {
+            list_remove(e);
+            closed_cnt--;
+            free(inode);
+            break;
+        }
     }
+    lock_release(&inodes_lock);
 }
 
 /*! Marks INODE to be deleted when it is closed by the last caller who
@@ -303,11 +450,11 @@ off_t inode_read_at(struct inode *inode, void *buffer_, off_t size,
     while (size > 0) {
         /* Disk sector to read, starting byte offset within sector. */
         block_sector_t sector_idx = byte_to_sector(inode, offset);
-        int sector_ofs = offset % BLOCK_SECTOR_SIZE;
+        int sector_ofs = offset % fs_block_size;
 
         /* Bytes left in inode, bytes left in sector, lesser of the two. */
         off_t inode_left = inode_length(inode) - offset;
-        int sector_left = BLOCK_SECTOR_SIZE - sector_ofs;
+        int sector_left = fs_block_size - sector_ofs;
         int min_left = inode_left < sector_left ? inode_left : sector_left;
 
         /* Number of bytes to actually copy out of this sector. */
@@ -315,8 +462,12 @@ off_t inode_read_at(struct inode *inode, void *buffer_, off_t size,
         if (chunk_size <= 0)
             break;
 
-        cache_read_spec(sector_idx, buffer + bytes_read, sector_ofs,
-                chunk_size);
+        if (inode->compressed)
+            cache_read_group(group_of(sector_idx, offset / fs_block_size),
+                    sector_idx, buffer + bytes_read, sector_ofs, chunk_size);
+        else
+            cache_read_spec(sector_idx, buffer + bytes_read, sector_ofs,
+                    chunk_size);
 
         /* Advance. */
         size -= chunk_size;
@@ -334,23 +485,35 @@ off_t inode_write_at(struct inode *inode, const void *buffer_, off_t size,
         off_t offset) {
     const uint8_t *buffer = buffer_;
     off_t bytes_written = 0;
+    bool meta = is_metadata(inode);
+
+    /* Metadata is written as one journaled operation.  Ordinary files
+     * only journal growing, so that no operation is held open while
+     * copying from a buffer that may fault. */
+    if (meta) {
+        journal_begin();
+    } else {
+        grow(inode, offset + size, false);
+    }
     acquire(inode);
     if (inode->deny_write_cnt) {
         release(inode);
+        if (meta)
+            journal_end();
         return 0;
     }
     if (offset + size > inode->length) {
-        extend_to(inode, offset + size);
+        extend_to(inode, offset + size, false);
     }
 
     while (size > 0) {
         /* Sector to write, starting byte offset within sector. */
         block_sector_t sector_idx = byte_to_sector(inode, offset);
-        int sector_ofs = offset % BLOCK_SECTOR_SIZE;
+        int sector_ofs = offset % fs_block_size;
 
         /* Bytes left in inode, bytes left in sector, lesser of the two. */
         off_t inode_left = inode_length(inode) - offset;
-        int sector_left = BLOCK_SECTOR_SIZE - sector_ofs;
+        int sector_left = fs_block_size - sector_ofs;
         int min_left = inode_left < sector_left ? inode_left : sector_left;
 
         /* Number of bytes to actually write into this sector. */
@@ -359,8 +522,15 @@ off_t inode_write_at(struct inode *inode, const void *buffer_, off_t size,
             break;
 
         /* Write full sector directly to disk through the cache. */
-        cache_write_spec(sector_idx, buffer + bytes_written, sector_ofs,
-            chunk_size);
+        if (meta)
+            journal_write(sector_idx, buffer + bytes_written, sector_ofs,
+                chunk_size);
+        else if (inode->compressed)
+            cache_write_group(group_of(sector_idx, offset / fs_block_size),
+                sector_idx, buffer + bytes_written, sector_ofs, chunk_size);
+        else
+            cache_write_spec(sector_idx, buffer + bytes_written, sector_ofs,
+                chunk_size);
 
         /* Advance. */
         size -= chunk_size;
@@ -368,26 +538,219 @@ off_t inode_write_at(struct inode *inode, const void *buffer_, off_t size,
         bytes_written += chunk_size;
     }
     release(inode);
+    if (meta)
+        journal_end();
     return bytes_written;
 }
 
+/*! Reads SIZE bytes from INODE into BUFFER, starting at position OFFSET,
+    like inode_read_at(), but without going through the buffer cache for
+    whole blocks.  Those are read a run of contiguous blocks at a time
+    into a bounce page, after writing back any dirty cached copies.
+    Partial blocks are still read through the cache. */
+off_t inode_read_direct(struct inode *inode, void *buffer, off_t size,
+        off_t offset) {
+    return direct_io(inode, buffer, size, offset, false);
+}
+
+/*! Writes SIZE bytes from BUFFER into INODE, starting at OFFSET, like
+    inode_write_at(), but without going through the buffer cache for
+    whole blocks.  Cached copies of those blocks are dropped. */
+off_t inode_write_direct(struct inode *inode, const void *buffer,
+        off_t size, off_t offset) {
+    return direct_io(inode, (uint8_t *) buffer, size, offset, true);
+}
+
+/* Does the work of inode_read_direct() and inode_write_direct().
+ * Metadata, compressed files, and transfers too small to hold a whole
+ * block take the cached path. */
+static off_t direct_io(struct inode *inode, uint8_t *buffer, off_t size,
+        off_t offset, bool write) {
+    struct inode_disk disk_inode;
+    uint8_t *bounce = NULL;
+    off_t bytes_done = 0;
+
+    if (!is_metadata(inode) && !inode->compressed &&
+            size >= (off_t) fs_block_size)
+        bounce = palloc_get_page(0);
+    if (bounce == NULL) {
+        return write ? inode_write_at(inode, buffer, size, offset)
+                     : inode_read_at(inode, buffer, size, offset);
+    }
+
+    /* Grow the file first, as inode_write_at() does. */
+    if (write)
+        grow(inode, offset + size, false);
+
+    acquire(inode);
+    if (write && inode->deny_write_cnt) {
+        size = 0;
+    } else if (offset >= inode->length) {
+        size = 0;
+    } else if (size > inode->length - offset) {
+        size = inode->length - offset;
+    }
+    cache_read_spec(inode->sector, &disk_inode, 0, sizeof disk_inode);
+    while (size > 0) {
+        unsigned vblock = offset / fs_block_size;
+        off_t block_ofs = offset % fs_block_size;
+        block_sector_t first = block_at(&disk_inode, vblock);
+        off_t chunk_size;
+
+        if (block_ofs != 0 || size < (off_t) fs_block_size) {
+            /* Partial block, through the cache. */
+            chunk_size = fs_block_size - block_ofs;
+            if (chunk_size > size)
+                chunk_size = size;
+            if (write)
+                cache_write_spec(first, buffer + bytes_done, block_ofs,
+                    chunk_size);
+            else
+                cache_read_spec(first, buffer + bytes_done, block_ofs,
+                    chunk_size);
+        } else {
+            /* Whole blocks, as long a run as is contiguous on disk. */
+            size_t max = size / fs_block_size;
+            size_t cnt = 1;
+            size_t i;
+            if (max > DIRECT_RUN_BLOCKS)
+                max = DIRECT_RUN_BLOCKS;
+            while (cnt < max && block_at(&disk_inode, vblock + cnt) ==
+                    first + cnt)
+                cnt++;
+            enum block_cause old_cause;
+            chunk_size = cnt * fs_block_size;
+            if (write) {
+                memcpy(bounce, buffer + bytes_done, chunk_size);
+                for (i = 0; i < cnt; i++)
+                    cache_discard(first + i);
+                old_cause = block_set_cause(BLOCK_CAUSE_DIRECT);
+                fs_block_write_multi(first, cnt, bounce);
+            } else {
+                for (i = 0; i < cnt; i++)
+                    cache_sync(first + i);
+                old_cause = block_set_cause(BLOCK_CAUSE_DIRECT);
+                fs_block_read_multi(first, cnt, bounce);
+                memcpy(buffer + bytes_done, bounce, chunk_size);
+            }
+            block_set_cause(old_cause);
+        }
+
+        /* Advance. */
+        size -= chunk_size;
+        offset += chunk_size;
+        bytes_done += chunk_size;
+    }
+    release(inode);
+    palloc_free_page(bounce);
+    return bytes_done;
+}
+
+/*! Copies SIZE bytes from SRC, starting at SRC_OFS, into DST, starting
+    at DST_OFS, without passing through user memory.  The data moves a
+    page at a time through a kernel bounce page, read from the source's
+    cached blocks and written into the destination's, and DST is grown
+    to its final length up front.  Returns the number of bytes copied,
+    which is less than SIZE if the end of SRC is reached and 0 if
+    SRC_OFS is already there.  Returns -1 if the two ranges overlap
+    within the same file, or if nothing could be copied because memory
+    ran out, DST could not be grown or DST denies writes. */
+off_t inode_copy_range(struct inode *dst, off_t dst_ofs, struct inode *src,
+        off_t src_ofs, off_t size) {
+    off_t src_length = inode_length(src);
+    off_t bytes_copied = 0;
+    bool failed = false;
+    uint8_t *bounce;
+
+    if (src_ofs >= src_length)
+        return 0;
+    if (size > src_length - src_ofs)
+        size = src_length - src_ofs;
+    if (dst == src && src_ofs < dst_ofs + size && dst_ofs < src_ofs + size)
+        return -1;
+    if (size == 0)
+        return 0;
+
+    bounce = palloc_get_page(0);
+    if (bounce == NULL)
+        return -1;
+    if (!grow(dst, dst_ofs + size, false)) {
+        palloc_free_page(bounce);
+        return -1;
+    }
+    while (size > 0) {
+        off_t chunk_size = size < PGSIZE ? size : PGSIZE;
+        off_t chunk_read = inode_read_at(src, bounce, chunk_size,
+                src_ofs + bytes_copied);
+        off_t chunk_written = inode_write_at(dst, bounce, chunk_read,
+                dst_ofs + bytes_copied);
+
+        bytes_copied += chunk_written;
+        if (chunk_written < chunk_read) {
+            failed = bytes_copied == 0;
+            break;
+        }
+        if (chunk_read < chunk_size)
+            break;
+        size -= chunk_size;
+    }
+    palloc_free_page(bounce);
+    return failed ? -1 : bytes_copied;
+}
+
+/*! Extends INODE, which must not be metadata, to LENGTH bytes by
+    appending zeros.  Returns false if the disk is full or writes to
+    INODE are denied, leaving it as long as it got. */
+bool inode_grow(struct inode *inode, off_t length) {
+    ASSERT(!is_metadata(inode));
+    return grow(inode, length, true);
+}
+
+/* Extends INODE to LENGTH bytes, unless it is already that long, filling
+ * the new blocks with zeros if ZERO is true.  Each GROW_STEP_BLOCKS
+ * blocks are added in a journaled operation of their own.  Returns false
+ * if the disk is full or writes to INODE are denied. */
+static bool grow(struct inode *inode, off_t length, bool zero) {
+    bool success = true;
+
+    while (success && length > inode_length(inode)) {
+        off_t step = (bytes_to_sectors(inode_length(inode)) +
+                GROW_STEP_BLOCKS) * fs_block_size;
+        journal_begin();
+        acquire(inode);
+        if (inode->deny_write_cnt)
+            success = false;
+        else if (length > inode->length)
+            success = extend_to(inode, length < step ? length : step, zero);
+        release(inode);
+        journal_end();
+    }
+    return success;
+}
+
 /* Extends the number of blocks used by the file to contain the offset
- * provided.
+ * provided, filling the new blocks with zeros if ZERO is true.  Returns
+ * false, leaving the length as it was, if the disk is full.
  */
-void extend_to(struct inode *inode, off_t offset) {
+static bool extend_to(struct inode *inode, off_t offset, bool zero) {
     struct inode_disk buffer;
     struct inode_disk *disk_inode = &buffer;
-    cache_read(inode->sector, disk_inode);
+    cache_read_spec(inode->sector, disk_inode, 0, sizeof *disk_inode);
     int num_blocks = bytes_to_sectors(offset) - disk_inode->blocks_used;
+    bool success = true;
 
-    while (num_blocks > 0) {
+    while (success && num_blocks > 0) {
         block_sector_t block;
-        append_sector(disk_inode, &block);
+        success = zero ? append_zeros(disk_inode) :
+            append_sector(disk_inode, &block);
         num_blocks--;
     }
-    disk_inode->length = offset;
-    inode->length = offset;
-    cache_write(inode->sector, disk_inode);
+    if (success) {
+        disk_inode->length = offset;
+        inode->length = offset;
+    }
+    journal_write(inode->sector, disk_inode, 0, sizeof *disk_inode);
+    return success;
 }
 /*! Disables writes to INODE.
     May be called at most once per inode opener. */
@@ -444,7 +807,7 @@ static bool append_sector(struct inode_disk *disk_inode,
     if (b <= N_BLOCKS - 4) {
         // Direct addressing.
         disk_inode->i_block[b] = *result;
-    } else if (b <= BLOCK_SECTOR_SIZE / 4 + (N_BLOCKS - 4)) {
+    } else if (b <= PTRS_PER_BLOCK + (N_BLOCKS - 4)) {
         // 1-indirect addressing.
         block_sector_t indirect_block;
         // Index of our pointer within the indirect block.
@@ -460,19 +823,19 @@ static bool append_sector(struct inode_disk *disk_inode,
         }
         // Write the location of the newly allocated block to the
         // indirect block.
-        cache_write_spec(indirect_block, result,
+        journal_write(indirect_block, result,
                 index1 * sizeof(block_sector_t), sizeof(block_sector_t));
-    } else if (b <= (BLOCK_SECTOR_SIZE / 4) * (BLOCK_SECTOR_SIZE / 4) +
-            BLOCK_SECTOR_SIZE / 4 + (N_BLOCKS - 4)) {
+    } else if (b <= PTRS_PER_BLOCK * PTRS_PER_BLOCK +
+            PTRS_PER_BLOCK + (N_BLOCKS - 4)) {
         // 2-indirect addressing.
         block_sector_t indirect2; // Contains pointers to indirect1 blocks.
         block_sector_t indirect1; // Contains pointers to data blocks.
         // Index of our desired pointers within the indirect2 and indirect1
         // blocks, respectively.
-        off_t index2 = (b - BLOCK_SECTOR_SIZE / 4 - (N_BLOCKS - 3)) /
-            (BLOCK_SECTOR_SIZE / 4);
-        off_t index1 = (b - BLOCK_SECTOR_SIZE / 4 - (N_BLOCKS - 3)) %
-            (BLOCK_SECTOR_SIZE / 4);
+        off_t index2 = (b - PTRS_PER_BLOCK - (N_BLOCKS - 3)) /
+            PTRS_PER_BLOCK;
+        off_t index1 = (b - PTRS_PER_BLOCK - (N_BLOCKS - 3)) %
+            PTRS_PER_BLOCK;
         if (index1 == 0 && index2 == 0) {
             // We need to create the indirect2 block.
             if (!free_map_allocate(1, &indirect2)) {
@@ -487,7 +850,7 @@ static bool append_sector(struct inode_disk *disk_inode,
             if (!free_map_allocate(1, &indirect1)) {
                 return false;
             }
-            cache_write_spec(indirect2, &indirect1,
+            journal_write(indirect2, &indirect1,
                     index2 * sizeof(block_sector_t), sizeof(block_sector_t));
         } else {
             // Read the location of the indirect1 block from the indirect2
@@ -497,7 +860,7 @@ static bool append_sector(struct inode_disk *disk_inode,
         }
         // Write the location of the newly allocated block to the
         // indirect block.
-        cache_write_spec(indirect1, result,
+        journal_write(indirect1, result,
                 index1 * sizeof(block_sector_t), sizeof(block_sector_t));
     } else {
         PANIC("3-Indirect accessing not implemented!\n");
@@ -505,60 +868,97 @@ static bool append_sector(struct inode_disk *disk_inode,
     return true;
 }
 
+/* Appends a block of zeros to an inode that is not metadata.  Returns
+ * true if successful. */
+static bool append_zeros(struct inode_disk *disk_inode) {
+    unsigned vblock = disk_inode->blocks_used;
+    block_sector_t block;
+
+    if (!append_sector(disk_inode, &block))
+        return false;
+    if (disk_inode->compressed)
+        cache_write_group(group_of(block, vblock), block, zeros, 0,
+                fs_block_size);
+    else
+        cache_write(block, zeros);
+    return true;
+}
+
 /* Frees the last sector of a file. We deallocate blocks as groups, so this
- * doesn't actually free any blocks until the entire group is free.
- * Returns true if successful.
+ * doesn't actually free any data blocks until the entire group is free.
+ * Index blocks are freed as soon as they map nothing.  The caller writes
+ * DISK_INODE back.
  */
-static bool pop_sector(struct inode *inode) {
-    ASSERT(inode);
-    // Get the address of the last block that was allocated.
-    struct inode_disk buffer;
-    struct inode_disk *disk_inode = &buffer;
-    cache_read(inode->sector, disk_inode);
+static void pop_sector(struct inode_disk *disk_inode) {
+    ASSERT(disk_inode);
     if (disk_inode->blocks_used == 0) {
         PANIC("File is already empty!\n");
     }
-    block_sector_t last_block = byte_to_sector(inode, inode->length - 1);
-    // Mark this block as free.
+    // Block offset within file of the block being removed.
+    unsigned b = disk_inode->blocks_used - 1;
+    block_sector_t last_block = block_at(disk_inode, b);
+    // Return the block to its group.  Blocks of a group are handed out
+    // in order, so the group is entirely free once its first block is.
+    disk_inode->blocks_used--;
     disk_inode->next_block = last_block;
     disk_inode->group_blocks_free++;
-    disk_inode->blocks_used--;
-    // If we reached a group size free, then actually free it.
     if (disk_inode->group_blocks_free == BLOCKS_PER_GROUP) {
-        // Free the group.
+        // A compressed group must not be written back, or found staged,
+        // once its blocks belong to someone else.
+        if (disk_inode->compressed) {
+            unsigned i;
+            for (i = 0; i < BLOCKS_PER_GROUP; i++)
+                cache_discard(last_block + i);
+            compress_forget(last_block);
+        }
         free_map_release(last_block, BLOCKS_PER_GROUP);
         disk_inode->next_block = 0;
         disk_inode->group_blocks_free = 0;
-        // If there were indirect blocks associated with this block, then
-        // we should free them as well if necessary.
-        unsigned b = disk_inode->blocks_used + 1;
-        if (b == N_BLOCKS - 3) {
-            // Nothing left in the singly indirect block.
-            free_map_release(disk_inode->i_block[N_BLOCKS - 3], 1);
-        } else if (b >= BLOCK_SECTOR_SIZE / 4 + (N_BLOCKS - 3)) {
-            off_t index2 = (b - BLOCK_SECTOR_SIZE / 4 - (N_BLOCKS - 3)) /
-                (BLOCK_SECTOR_SIZE / 4);
-            off_t index1 = (b - BLOCK_SECTOR_SIZE / 4 - (N_BLOCKS - 3)) %
-                (BLOCK_SECTOR_SIZE / 4);
-            block_sector_t indirect1;
-            block_sector_t indirect2 = disk_inode->i_block[N_BLOCKS - 2];
-            if (index1 == 0) {
-                cache_read_spec(indirect2, &indirect1,
-                        index2 * sizeof(block_sector_t),
-                        sizeof(block_sector_t));
-                free_map_release(indirect1, 1);
-                if (index2 == 0) {
-                    free_map_release(indirect2, 1);
-                }
+    }
+    if (b == N_BLOCKS - 3) {
+        // Nothing left in the singly indirect block.
+        free_map_release(disk_inode->i_block[N_BLOCKS - 3], 1);
+    } else if (b >= PTRS_PER_BLOCK + (N_BLOCKS - 3)) {
+        off_t index2 = (b - PTRS_PER_BLOCK - (N_BLOCKS - 3)) /
+            PTRS_PER_BLOCK;
+        off_t index1 = (b - PTRS_PER_BLOCK - (N_BLOCKS - 3)) %
+            PTRS_PER_BLOCK;
+        block_sector_t indirect1;
+        block_sector_t indirect2 = disk_inode->i_block[N_BLOCKS - 2];
+        if (index1 == 0) {
+            // Nothing left in this indirect1 block.
+            cache_read_spec(indirect2, &indirect1,
+                    index2 * sizeof(block_sector_t),
+                    sizeof(block_sector_t));
+            free_map_release(indirect1, 1);
+            if (index2 == 0) {
+                free_map_release(indirect2, 1);
             }
         }
     }
-    // Write back to disk.
-    cache_write(inode->sector, disk_inode);
-    return true;
 }
 
+/* Shrinks INODE to LENGTH bytes, freeing the blocks past the new end.
+ * Does nothing if INODE is no longer than LENGTH. */
+void inode_truncate(struct inode *inode, off_t length) {
+    struct inode_disk buffer;
+    struct inode_disk *disk_inode = &buffer;
 
+    ASSERT(length >= 0);
+    journal_begin();
+    acquire(inode);
+    if (length < inode->length) {
+        cache_read_spec(inode->sector, disk_inode, 0, sizeof *disk_inode);
+        while (disk_inode->blocks_used > bytes_to_sectors(length)) {
+            pop_sector(disk_inode);
+        }
+        disk_inode->length = length;
+        inode->length = length;
+        journal_write(inode->sector, disk_inode, 0, sizeof *disk_inode);
+    }
+    release(inode);
+    journal_end();
+}
 
 void acquire(struct inode *inode) {
     lock_acquire(&inode->in_lock);
@@ -568,6 +968,78 @@ void release(struct inode *inode) {
     lock_release(&inode->in_lock);
 }
 
+/* Returns true if the contents of INODE are file system metadata, which
+ * is journaled: directories and the free map. */
+bool is_metadata(const struct inode *inode) {
+    return inode->is_dir || inode->sector == FREE_MAP_SECTOR;
+}
+
 bool inode_is_dir(const struct inode *inode) {
     return inode && inode->is_dir;
 }
+
+/* Returns true if INODE's data is stored in compressed groups. */
+bool inode_is_compressed(const struct inode *inode) {
+    return inode && inode->compressed;
+}
+
+/* Stores INODE's data in compressed groups from now on.  Groups already
+ * on disk are compressed the next time they are written back.  Returns
+ * false if INODE is metadata, which is never compressed. */
+bool inode_set_compressed(struct inode *inode) {
+    struct inode_disk buffer;
+    struct inode_disk *disk_inode = &buffer;
+
+    if (is_metadata(inode))
+        return false;
+    journal_begin();
+    acquire(inode);
+    if (!inode->compressed) {
+        /* Dirty blocks cached before now would be written back alone,
+         * behind the back of any staged copy of their group. */
+        cache_flush();
+        cache_read_spec(inode->sector, disk_inode, 0, sizeof *disk_inode);
+        disk_inode->compressed = true;
+        inode->compressed = true;
+        journal_write(inode->sector, disk_inode, 0, sizeof *disk_inode);
+    }
+    release(inode);
+    journal_end();
+    return true;
+}
+
+/* Returns true if the inode stored at SECTOR is a directory.  Reads
+ * only that field through the buffer cache, without opening the inode,
+ * so that directory listings can report entry types cheaply. */
+bool inode_sector_is_dir(block_sector_t sector) {
+    bool is_dir = false;
+    cache_read_spec(sector, &is_dir, offsetof(struct inode_disk, is_dir),
+            sizeof is_dir);
+    return is_dir;
+}
+
+/* Acquires the directory lock of INODE.  Directory operations hold it
+ * across the several reads and writes that make up one update, which
+ * in_lock alone, taken per inode_read_at() call, cannot protect. */
+void inode_lock_dir(struct inode *inode) {
+    lock_acquire(&inode->dir_lock);
+}
+
+/* Releases the directory lock of INODE. */
+void inode_unlock_dir(struct inode *inode) {
+    lock_release(&inode->dir_lock);
+}
+
+/* Returns the offset in directory INODE before which no entry is free.
+ * Kept in memory only, so it starts at 0 each time INODE is read from
+ * disk; a directory cannot change while it is closed, so the hint of a
+ * recently closed inode stays good when it is opened again.
+ * The caller must hold the directory lock. */
+off_t inode_dir_hint(const struct inode *inode) {
+    return inode->dir_hint;
+}
+
+/* Sets INODE's free directory entry hint to OFS. */
+void inode_set_dir_hint(struct inode *inode, off_t ofs) {
+    inode->dir_hint = ofs;
+}
@@ -22,10 +22,26 @@ void inode_close(struct inode *);
 void inode_remove(struct inode *);
 off_t inode_read_at(struct inode *, void *, off_t size, off_t offset);
 off_t inode_write_at(struct inode *, const void *, off_t size, off_t offset);
+off_t inode_read_direct(struct inode *, void *, off_t size, off_t offset);
+off_t inode_write_direct(struct inode *, const void *, off_t size,
+        off_t offset);
+off_t inode_copy_range(struct inode *dst, off_t dst_ofs, struct inode *src,
+        off_t src_ofs, off_t size);
 void inode_deny_write(struct inode *);
 void inode_allow_write(struct inode *);
 off_t inode_length(const struct inode *);
+bool inode_grow(struct inode *, off_t length);
+void inode_truncate(struct inode *, off_t length);
 
 bool inode_is_removed(const struct inode *);
 bool inode_is_dir(const struct inode *);
+bool inode_sector_is_dir(block_sector_t);
+bool inode_is_compressed(const struct inode *);
+bool inode_set_compressed(struct inode *);
+
+/* Serializes updates to the directory stored in an inode. */
+void inode_lock_dir(struct inode *);
+void inode_unlock_dir(struct inode *);
+off_t inode_dir_hint(const struct inode *);
+void inode_set_dir_hint(struct inode *, off_t);
 #endif /* filesys/inode.h */
@@ -0,0 +1,636 @@
+/*
+ * Write-ahead metadata journal.
+ *
+ * Sectors holding metadata (inodes, index blocks, directory contents and
+ * the free map) are not written in place as they change.  Instead, every
+ * metadata write made by an operation joins the running transaction and
+ * pins its cache slot, so the cache will not write it home yet.  A
+ * commit writes the images of all sectors in the running transaction to
+ * a contiguous log, as one descriptor sector naming their home sectors
+ * followed by the images themselves, in a single sequential write, and
+ * then a commit sector carrying a checksum, and then unpins them.  Operations that run concurrently share a
+ * transaction, so one sequential log write covers all of them.
+ *
+ * An operation brackets its updates with journal_begin() and
+ * journal_end(), which nest.  A commit waits until no operation is in
+ * progress and holds off new ones until it has written the log, so a
+ * transaction never contains half an operation.  Commits are made by a
+ * background thread, every JOURNAL_INTERVAL ticks and as soon as the
+ * running transaction grows past JOURNAL_TXN_SOFT sectors, which the
+ * next operation to begin tells it.
+ *
+ * A transaction can never log more than JOURNAL_TXN_MAX sectors, so
+ * each operation reserves room for JOURNAL_OP_SECTORS of them when it
+ * begins, and is held off until the running transaction has that much
+ * room left over after the reservations of the operations already in
+ * it.  That is the only time an operation waits for the journal.  An operation that may log more, such as a directory table split,
+ * asks for the extra room up front with journal_extend() and does
+ * without the step if it cannot have it.  Nothing is ever written
+ * unlogged: logging past the reservation, which would be a bug, panics.
+ *
+ * Checkpointing writes every dirty cache slot home and then empties the
+ * log by advancing the sequence number recorded in the journal's
+ * superblock.  The background thread checkpoints instead of just
+ * committing once the log is half full, or could not take two more full
+ * transactions, so that the last commit before a checkpoint always
+ * fits.  Most of the writing is done while operations carry on; they
+ * are held off only to commit the running transaction, write home what
+ * changed meanwhile and update the superblock.  The log never wraps: it
+ * always runs from its first sector, transaction after transaction,
+ * with consecutive sequence numbers starting from the superblock's.
+ *
+ * At mount, journal_open() replays the log: every transaction with a
+ * valid descriptor, commit sector and checksum is copied to its home
+ * sectors, stopping at the first that is not.  A sector that is freed
+ * after being logged is revoked, so that replay does not overwrite
+ * whatever it is reused for.
+ */
+
+#include "filesys/journal.h"
+#include <bitmap.h>
+#include <debug.h>
+#include <hash.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "filesys/cache.h"
+#include "filesys/filesys.h"
+#include "filesys/free-map.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+/* Identify the journal superblock and the sectors of a transaction. */
+#define JOURNAL_MAGIC 0x4a524e4c
+#define JOURNAL_DESC_MAGIC 0x4a444553
+#define JOURNAL_COMMIT_MAGIC 0x4a434d54
+
+/* The log takes one block in JOURNAL_DIVISOR of the file system, within
+ * 64 kB and 512 kB worth of blocks, but always has room for a full
+ * transaction. */
+#define JOURNAL_DIVISOR 16
+#define JOURNAL_MIN_BLOCKS (64 * 1024 / fs_block_size)
+#define JOURNAL_MAX_BLOCKS (512 * 1024 / fs_block_size)
+
+/* Sector numbers that fit in a descriptor. */
+#define JOURNAL_DESC_CAP ((BLOCK_SECTOR_SIZE - 16) / sizeof(block_sector_t))
+
+/* Sectors a transaction may log, and the size past which it is
+ * committed before another operation joins it.  Logged sectors stay
+ * pinned in the cache, so the limit must leave it room to work. */
+#define JOURNAL_TXN_MAX 48
+#define JOURNAL_TXN_SOFT 24
+
+/* Sectors an operation may log without calling journal_extend(). */
+#define JOURNAL_OP_SECTORS 16
+
+/* Sectors a transaction may revoke. */
+#define JOURNAL_REVOKE_MAX (JOURNAL_DESC_CAP - JOURNAL_TXN_MAX)
+
+/* Ticks between background commits. */
+#define JOURNAL_INTERVAL TIMER_FREQ
+
+/* Log blocks a commit may take: descriptor, images and commit block. */
+#define JOURNAL_TXN_BLOCKS (JOURNAL_TXN_MAX + 2)
+
+/*! Journal superblock, in sector JOURNAL_SECTOR. */
+struct journal_super {
+    unsigned magic;                     /*!< JOURNAL_MAGIC. */
+    block_sector_t start;               /*!< First sector of the log. */
+    uint32_t size;                      /*!< Blocks in the log. */
+    uint32_t seq;                       /*!< Sequence number of the
+                                             transaction at the start. */
+    char unused[BLOCK_SECTOR_SIZE - 16];
+};
+
+/*! First sector of a transaction in the log. */
+struct journal_desc {
+    unsigned magic;                     /*!< JOURNAL_DESC_MAGIC. */
+    uint32_t seq;                       /*!< Sequence number. */
+    uint32_t cnt;                       /*!< Sectors logged. */
+    uint32_t revoke_cnt;                /*!< Sectors revoked. */
+    block_sector_t sectors[JOURNAL_DESC_CAP]; /*!< Home sectors of the
+                                             logged images, then the
+                                             revoked sectors. */
+};
+
+/*! Last sector of a transaction in the log. */
+struct journal_commit {
+    unsigned magic;                     /*!< JOURNAL_COMMIT_MAGIC. */
+    uint32_t seq;                       /*!< Sequence number. */
+    uint32_t cnt;                       /*!< Sectors logged. */
+    unsigned checksum;                  /*!< Checksum of the images. */
+    char unused[BLOCK_SECTOR_SIZE - 16];
+};
+
+/* An in-memory transaction. */
+struct txn {
+    block_sector_t logged[JOURNAL_TXN_MAX];
+    size_t log_cnt;
+    block_sector_t revoked[JOURNAL_REVOKE_MAX];
+    size_t revoke_cnt;
+};
+
+/* A revocation found during replay. */
+struct revocation {
+    block_sector_t sector;
+    uint32_t seq;
+};
+
+static bool enabled;                    /* Journal found and open? */
+static struct journal_super super;      /* Copy of the superblock. */
+static uint32_t head;                   /* Next free sector of the log. */
+static uint32_t next_seq;               /* Sequence of the next commit. */
+
+static struct lock journal_lock;        /* Protects the state below. */
+static struct condition idle_cond;      /* Signaled when ACTIVE drops
+                                           to 0. */
+static struct condition commit_cond;    /* Signaled when a commit ends. */
+static int active;                      /* Operations in progress. */
+static size_t reserved;                 /* Sectors that operations in
+                                           progress may still log. */
+static bool committing;                 /* Commit in progress? */
+static bool want_checkpoint;            /* Checkpoint after next commit? */
+static bool kicked;                     /* Background thread asked to
+                                           commit? */
+static struct txn running;              /* Transaction being built. */
+static struct bitmap *logged;           /* Sectors logged since the last
+                                           checkpoint. */
+
+/* Wakes the background thread. */
+static struct semaphore daemon_sema;
+
+/* Buffers used by the committing thread and during replay. */
+static struct journal_desc *desc_buf;
+static void *data_buf;
+static uint8_t *log_buf;                /* Descriptor and images of a
+                                           transaction being written. */
+
+static void alloc_buffers(void);
+static void read_super(void);
+static void write_super(void);
+static void commit(bool checkpoint);
+static void write_txn(const struct txn *);
+static void checkpoint_log(void);
+static bool checkpoint_due(void);
+static void kick(void);
+static void replay(void);
+static void journal_daemon(void *aux);
+static void journal_ticker(void *aux);
+
+/*! Creates an empty journal while formatting the file system. */
+void journal_create(void) {
+    enum block_cause old_cause;
+
+    alloc_buffers();
+    memset(&super, 0, sizeof super);
+    super.magic = JOURNAL_MAGIC;
+    super.size = fs_block_cnt() / JOURNAL_DIVISOR;
+    if (super.size < JOURNAL_MIN_BLOCKS)
+        super.size = JOURNAL_MIN_BLOCKS;
+    if (super.size > JOURNAL_MAX_BLOCKS)
+        super.size = JOURNAL_MAX_BLOCKS;
+    if (super.size < JOURNAL_TXN_BLOCKS)
+        super.size = JOURNAL_TXN_BLOCKS;
+    super.seq = 1;
+    if (!free_map_allocate(super.size, &super.start))
+        PANIC("journal creation failed");
+
+    /* Make sure nothing left on the disk reads as a transaction. */
+    memset(data_buf, 0, fs_block_size);
+    old_cause = block_set_cause(BLOCK_CAUSE_JOURNAL);
+    fs_block_write(super.start, data_buf);
+    block_set_cause(old_cause);
+    write_super();
+}
+
+/*! Opens the journal, replaying any transactions committed but not
+    checkpointed before the file system was last shut down.  Must run
+    before anything reads metadata through the cache.  File systems
+    without a journal are left unjournaled. */
+void journal_open(void) {
+    ASSERT(sizeof(struct journal_super) == BLOCK_SECTOR_SIZE);
+    ASSERT(sizeof(struct journal_desc) == BLOCK_SECTOR_SIZE);
+    ASSERT(sizeof(struct journal_commit) == BLOCK_SECTOR_SIZE);
+
+    alloc_buffers();
+    read_super();
+    if (super.magic != JOURNAL_MAGIC)
+        return;
+
+    lock_init(&journal_lock);
+    cond_init(&idle_cond);
+    cond_init(&commit_cond);
+    sema_init(&daemon_sema, 0);
+    logged = bitmap_create(fs_block_cnt());
+    if (logged == NULL)
+        PANIC("journal: out of memory");
+
+    replay();
+    enabled = true;
+    thread_create("journal", PRI_DEFAULT, journal_daemon, NULL);
+    thread_create("journal-tick", PRI_DEFAULT, journal_ticker, NULL);
+}
+
+/*! Commits and checkpoints everything, leaving an empty log.  If an
+    operation is still in progress, as when panicking, leaves the log
+    to be replayed instead. */
+void journal_close(void) {
+    bool busy;
+
+    if (!enabled)
+        return;
+    lock_acquire(&journal_lock);
+    busy = active > 0;
+    lock_release(&journal_lock);
+    if (!busy)
+        commit(true);
+    enabled = false;
+}
+
+/*! Starts an operation whose metadata updates must reach the disk
+    together, reserving room for JOURNAL_OP_SECTORS of them in the
+    running transaction.  Waits if a commit is copying the running
+    transaction, or if it lacks the room, until the background thread
+    has committed it; one that has only grown large is handed to that
+    thread without waiting.  Calls nest; only the outermost pair counts, so the caller
+    must not hold locks that an operation in progress may wait for. */
+void journal_begin(void) {
+    struct thread *t = thread_current();
+
+    if (!enabled || t->journal_depth++ > 0)
+        return;
+    lock_acquire(&journal_lock);
+    while (committing || running.log_cnt + reserved + JOURNAL_OP_SECTORS >
+               JOURNAL_TXN_MAX) {
+        if (!committing)
+            kick();
+        cond_wait(&commit_cond, &journal_lock);
+    }
+    if (running.log_cnt >= JOURNAL_TXN_SOFT)
+        kick();
+    active++;
+    t->journal_credits = JOURNAL_OP_SECTORS;
+    reserved += t->journal_credits;
+    lock_release(&journal_lock);
+}
+
+/*! Ends an operation started by journal_begin(). */
+void journal_end(void) {
+    struct thread *t = thread_current();
+
+    if (!enabled)
+        return;
+    ASSERT(t->journal_depth > 0);
+    if (--t->journal_depth > 0)
+        return;
+    lock_acquire(&journal_lock);
+    reserved -= t->journal_credits;
+    t->journal_credits = 0;
+    if (--active == 0)
+        cond_broadcast(&idle_cond, &journal_lock);
+    lock_release(&journal_lock);
+}
+
+/*! Makes sure that the operation in progress may log CNT more sectors,
+    taking room the running transaction has left over if its own
+    reservation is short.  Never waits, since the caller may hold locks
+    that other operations need to finish.  Returns false, leaving the
+    reservation as it was, if the room is not there; the caller should
+    then give up the step it was about to take. */
+bool journal_extend(size_t cnt) {
+    struct thread *t = thread_current();
+    size_t need;
+    bool success;
+
+    if (!enabled)
+        return true;
+    ASSERT(t->journal_depth > 0);
+    lock_acquire(&journal_lock);
+    need = cnt > t->journal_credits ? cnt - t->journal_credits : 0;
+    success = running.log_cnt + reserved + need <= JOURNAL_TXN_MAX;
+    if (success) {
+        t->journal_credits += need;
+        reserved += need;
+    }
+    lock_release(&journal_lock);
+    return success;
+}
+
+/*! Writes SIZE bytes from SOURCE at offset START of metadata sector
+    SECT through the cache, adding the sector to the running
+    transaction, against the reservation of the operation in progress.
+    The sector is not written home until that transaction commits. */
+void journal_write(block_sector_t sect, const void *source, off_t start,
+        off_t size) {
+    struct thread *t = thread_current();
+    size_t i;
+
+    if (!enabled) {
+        cache_write_spec(sect, source, start, size);
+        return;
+    }
+
+    journal_begin();
+    lock_acquire(&journal_lock);
+    for (i = 0; i < running.log_cnt; i++) {
+        if (running.logged[i] == sect)
+            break;
+    }
+    if (i == running.log_cnt) {
+        if (t->journal_credits > 0) {
+            t->journal_credits--;
+            reserved--;
+        } else if (running.log_cnt + reserved >= JOURNAL_TXN_MAX) {
+            PANIC("journal: operation logged more than it reserved");
+        }
+        running.logged[running.log_cnt++] = sect;
+    }
+    cache_write_pinned(sect, source, start, size);
+    lock_release(&journal_lock);
+    journal_end();
+}
+
+/*! Notes that the CNT sectors starting at SECT have been freed, so
+    that replay will not write images logged for them earlier over
+    whatever the sectors hold next.  Sectors logged by the running
+    transaction are dropped from it, and their pinned cache slots with
+    them, so that a freed sector is never pinned when it is reused. */
+void journal_revoke(block_sector_t sect, size_t cnt) {
+    size_t i, j;
+
+    if (!enabled)
+        return;
+    lock_acquire(&journal_lock);
+    for (i = 0; i < cnt; i++) {
+        for (j = 0; j < running.log_cnt; j++) {
+            if (running.logged[j] == sect + i) {
+                running.logged[j] = running.logged[--running.log_cnt];
+                cache_discard(sect + i);
+                break;
+            }
+        }
+        if (!bitmap_test(logged, sect + i))
+            continue;
+        if (running.revoke_cnt < JOURNAL_REVOKE_MAX)
+            running.revoked[running.revoke_cnt++] = sect + i;
+        else {
+            want_checkpoint = true;
+            kick();
+        }
+    }
+    lock_release(&journal_lock);
+}
+
+/* Allocates the block buffers used to build and read back the log. */
+static void alloc_buffers(void) {
+    if (desc_buf != NULL)
+        return;
+    desc_buf = malloc(fs_block_size);
+    data_buf = malloc(fs_block_size);
+    log_buf = malloc((JOURNAL_TXN_MAX + 1) * fs_block_size);
+    if (desc_buf == NULL || data_buf == NULL || log_buf == NULL)
+        PANIC("journal: out of memory");
+}
+
+/* Reads the superblock into SUPER. */
+static void read_super(void) {
+    enum block_cause old_cause = block_set_cause(BLOCK_CAUSE_JOURNAL);
+    fs_block_read(JOURNAL_SECTOR, desc_buf);
+    memcpy(&super, desc_buf, sizeof super);
+    block_set_cause(old_cause);
+}
+
+/* Writes SUPER to the superblock. */
+static void write_super(void) {
+    enum block_cause old_cause = block_set_cause(BLOCK_CAUSE_JOURNAL);
+    memset(desc_buf, 0, fs_block_size);
+    memcpy(desc_buf, &super, sizeof super);
+    fs_block_write(JOURNAL_SECTOR, desc_buf);
+    block_set_cause(old_cause);
+}
+
+/* Commits the running transaction, then checkpoints if CHECKPOINT is
+ * true or the log could not take another full transaction.  Operations
+ * are held off throughout, so a checkpoint should be preceded by a
+ * cache_flush() made while they run, leaving little to write here. */
+static void commit(bool checkpoint) {
+    static struct txn txn;      /* Owned by the committing thread. */
+    size_t i;
+
+    lock_acquire(&journal_lock);
+    while (committing)
+        cond_wait(&commit_cond, &journal_lock);
+    committing = true;
+    while (active > 0)
+        cond_wait(&idle_cond, &journal_lock);
+    txn = running;
+    running.log_cnt = running.revoke_cnt = 0;
+    checkpoint = checkpoint || want_checkpoint;
+    want_checkpoint = false;
+    lock_release(&journal_lock);
+
+    if (txn.log_cnt > 0 || txn.revoke_cnt > 0) {
+        write_txn(&txn);
+        for (i = 0; i < txn.log_cnt; i++) {
+            bitmap_mark(logged, txn.logged[i]);
+            cache_unpin(txn.logged[i]);
+        }
+    }
+    if (checkpoint || super.size - head < JOURNAL_TXN_BLOCKS)
+        checkpoint_log();
+
+    lock_acquire(&journal_lock);
+    committing = false;
+    cond_broadcast(&commit_cond, &journal_lock);
+    lock_release(&journal_lock);
+}
+
+/* Appends TXN to the log: its descriptor and the current images of the
+ * sectors it logged, in one write, then a commit sector, which must not
+ * reach the disk before them. */
+static void write_txn(const struct txn *txn) {
+    struct journal_desc *desc = (struct journal_desc *) log_buf;
+    struct journal_commit *c = data_buf;
+    enum block_cause old_cause = block_set_cause(BLOCK_CAUSE_JOURNAL);
+    unsigned checksum = 0;
+    size_t i;
+
+    ASSERT(head + txn->log_cnt + 2 <= super.size);
+
+    memset(desc, 0, fs_block_size);
+    desc->magic = JOURNAL_DESC_MAGIC;
+    desc->seq = next_seq;
+    desc->cnt = txn->log_cnt;
+    desc->revoke_cnt = txn->revoke_cnt;
+    memcpy(desc->sectors, txn->logged, txn->log_cnt * sizeof *txn->logged);
+    memcpy(desc->sectors + txn->log_cnt, txn->revoked,
+            txn->revoke_cnt * sizeof *txn->revoked);
+
+    for (i = 0; i < txn->log_cnt; i++) {
+        uint8_t *image = log_buf + (i + 1) * fs_block_size;
+        cache_read(txn->logged[i], image);
+        checksum = checksum * 31 + hash_bytes(image, fs_block_size);
+    }
+    fs_block_write_multi(super.start + head, txn->log_cnt + 1, log_buf);
+
+    memset(c, 0, fs_block_size);
+    c->magic = JOURNAL_COMMIT_MAGIC;
+    c->seq = next_seq;
+    c->cnt = txn->log_cnt;
+    c->checksum = checksum;
+    fs_block_write(super.start + head + 1 + txn->log_cnt, c);
+
+    head += txn->log_cnt + 2;
+    next_seq++;
+    block_set_cause(old_cause);
+}
+
+/* Writes every dirty sector home and empties the log.  Only called by
+ * the committing thread with no operation in progress, so no sector is
+ * pinned. */
+static void checkpoint_log(void) {
+    cache_flush();
+    super.seq = next_seq;
+    write_super();
+    bitmap_set_all(logged, false);
+    head = 0;
+}
+
+/* Returns true if the background thread should checkpoint rather than
+ * just commit: a checkpoint was asked for, or the log is half full, or
+ * after one more full transaction could not take the commit that ends a
+ * checkpoint. */
+static bool checkpoint_due(void) {
+    ASSERT(lock_held_by_current_thread(&journal_lock));
+    if (want_checkpoint)
+        return true;
+    if (head == 0 && running.log_cnt == 0)
+        return false;
+    return head > super.size / 2 ||
+        super.size - head < 2 * JOURNAL_TXN_BLOCKS;
+}
+
+/* Asks the background thread to commit, if not asked already. */
+static void kick(void) {
+    ASSERT(lock_held_by_current_thread(&journal_lock));
+    if (!kicked) {
+        kicked = true;
+        sema_up(&daemon_sema);
+    }
+}
+
+/* Reads the transaction at sector POS of the log into DESC_BUF and
+ * returns true if it is complete and has sequence number SEQ. */
+static bool read_txn(uint32_t pos, uint32_t seq) {
+    struct journal_commit *c = data_buf;
+    unsigned checksum = 0, expected;
+    uint32_t cnt, i;
+
+    if (pos + 2 > super.size)
+        return false;
+    fs_block_read(super.start + pos, desc_buf);
+    cnt = desc_buf->cnt;
+    if (desc_buf->magic != JOURNAL_DESC_MAGIC || desc_buf->seq != seq ||
+        cnt > JOURNAL_TXN_MAX || desc_buf->revoke_cnt > JOURNAL_REVOKE_MAX ||
+        pos + cnt + 2 > super.size)
+        return false;
+
+    fs_block_read(super.start + pos + 1 + cnt, c);
+    if (c->magic != JOURNAL_COMMIT_MAGIC || c->seq != seq || c->cnt != cnt)
+        return false;
+    expected = c->checksum;
+    for (i = 0; i < cnt; i++) {
+        fs_block_read(super.start + pos + 1 + i, data_buf);
+        checksum = checksum * 31 + hash_bytes(data_buf, fs_block_size);
+    }
+    return checksum == expected;
+}
+
+/* Returns true if SECTOR, logged by transaction SEQ, was revoked by
+ * that transaction or a later one. */
+static bool is_revoked(const struct revocation *r, size_t cnt,
+        block_sector_t sector, uint32_t seq) {
+    size_t i;
+    for (i = 0; i < cnt; i++) {
+        if (r[i].sector == sector && r[i].seq >= seq)
+            return true;
+    }
+    return false;
+}
+
+/* Replays the committed transactions in the log, then empties it. */
+static void replay(void) {
+    struct revocation *revocations = NULL;
+    enum block_cause old_cause = block_set_cause(BLOCK_CAUSE_JOURNAL);
+    size_t revoke_cnt = 0, i;
+    uint32_t pos, seq, end_seq;
+
+    /* Find the committed transactions and what they revoke. */
+    for (pos = 0, seq = super.seq; read_txn(pos, seq); seq++) {
+        struct revocation *r = realloc(revocations,
+                (revoke_cnt + desc_buf->revoke_cnt) * sizeof *r);
+        if (r == NULL && desc_buf->revoke_cnt > 0)
+            PANIC("journal: out of memory");
+        revocations = r;
+        for (i = 0; i < desc_buf->revoke_cnt; i++) {
+            revocations[revoke_cnt].sector =
+                desc_buf->sectors[desc_buf->cnt + i];
+            revocations[revoke_cnt++].seq = seq;
+        }
+        pos += desc_buf->cnt + 2;
+    }
+    end_seq = seq;
+
+    /* Copy their images home, oldest first. */
+    for (pos = 0, seq = super.seq; seq < end_seq; seq++) {
+        fs_block_read(super.start + pos, desc_buf);
+        for (i = 0; i < desc_buf->cnt; i++) {
+            block_sector_t home = desc_buf->sectors[i];
+            if (is_revoked(revocations, revoke_cnt, home, seq))
+                continue;
+            fs_block_read(super.start + pos + 1 + i, data_buf);
+            fs_block_write(home, data_buf);
+        }
+        pos += desc_buf->cnt + 2;
+    }
+    free(revocations);
+    if (end_seq != super.seq)
+        printf("journal: replayed %"PRIu32" transaction(s).\n",
+               end_seq - super.seq);
+
+    next_seq = end_seq;
+    super.seq = end_seq;
+    write_super();
+    head = 0;
+    block_set_cause(old_cause);
+}
+
+/* Commits the running transaction whenever woken, checkpointing when
+ * the log is filling up.  The bulk of a checkpoint is written before the
+ * commit, while operations carry on. */
+static void journal_daemon(void *aux UNUSED) {
+    for (;;) {
+        bool checkpoint;
+
+        sema_down(&daemon_sema);
+        if (!enabled)
+            continue;
+        lock_acquire(&journal_lock);
+        kicked = false;
+        checkpoint = checkpoint_due();
+        lock_release(&journal_lock);
+        if (checkpoint)
+            cache_flush();
+        commit(checkpoint);
+    }
+}
+
+/* Wakes the background thread every JOURNAL_INTERVAL ticks. */
+static void journal_ticker(void *aux UNUSED) {
+    for (;;) {
+        timer_sleep(JOURNAL_INTERVAL);
+        sema_up(&daemon_sema);
+    }
+}
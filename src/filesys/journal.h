@@ -0,0 +1,24 @@
+#ifndef FILESYS_JOURNAL_H
+#define FILESYS_JOURNAL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "devices/block.h"
+#include "filesys/off_t.h"
+
+/* Formatting, mounting and unmounting. */
+void journal_create(void);
+void journal_open(void);
+void journal_close(void);
+
+/* Grouping the metadata writes of one operation. */
+void journal_begin(void);
+void journal_end(void);
+bool journal_extend(size_t cnt);
+
+/* Metadata updates. */
+void journal_write(block_sector_t sect, const void *source, off_t start,
+        off_t size);
+void journal_revoke(block_sector_t sect, size_t cnt);
+
+#endif /* filesys/journal.h */
@@ -3,6 +3,7 @@
 #include <limits.h>
 #include <round.h>
 #include <stdio.h>
+#include "threads/interrupt.h"
 #include "threads/malloc.h"
 #ifdef FILESYS
 #include "filesys/file.h"
@@ -23,11 +24,21 @@ typedef unsigned long elem_type;
 
 /* From the outside, a bitmap is an array of bits.  From the
    inside, it's an array of elem_type (defined above) that
-   simulates an array of bits. */
+   simulates an array of bits.
+
+   Two summary arrays sit on top of the bits, with one bit per
+   element of BITS.  Bit I of HAS_CLEAR is set if BITS[I] has at
+   least one bit set to false, and bit I of HAS_SET is set if
+   BITS[I] has at least one bit set to true.  bitmap_scan() uses
+   them to step over whole elements, ELEM_BITS * ELEM_BITS bits
+   per summary element, that cannot contain the value it is
+   looking for. */
 struct bitmap
   {
     size_t bit_cnt;     /* Number of bits. */
     elem_type *bits;    /* Elements that represent bits. */
+    elem_type *has_clear; /* Summary: elements with a false bit. */
+    elem_type *has_set;   /* Summary: elements with a true bit. */
   };
 
 /* Returns the index of the element that contains the bit
@@ -60,6 +71,22 @@ byte_cnt (size_t bit_cnt)
   return sizeof (elem_type) * elem_cnt (bit_cnt);
 }
 
+/* Returns the number of summary elements required for BIT_CNT
+   bits. */
+static inline size_t
+summary_cnt (size_t bit_cnt)
+{
+  return elem_cnt (elem_cnt (bit_cnt));
+}
+
+/* Returns the number of bytes required for BIT_CNT bits and
+   both of their summaries. */
+static inline size_t
+total_byte_cnt (size_t bit_cnt)
+{
+  return byte_cnt (bit_cnt) + 2 * sizeof (elem_type) * summary_cnt (bit_cnt);
+}
+
 /* Returns a bit mask in which the bits actually used in the last
    element of B's bits are set to 1 and the rest are set to 0. */
 static inline elem_type
@@ -68,6 +95,81 @@ last_mask (const struct bitmap *b)
   int last_bits = b->bit_cnt % ELEM_BITS;
   return last_bits ? ((elem_type) 1 << last_bits) - 1 : (elem_type) -1;
 }
+
+/* Returns the bits of element IDX in B that are actually used. */
+static inline elem_type
+used_mask (const struct bitmap *b, size_t idx)
+{
+  return idx == elem_cnt (b->bit_cnt) - 1 ? last_mask (b) : (elem_type) -1;
+}
+
+/* Points B's summary arrays into the storage just past its bits. */
+static void
+place_summaries (struct bitmap *b)
+{
+  b->has_clear = b->bits + elem_cnt (b->bit_cnt);
+  b->has_set = b->has_clear + summary_cnt (b->bit_cnt);
+}
+
+/* Recomputes the summary bits of element IDX in B from the
+   element's current contents.  Must be called with interrupts
+   off, so that the summary cannot fall behind a concurrent
+   update of the same element. */
+static void
+update_summary (struct bitmap *b, size_t idx)
+{
+  elem_type used = used_mask (b, idx);
+  elem_type word = b->bits[idx] & used;
+  elem_type mask = bit_mask (idx);
+
+  ASSERT (intr_get_level () == INTR_OFF);
+  if (word != used)
+    b->has_clear[elem_idx (idx)] |= mask;
+  else
+    b->has_clear[elem_idx (idx)] &= ~mask;
+  if (word != 0)
+    b->has_set[elem_idx (idx)] |= mask;
+  else
+    b->has_set[elem_idx (idx)] &= ~mask;
+}
+
+/* Returns the bits of element IDX in B that are set to VALUE.
+   Bits past the end of B are never included. */
+static inline elem_type
+matching_bits (const struct bitmap *b, size_t idx, bool value)
+{
+  elem_type word = value ? b->bits[idx] : ~b->bits[idx];
+  return word & used_mask (b, idx);
+}
+
+/* Returns the index of the first element at or after IDX in B
+   that has at least one bit set to VALUE, or elem_cnt of B's
+   size if there is none.  Consults only the summary, so each
+   summary element skipped passes over ELEM_BITS elements. */
+static size_t
+next_candidate (const struct bitmap *b, size_t idx, bool value)
+{
+  const elem_type *summary = value ? b->has_set : b->has_clear;
+  size_t cnt = elem_cnt (b->bit_cnt);
+  size_t s = elem_idx (idx);
+
+  if (idx >= cnt)
+    return cnt;
+
+  /* Ignore candidates before IDX in its summary element. */
+  elem_type word = summary[s] & ~(bit_mask (idx) - 1);
+  for (;;)
+    {
+      if (word != 0)
+        {
+          size_t found = s * ELEM_BITS + __builtin_ctzl (word);
+          return found < cnt ? found : cnt;
+        }
+      if (++s >= summary_cnt (b->bit_cnt))
+        return cnt;
+      word = summary[s];
+    }
+}
 
 /* Creation and destruction. */
 
@@ -82,9 +184,10 @@ bitmap_create (size_t bit_cnt)
   if (b != NULL)
     {
       b->bit_cnt = bit_cnt;
-      b->bits = malloc (byte_cnt (bit_cnt));
+      b->bits = malloc (total_byte_cnt (bit_cnt));
       if (b->bits != NULL || bit_cnt == 0)
         {
+          place_summaries (b);
           bitmap_set_all (b, false);
           return b;
         }
@@ -105,6 +208,7 @@ bitmap_create_in_buf (size_t bit_cnt, void *block, size_t block_size UNUSED)
 
   b->bit_cnt = bit_cnt;
   b->bits = (elem_type *) (b + 1);
+  place_summaries (b);
   bitmap_set_all (b, false);
   return b;
 }
@@ -114,7 +218,7 @@ bitmap_create_in_buf (size_t bit_cnt, void *block, size_t block_size UNUSED)
 size_t
 bitmap_buf_size (size_t bit_cnt) 
 {
-  return sizeof (struct bitmap) + byte_cnt (bit_cnt);
+  return sizeof (struct bitmap) + total_byte_cnt (bit_cnt);
 }
 
 /* Destroys bitmap B, freeing its storage.
@@ -161,8 +265,12 @@ bitmap_mark (struct bitmap *b, size_t bit_idx)
 
   /* This is equivalent to `b->bits[idx] |= mask' except that it
      is guaranteed to be atomic on a uniprocessor machine.  See
-     the description of the OR instruction in [IA32-v2b]. */
+     the description of the OR instruction in [IA32-v2b].  The
+     summary update must not be separated from it, though. */
+  enum intr_level old_level = intr_disable ();
   asm ("orl %1, %0" : "=m" (b->bits[idx]) : "r" (mask) : "cc");
+  update_summary (b, idx);
+  intr_set_level (old_level);
 }
 
 /* Atomically sets the bit numbered BIT_IDX in B to false. */
@@ -175,7 +283,10 @@ bitmap_reset (struct bitmap *b, size_t bit_idx)
   /* This is equivalent to `b->bits[idx] &= ~mask' except that it
      is guaranteed to be atomic on a uniprocessor machine.  See
      the description of the AND instruction in [IA32-v2a]. */
+  enum intr_level old_level = intr_disable ();
   asm ("andl %1, %0" : "=m" (b->bits[idx]) : "r" (~mask) : "cc");
+  update_summary (b, idx);
+  intr_set_level (old_level);
 }
 
 /* Atomically toggles the bit numbered IDX in B;
@@ -190,7 +301,10 @@ bitmap_flip (struct bitmap *b, size_t bit_idx)
   /* This is equivalent to `b->bits[idx] ^= mask' except that it
      is guaranteed to be atomic on a uniprocessor machine.  See
      the description of the XOR instruction in [IA32-v2b]. */
+  enum intr_level old_level = intr_disable ();
   asm ("xorl %1, %0" : "=m" (b->bits[idx]) : "r" (mask) : "cc");
+  update_summary (b, idx);
+  intr_set_level (old_level);
 }
 
 /* Returns the value of the bit numbered IDX in B. */
@@ -213,18 +327,44 @@ bitmap_set_all (struct bitmap *b, bool value)
   bitmap_set_multiple (b, 0, bitmap_size (b), value);
 }
 
-/* Sets the CNT bits starting at START in B to VALUE. */
+/* Returns a mask of the bits of the element containing bit
+   START that lie in the range [START, END), where END must be
+   greater than START. */
+static inline elem_type
+range_mask (size_t start, size_t end)
+{
+  size_t last = elem_idx (start) * ELEM_BITS + ELEM_BITS;
+  elem_type mask = ~(bit_mask (start) - 1);
+  if (end < last)
+    mask &= bit_mask (end) - 1;
+  return mask;
+}
+
+/* Sets the CNT bits starting at START in B to VALUE.
+   Works an element at a time, so that each element and its
+   summary are updated together. */
 void
 bitmap_set_multiple (struct bitmap *b, size_t start, size_t cnt, bool value) 
 {
-  size_t i;
+  size_t end = start + cnt;
   
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
   ASSERT (start + cnt <= b->bit_cnt);
 
-  for (i = 0; i < cnt; i++)
-    bitmap_set (b, start + i, value);
+  while (start < end)
+    {
+      size_t idx = elem_idx (start);
+      elem_type mask = range_mask (start, end);
+      enum intr_level old_level = intr_disable ();
+      if (value)
+        b->bits[idx] |= mask;
+      else
+        b->bits[idx] &= ~mask;
+      update_summary (b, idx);
+      intr_set_level (old_level);
+      start = (idx + 1) * ELEM_BITS;
+    }
 }
 
 /* Returns the number of bits in B between START and START + CNT,
@@ -232,16 +372,25 @@ bitmap_set_multiple (struct bitmap *b, size_t start, size_t cnt, bool value)
 size_t
 bitmap_count (const struct bitmap *b, size_t start, size_t cnt, bool value) 
 {
-  size_t i, value_cnt;
+  size_t end = start + cnt;
+  size_t value_cnt;
 
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
   ASSERT (start + cnt <= b->bit_cnt);
 
   value_cnt = 0;
-  for (i = 0; i < cnt; i++)
-    if (bitmap_test (b, start + i) == value)
-      value_cnt++;
+  while (start < end)
+    {
+      size_t idx = elem_idx (start);
+      elem_type word = matching_bits (b, idx, value) & range_mask (start, end);
+
+      /* We have no libgcc for __builtin_popcount(), so clear the
+         lowest set bit until none remain. */
+      for (; word != 0; word &= word - 1)
+        value_cnt++;
+      start = (idx + 1) * ELEM_BITS;
+    }
   return value_cnt;
 }
 
@@ -250,15 +399,19 @@ bitmap_count (const struct bitmap *b, size_t start, size_t cnt, bool value)
 bool
 bitmap_contains (const struct bitmap *b, size_t start, size_t cnt, bool value) 
 {
-  size_t i;
+  size_t end = start + cnt;
   
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
   ASSERT (start + cnt <= b->bit_cnt);
 
-  for (i = 0; i < cnt; i++)
-    if (bitmap_test (b, start + i) == value)
-      return true;
+  while (start < end)
+    {
+      size_t idx = elem_idx (start);
+      if (matching_bits (b, idx, value) & range_mask (start, end))
+        return true;
+      start = (idx + 1) * ELEM_BITS;
+    }
   return false;
 }
 
@@ -291,20 +444,88 @@ bitmap_all (const struct bitmap *b, size_t start, size_t cnt)
 /* Finds and returns the starting index of the first group of CNT
    consecutive bits in B at or after START that are all set to
    VALUE.
-   If there is no such group, returns BITMAP_ERROR. */
+   If there is no such group, returns BITMAP_ERROR.
+
+   The scan works an element at a time, using __builtin_ctzl()
+   to jump between runs, and whenever it is not in the middle
+   of a run it consults the summary to skip every element that
+   holds no VALUE bits at all. */
 size_t
 bitmap_scan (const struct bitmap *b, size_t start, size_t cnt, bool value) 
 {
+  size_t pos = start;           /* Next bit to examine. */
+  size_t run_start = start;     /* First bit of the current run. */
+  size_t run = 0;               /* Length of the current run. */
+
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
 
-  if (cnt <= b->bit_cnt) 
+  if (cnt > b->bit_cnt)
+    return BITMAP_ERROR;
+  if (cnt == 0)
+    return start;
+
+  while (pos < b->bit_cnt)
     {
-      size_t last = b->bit_cnt - cnt;
-      size_t i;
-      for (i = start; i <= last; i++)
-        if (!bitmap_contains (b, i, cnt, !value))
-          return i; 
+      size_t idx = elem_idx (pos);
+      size_t avail;
+      elem_type word;
+
+      if (run == 0)
+        {
+          size_t next = next_candidate (b, idx, value);
+          if (next != idx)
+            {
+              if (next >= elem_cnt (b->bit_cnt))
+                break;
+              idx = next;
+              pos = idx * ELEM_BITS;
+            }
+        }
+
+      /* WORD holds the AVAIL bits from POS to the end of the
+         element, with bit 0 corresponding to POS. */
+      word = matching_bits (b, idx, value) >> (pos % ELEM_BITS);
+      avail = ELEM_BITS - pos % ELEM_BITS;
+      if (avail > b->bit_cnt - pos)
+        avail = b->bit_cnt - pos;
+
+      while (avail > 0)
+        {
+          size_t ones;
+
+          if (run == 0)
+            {
+              /* Skip to the start of the next run. */
+              size_t zeros;
+              if (word == 0)
+                {
+                  pos += avail;
+                  break;
+                }
+              zeros = __builtin_ctzl (word);
+              word >>= zeros;
+              pos += zeros;
+              avail -= zeros;
+              run_start = pos;
+            }
+
+          /* Measure the run at the bottom of WORD. */
+          ones = ~word == 0 ? ELEM_BITS : (size_t) __builtin_ctzl (~word);
+          if (ones > avail)
+            ones = avail;
+          run += ones;
+          if (run >= cnt)
+            return run_start;
+          pos += ones;
+          avail -= ones;
+          if (avail == 0)
+            break;
+
+          /* The run was broken before the end of the element. */
+          run = 0;
+          word >>= ones;
+        }
     }
   return BITMAP_ERROR;
 }
@@ -344,8 +565,17 @@ bitmap_read (struct bitmap *b, struct file *file)
   if (b->bit_cnt > 0) 
     {
       off_t size = byte_cnt (b->bit_cnt);
+      enum intr_level old_level;
+      size_t idx;
+
       success = file_read_at (file, b->bits, size, 0) == size;
       b->bits[elem_cnt (b->bit_cnt) - 1] &= last_mask (b);
+
+      /* The summaries are not stored in the file. */
+      old_level = intr_disable ();
+      for (idx = 0; idx < elem_cnt (b->bit_cnt); idx++)
+        update_summary (b, idx);
+      intr_set_level (old_level);
     }
   return success;
 }
@@ -358,6 +588,30 @@ bitmap_write (const struct bitmap *b, struct file *file)
   off_t size = byte_cnt (b->bit_cnt);
   return file_write_at (file, b->bits, size, 0) == size;
 }
+
+/* Writes to FILE only the part of B holding the CNT bits starting
+   at START, rounded out to whole elements.  Returns true if
+   successful, false otherwise. */
+bool
+bitmap_write_range (const struct bitmap *b, struct file *file,
+                    size_t start, size_t cnt)
+{
+  size_t first, last;
+  off_t ofs, size;
+
+  ASSERT (start <= b->bit_cnt);
+  ASSERT (cnt <= b->bit_cnt - start);
+  if (cnt == 0)
+    return true;
+
+  first = elem_idx (start);
+  last = elem_idx (start + cnt - 1);
+  ofs = first * sizeof (elem_type);
+  size = (last - first + 1) * sizeof (elem_type);
+  if (ofs + size > (off_t) byte_cnt (b->bit_cnt))
+    size = byte_cnt (b->bit_cnt) - ofs;
+  return file_write_at (file, b->bits + first, size, ofs) == size;
+}
 #endif /* FILESYS */
 
 /* Debugging. */
@@ -0,0 +1,168 @@
+#include <lz.h>
+#include <debug.h>
+#include <string.h>
+
+/* Token layout: literal run length in the high nibble, back reference
+   length less LZ_MIN_MATCH in the low nibble.  A nibble of 15 is
+   continued in following bytes, each added to it, until one below
+   255. */
+#define NIBBLE_MAX 15
+
+/* Number of bits in a hash table index, matching LZ_WORK_SIZE. */
+#define HASH_BITS 12
+
+/*! Returns the hash table index for the LZ_MIN_MATCH bytes at P. */
+static unsigned int hash(const uint8_t *p) {
+    uint32_t v = p[0] | p[1] << 8 | p[2] << 16 | (uint32_t) p[3] << 24;
+    return (v * 2654435761u) >> (32 - HASH_BITS);
+}
+
+/*! Appends the continuation bytes for length N, the part of a length
+    beyond NIBBLE_MAX, to DST at *OP.  Returns false if they do not fit
+    in CAP bytes. */
+static bool put_length(uint8_t *dst, size_t *op, size_t cap, size_t n) {
+    for (;;) {
+        if (*op >= cap)
+            return false;
+        if (n < 255) {
+            dst[(*op)++] = n;
+            return true;
+        }
+        dst[(*op)++] = 255;
+        n -= 255;
+    }
+}
+
+/*! Appends a token to DST at *OP: LIT_LEN literal bytes from LIT, then,
+    if MATCH_LEN is nonzero, a back reference OFFSET bytes back.
+    Returns false if the token does not fit in CAP bytes. */
+static bool emit(uint8_t *dst, size_t *op, size_t cap, const uint8_t *lit,
+                 size_t lit_len, size_t offset, size_t match_len) {
+    size_t extra = match_len > 0 ? match_len - LZ_MIN_MATCH : 0;
+
+    if (*op >= cap)
+        return false;
+    dst[(*op)++] = (lit_len < NIBBLE_MAX ? lit_len : NIBBLE_MAX) << 4
+                   | (extra < NIBBLE_MAX ? extra : NIBBLE_MAX);
+    if (lit_len >= NIBBLE_MAX
+        && !put_length(dst, op, cap, lit_len - NIBBLE_MAX))
+        return false;
+    if (lit_len > cap - *op)
+        return false;
+    memcpy(dst + *op, lit, lit_len);
+    *op += lit_len;
+
+    if (match_len > 0) {
+        if (cap - *op < 2)
+            return false;
+        dst[(*op)++] = offset & 0xff;
+        dst[(*op)++] = offset >> 8;
+        if (extra >= NIBBLE_MAX
+            && !put_length(dst, op, cap, extra - NIBBLE_MAX))
+            return false;
+    }
+    return true;
+}
+
+/*! Compresses the SRC_SIZE bytes at SRC, which may be at most
+    LZ_MAX_INPUT, into DST, using the LZ_WORK_SIZE bytes at WORK as
+    scratch memory.  Returns the compressed size, or 0 if it would
+    exceed DST_CAP bytes. */
+size_t lz_compress(const void *src_, size_t src_size, void *dst_,
+                   size_t dst_cap, void *work) {
+    const uint8_t *src = src_;
+    uint8_t *dst = dst_;
+    uint16_t *table = work;     /* Last position + 1 with each hash. */
+    size_t ip = 0;              /* Next byte to look for a match at. */
+    size_t anchor = 0;          /* First byte not yet emitted. */
+    size_t op = 0;              /* Bytes of output so far. */
+
+    ASSERT(src_size <= LZ_MAX_INPUT);
+    memset(table, 0, LZ_WORK_SIZE);
+    while (src_size >= LZ_MIN_MATCH && ip <= src_size - LZ_MIN_MATCH) {
+        unsigned int h = hash(src + ip);
+        size_t cand = table[h];
+        size_t len;
+
+        table[h] = ip + 1;
+        if (cand == 0 || memcmp(src + cand - 1, src + ip, LZ_MIN_MATCH)) {
+            ip++;
+            continue;
+        }
+        cand--;
+        len = LZ_MIN_MATCH;
+        while (ip + len < src_size && src[cand + len] == src[ip + len])
+            len++;
+        if (!emit(dst, &op, dst_cap, src + anchor, ip - anchor, ip - cand,
+                  len))
+            return 0;
+        ip += len;
+        anchor = ip;
+    }
+    if (!emit(dst, &op, dst_cap, src + anchor, src_size - anchor, 0, 0))
+        return 0;
+    return op;
+}
+
+/*! Reads the continuation bytes of a length from SRC at *IP, adding
+    them to *N.  Returns false if SRC_SIZE bytes run out first. */
+static bool get_length(const uint8_t *src, size_t *ip, size_t src_size,
+                       size_t *n) {
+    uint8_t b;
+
+    do {
+        if (*ip >= src_size)
+            return false;
+        b = src[(*ip)++];
+        *n += b;
+    } while (b == 255);
+    return true;
+}
+
+/*! Decompresses the SRC_SIZE bytes at SRC into DST.  Returns true if
+    SRC is well formed and expands to exactly DST_SIZE bytes, false
+    otherwise.  Never reads or writes outside the two buffers, whatever
+    SRC holds. */
+bool lz_decompress(const void *src_, size_t src_size, void *dst_,
+                   size_t dst_size) {
+    const uint8_t *src = src_;
+    uint8_t *dst = dst_;
+    size_t ip = 0;
+    size_t op = 0;
+
+    while (ip < src_size) {
+        uint8_t token = src[ip++];
+        size_t lit_len = token >> 4;
+        size_t match_len = (token & NIBBLE_MAX) + LZ_MIN_MATCH;
+        size_t offset;
+
+        if (lit_len == NIBBLE_MAX
+            && !get_length(src, &ip, src_size, &lit_len))
+            return false;
+        if (lit_len > src_size - ip || lit_len > dst_size - op)
+            return false;
+        memcpy(dst + op, src + ip, lit_len);
+        ip += lit_len;
+        op += lit_len;
+
+        /* Only the last token lacks a back reference. */
+        if (ip == src_size)
+            break;
+        if (src_size - ip < 2)
+            return false;
+        offset = src[ip] | src[ip + 1] << 8;
+        ip += 2;
+        if (match_len == NIBBLE_MAX + LZ_MIN_MATCH
+            && !get_length(src, &ip, src_size, &match_len))
+            return false;
+        if (offset == 0 || offset > op || match_len > dst_size - op)
+            return false;
+
+        /* Byte by byte, since the source may overlap the copy. */
+        while (match_len-- > 0) {
+            dst[op] = dst[op - offset];
+            op++;
+        }
+    }
+    return op == dst_size;
+}
@@ -0,0 +1,31 @@
+/*! \file lz.h
+ *
+ * A small LZ77-family compressor, in the style of LZ4.  Compressed data
+ * is a sequence of tokens, each a run of literal bytes followed by a
+ * back reference to at least LZ_MIN_MATCH bytes already produced.  The
+ * last token carries only literals.  Buffers are limited to
+ * LZ_MAX_INPUT bytes, so that back references fit in 16 bits.
+ */
+
+#ifndef __LIB_LZ_H
+#define __LIB_LZ_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*! Largest buffer that can be compressed. */
+#define LZ_MAX_INPUT 65535
+
+/*! Shortest back reference. */
+#define LZ_MIN_MATCH 4
+
+/*! Bytes of scratch memory lz_compress() needs. */
+#define LZ_WORK_SIZE (4096 * sizeof (uint16_t))
+
+size_t lz_compress(const void *src, size_t src_size, void *dst,
+                   size_t dst_cap, void *work);
+bool lz_decompress(const void *src, size_t src_size, void *dst,
+                   size_t dst_size);
+
+#endif /* lib/lz.h */
@@ -34,7 +34,17 @@ enum {
     SYS_MKDIR,                  /*!< Create a directory. */
     SYS_READDIR,                /*!< Reads a directory entry. */
     SYS_ISDIR,                  /*!< Tests if a fd represents a directory. */
-    SYS_INUMBER                 /*!< Returns the inode number for a fd. */
+    SYS_INUMBER,                /*!< Returns the inode number for a fd. */
+    SYS_GETDENTS,               /*!< Reads a batch of directory entries. */
+    SYS_FCNTL,                  /*!< Gets or sets file status flags. */
+    SYS_PREAD,                  /*!< Read from a position in a file. */
+    SYS_PWRITE,                 /*!< Write to a position in a file. */
+    SYS_READV,                  /*!< Read into several buffers. */
+    SYS_WRITEV,                 /*!< Write from several buffers. */
+    SYS_COPY_FILE_RANGE,        /*!< Copy bytes between two files. */
+    SYS_AIO_SETUP,              /*!< Register an asynchronous I/O ring. */
+    SYS_AIO_ENTER,              /*!< Submit and reap asynchronous I/O. */
+    SYS_IOSTAT                  /*!< Print disk I/O statistics. */
 };
 
 #endif /* lib/syscall-nr.h */
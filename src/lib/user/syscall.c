@@ -1,9 +1,9 @@
 /*! \file syscall.c
  *
  * User-space wrappers for invoking system calls through the standard UNIX
- * APIs.  Four macros are defined, syscall0(), syscall1(), syscall2(), and
- * syscall3(), to pass the corresponding number of arguments to the system
- * call being invoked.  The remaining functions are wrappers for standard
+ * APIs.  Five macros are defined, syscall0() through syscall4(), to pass
+ * the corresponding number of arguments to the system call being
+ * invoked.  The remaining functions are wrappers for standard
  * UNIX operations, which simply use the syscall macros to invoke the
  * system call.
  */
@@ -71,6 +71,25 @@
           retval;                                               \
         })
 
+/*! Invokes syscall NUMBER, passing arguments ARG0, ARG1, ARG2, and
+    ARG3, and returns the return value as an `int'. */
+#define syscall4(NUMBER, ARG0, ARG1, ARG2, ARG3)                \
+        ({                                                      \
+          int retval;                                           \
+          asm volatile                                          \
+            ("pushl %[arg3]; pushl %[arg2]; pushl %[arg1]; "    \
+             "pushl %[arg0]; pushl %[number]; int $0x30; "      \
+             "addl $20, %%esp"                                  \
+               : "=a" (retval)                                  \
+               : [number] "i" (NUMBER),                         \
+                 [arg0] "r" (ARG0),                             \
+                 [arg1] "r" (ARG1),                             \
+                 [arg2] "r" (ARG2),                             \
+                 [arg3] "r" (ARG3)                              \
+               : "memory");                                     \
+          retval;                                               \
+        })
+
 void halt(void) {
     syscall0(SYS_HALT);
     NOT_REACHED();
@@ -153,3 +172,73 @@ int inumber(int fd) {
     return syscall1(SYS_INUMBER, fd);
 }
 
+/*! Fills ENTS with up to CNT entries of directory FD, resuming from
+    *COOKIE, which should be 0 for the first call.  Returns the number
+    of entries filled in, 0 at the end of the directory, or -1 if FD is
+    not a directory. */
+int getdents(int fd, struct dirent *ents, unsigned cnt, unsigned *cookie) {
+    return syscall4(SYS_GETDENTS, fd, ents, cnt, cookie);
+}
+
+/*! Gets (F_GETFL) or sets (F_SETFL) the status flags of open file FD,
+    of which O_DIRECT is the only one.  Returns the flags for F_GETFL
+    and 0 for F_SETFL, or -1 on failure. */
+int fcntl(int fd, int cmd, int arg) {
+    return syscall3(SYS_FCNTL, fd, cmd, arg);
+}
+
+/*! Reads LENGTH bytes from FD into BUFFER starting at byte OFFSET,
+    without using or moving the file position.  Returns the number of
+    bytes read, or -1 if FD has no position. */
+int pread(int fd, void *buffer, unsigned length, unsigned offset) {
+    return syscall4(SYS_PREAD, fd, buffer, length, offset);
+}
+
+/*! Writes LENGTH bytes from BUFFER to FD starting at byte OFFSET,
+    without using or moving the file position.  Returns the number of
+    bytes written, or -1 if FD has no position. */
+int pwrite(int fd, const void *buffer, unsigned length, unsigned offset) {
+    return syscall4(SYS_PWRITE, fd, buffer, length, offset);
+}
+
+/*! Reads from FD into the IOVCNT buffers in IOV, filling each in turn,
+    as one read() of their total size would.  Returns the number of
+    bytes read, or -1 if IOVCNT is out of range. */
+int readv(int fd, const struct iovec *iov, int iovcnt) {
+    return syscall3(SYS_READV, fd, iov, iovcnt);
+}
+
+/*! Writes the IOVCNT buffers in IOV to FD in turn, as one write() of
+    their concatenation would.  Returns the number of bytes written, or
+    -1 if IOVCNT is out of range. */
+int writev(int fd, const struct iovec *iov, int iovcnt) {
+    return syscall3(SYS_WRITEV, fd, iov, iovcnt);
+}
+
+/*! Copies LENGTH bytes from IN_FD to OUT_FD, starting at and advancing
+    both file positions, without passing the data through user memory.
+    Returns the number of bytes copied, which is 0 at the end of IN_FD,
+    or -1 if either descriptor is not an ordinary file, the ranges
+    overlap within one file, or nothing could be written to OUT_FD. */
+int copy_file_range(int in_fd, int out_fd, unsigned length) {
+    return syscall3(SYS_COPY_FILE_RANGE, in_fd, out_fd, length);
+}
+
+/*! Registers RING as this process's asynchronous I/O ring, resetting
+    its counters.  Returns 0 if successful or -1 if a ring is already
+    registered or RING crosses a page boundary. */
+int aio_setup(struct aio_ring *ring) {
+    return syscall1(SYS_AIO_SETUP, ring);
+}
+
+/*! Submits every request queued in the ring, then waits until at least
+    MIN_COMPLETE completions are waiting to be consumed.  Returns the
+    number of requests submitted, or -1 if no ring is registered. */
+int aio_enter(unsigned min_complete) {
+    return syscall1(SYS_AIO_ENTER, min_complete);
+}
+
+/*! Prints the disk I/O statistics gathered so far to the console. */
+void iostat(void) {
+    syscall0(SYS_IOSTAT);
+}
@@ -2,6 +2,7 @@
 #define __LIB_USER_SYSCALL_H
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <debug.h>
 
 /*! Process identifier. */
@@ -15,6 +16,73 @@ typedef int mapid_t;
 /*! Maximum characters in a filename written by readdir(). */
 #define READDIR_MAX_LEN 14
 
+/*! A directory entry filled in by getdents(). */
+struct dirent {
+    int inumber;                        /*!< Inode number of the entry. */
+    bool is_dir;                        /*!< Is the entry a directory? */
+    char name[READDIR_MAX_LEN + 1];     /*!< Null terminated file name. */
+};
+
+/*! fcntl() commands. */
+#define F_GETFL 1               /*!< Get file status flags. */
+#define F_SETFL 2               /*!< Set file status flags. */
+#define F_GETATTR 3             /*!< Get file attributes. */
+#define F_SETATTR 4             /*!< Set file attributes. */
+
+/*! File status flags. */
+#define O_DIRECT 0x1            /*!< Move whole blocks without caching. */
+
+/*! File attributes, which belong to the file rather than the open file. */
+#define A_COMPRESS 0x1          /*!< Store the data compressed. */
+
+/*! One buffer of a readv() or writev() call. */
+struct iovec {
+    void *iov_base;             /*!< Start of the buffer. */
+    size_t iov_len;             /*!< Size of the buffer in bytes. */
+};
+
+/*! Maximum number of buffers in one readv() or writev() call. */
+#define IOV_MAX 64
+
+/*! Operations of an asynchronous I/O request. */
+#define AIO_READ 1              /*!< Like pread(). */
+#define AIO_WRITE 2             /*!< Like pwrite(). */
+
+/*! An asynchronous I/O request, queued by the process. */
+struct aio_sqe {
+    int op;                     /*!< AIO_READ or AIO_WRITE. */
+    int fd;                     /*!< Open file to transfer to or from. */
+    void *buf;                  /*!< Buffer in the process. */
+    unsigned size;              /*!< Bytes to transfer. */
+    unsigned offset;            /*!< Byte offset in the file. */
+    unsigned user_data;         /*!< Copied to the completion. */
+};
+
+/*! The completion of an asynchronous I/O request, posted by the kernel. */
+struct aio_cqe {
+    unsigned user_data;         /*!< From the request. */
+    int result;                 /*!< Bytes transferred, or -1. */
+};
+
+/*! Number of entries in each queue of an asynchronous I/O ring. */
+#define AIO_RING_ENTRIES 32
+
+/*! Submission and completion queues shared between a process and the
+    kernel.  Each queue is indexed by free-running counters, taken
+    modulo AIO_RING_ENTRIES.  The process fills sq[sq_tail] and then
+    advances sq_tail; the kernel advances sq_head as it takes requests.
+    The kernel fills cq[cq_tail] and then advances cq_tail; the process
+    advances cq_head as it consumes completions.  The ring must not
+    cross a page boundary. */
+struct aio_ring {
+    volatile unsigned sq_head;  /*!< Next request the kernel takes. */
+    volatile unsigned sq_tail;  /*!< Next free request slot. */
+    volatile unsigned cq_head;  /*!< Next completion the process takes. */
+    volatile unsigned cq_tail;  /*!< Next free completion slot. */
+    struct aio_sqe sq[AIO_RING_ENTRIES];        /*!< Requests. */
+    struct aio_cqe cq[AIO_RING_ENTRIES];        /*!< Completions. */
+};
+
 /*! Typical return values from main() and arguments to exit(). */
 #define EXIT_SUCCESS 0          /*!< Successful execution. */
 #define EXIT_FAILURE 1          /*!< Unsuccessful execution. */
@@ -44,6 +112,16 @@ bool mkdir(const char *dir);
 bool readdir(int fd, char name[READDIR_MAX_LEN + 1]);
 bool isdir(int fd);
 int inumber(int fd);
+int getdents(int fd, struct dirent *, unsigned cnt, unsigned *cookie);
+int fcntl(int fd, int cmd, int arg);
+int pread(int fd, void *buffer, unsigned length, unsigned offset);
+int pwrite(int fd, const void *buffer, unsigned length, unsigned offset);
+int readv(int fd, const struct iovec *iov, int iovcnt);
+int writev(int fd, const struct iovec *iov, int iovcnt);
+int copy_file_range(int in_fd, int out_fd, unsigned length);
+int aio_setup(struct aio_ring *ring);
+int aio_enter(unsigned min_complete);
+void iostat(void);
 
 #endif /* lib/user/syscall.h */
 
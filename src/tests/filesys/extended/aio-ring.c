@@ -0,0 +1,95 @@
+/* Writes a file with a ring of asynchronous requests, then reads it
+   back the same way, closing the descriptor while the reads are still
+   in flight, and checks that a bad request completes with -1. */
+
+#include <random.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define CHUNK_SIZE 1000
+#define CHUNK_CNT 16
+#define FILE_SIZE (CHUNK_SIZE * CHUNK_CNT)
+
+static struct aio_ring ring __attribute__ ((aligned (2048)));
+static char buf[FILE_SIZE];
+static char readback[FILE_SIZE];
+
+/* Queues a request for chunk IDX of BUFFER in the ring. */
+static void
+queue (int op, int fd, char *buffer, int idx)
+{
+  struct aio_sqe *sqe = &ring.sq[ring.sq_tail % AIO_RING_ENTRIES];
+
+  sqe->op = op;
+  sqe->fd = fd;
+  sqe->buf = buffer + idx * CHUNK_SIZE;
+  sqe->size = CHUNK_SIZE;
+  sqe->offset = idx * CHUNK_SIZE;
+  sqe->user_data = idx;
+  ring.sq_tail++;
+}
+
+/* Consumes CNT completions, each of which must report a whole chunk
+   for a distinct chunk index. */
+static void
+reap (int cnt)
+{
+  bool seen[CHUNK_CNT];
+  int i;
+
+  memset (seen, 0, sizeof seen);
+  for (i = 0; i < cnt; i++)
+    {
+      struct aio_cqe *cqe = &ring.cq[ring.cq_head % AIO_RING_ENTRIES];
+
+      if (ring.cq_head == ring.cq_tail)
+        fail ("only %d of %d completions posted", i, cnt);
+      if (cqe->user_data >= CHUNK_CNT || seen[cqe->user_data])
+        fail ("unexpected completion %u", cqe->user_data);
+      if (cqe->result != CHUNK_SIZE)
+        fail ("chunk %u transferred %d bytes", cqe->user_data, cqe->result);
+      seen[cqe->user_data] = true;
+      ring.cq_head++;
+    }
+}
+
+void
+test_main (void) 
+{
+  int fd, i;
+
+  random_bytes (buf, sizeof buf);
+  CHECK (aio_setup (&ring) == 0, "set up ring");
+  CHECK (aio_setup (&ring) == -1, "second ring refused");
+  CHECK (create ("aio", 0), "create \"aio\"");
+  CHECK ((fd = open ("aio")) > 1, "open \"aio\"");
+
+  /* Writes, queued in reverse so that the file grows out of order. */
+  for (i = CHUNK_CNT - 1; i >= 0; i--)
+    queue (AIO_WRITE, fd, buf, i);
+  CHECK (aio_enter (CHUNK_CNT) == CHUNK_CNT, "submit %d writes", CHUNK_CNT);
+  reap (CHUNK_CNT);
+  msg ("reaped %d writes", CHUNK_CNT);
+  check_file ("aio", buf, sizeof buf);
+
+  /* Reads, still in flight when the descriptor is closed. */
+  for (i = 0; i < CHUNK_CNT; i++)
+    queue (AIO_READ, fd, readback, i);
+  CHECK (aio_enter (0) == CHUNK_CNT, "submit %d reads", CHUNK_CNT);
+  msg ("close \"aio\"");
+  close (fd);
+  CHECK (aio_enter (CHUNK_CNT) == 0, "wait for the reads");
+  reap (CHUNK_CNT);
+  msg ("reaped %d reads", CHUNK_CNT);
+  compare_bytes (readback, buf, sizeof buf, 0, "aio");
+
+  /* A request on a closed descriptor fails on its own. */
+  queue (AIO_READ, fd, readback, 0);
+  CHECK (aio_enter (1) == 1, "submit a read of a closed descriptor");
+  CHECK (ring.cq_tail - ring.cq_head == 1
+         && ring.cq[ring.cq_head % AIO_RING_ENTRIES].result == -1,
+         "read failed with -1");
+  ring.cq_head++;
+}
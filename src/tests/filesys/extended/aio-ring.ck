@@ -0,0 +1,24 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(aio-ring) begin
+(aio-ring) set up ring
+(aio-ring) second ring refused
+(aio-ring) create "aio"
+(aio-ring) open "aio"
+(aio-ring) submit 16 writes
+(aio-ring) reaped 16 writes
+(aio-ring) open "aio" for verification
+(aio-ring) verified contents of "aio"
+(aio-ring) close "aio"
+(aio-ring) submit 16 reads
+(aio-ring) close "aio"
+(aio-ring) wait for the reads
+(aio-ring) reaped 16 reads
+(aio-ring) submit a read of a closed descriptor
+(aio-ring) read failed with -1
+(aio-ring) end
+EOF
+pass;
@@ -0,0 +1,10 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+use tests::random;
+my ($text) = "Pintos stores this file a group at a time. ";
+my ($packed) = substr ($text x (12288 / length ($text) + 1), 0, 12288)
+  . random_bytes (8192);
+check_archive ({"packed" => [$packed]});
+pass;
@@ -0,0 +1,62 @@
+/* Sets the compression attribute on a file, writes it in pieces
+   that only partly fill block groups, with both text that
+   compresses well and random data that does not, and verifies
+   the contents, including after rewriting part of a group. */
+
+#include <random.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define TEXT_SIZE 12288
+#define FILE_SIZE (TEXT_SIZE + 8192)
+#define CHUNK_SIZE 1000
+
+static const char text[] = "Pintos stores this file a group at a time. ";
+static char buf[FILE_SIZE];
+static char scratch[CHUNK_SIZE];
+static char readback[CHUNK_SIZE];
+
+void
+test_main (void) 
+{
+  size_t ofs;
+  int fd;
+
+  for (ofs = 0; ofs < TEXT_SIZE; ofs++)
+    buf[ofs] = text[ofs % (sizeof text - 1)];
+  random_bytes (buf + TEXT_SIZE, FILE_SIZE - TEXT_SIZE);
+
+  CHECK (create ("packed", 0), "create \"packed\"");
+  CHECK ((fd = open ("packed")) > 1, "open \"packed\"");
+  CHECK (fcntl (fd, F_GETATTR, 0) == 0, "A_COMPRESS initially clear");
+  CHECK (fcntl (fd, F_SETATTR, A_COMPRESS) == 0, "set A_COMPRESS");
+  CHECK (fcntl (fd, F_GETATTR, 0) == A_COMPRESS, "A_COMPRESS now set");
+  CHECK (fcntl (fd, F_SETATTR, 0) == -1, "A_COMPRESS cannot be cleared");
+
+  msg ("write \"packed\" in %d-byte chunks", CHUNK_SIZE);
+  for (ofs = 0; ofs < FILE_SIZE; ofs += CHUNK_SIZE)
+    {
+      size_t size = FILE_SIZE - ofs;
+      if (size > CHUNK_SIZE)
+        size = CHUNK_SIZE;
+      if (write (fd, buf + ofs, size) != (int) size)
+        fail ("write %zu bytes at offset %zu failed", size, ofs);
+    }
+  check_file ("packed", buf, sizeof buf);
+
+  /* Rewriting part of a group must keep the rest of it. */
+  memset (scratch, 'x', sizeof scratch);
+  CHECK (pwrite (fd, scratch, sizeof scratch, 5000) == sizeof scratch,
+         "overwrite 1000 bytes at 5000");
+  CHECK (pread (fd, readback, sizeof readback, 5000) == sizeof readback,
+         "read them back");
+  compare_bytes (readback, scratch, sizeof readback, 5000, "packed");
+  CHECK (pwrite (fd, buf + 5000, sizeof scratch, 5000) == sizeof scratch,
+         "restore them");
+
+  msg ("close \"packed\"");
+  close (fd);
+  check_file ("packed", buf, sizeof buf);
+}
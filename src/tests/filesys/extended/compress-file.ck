@@ -0,0 +1,26 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(compress-file) begin
+(compress-file) create "packed"
+(compress-file) open "packed"
+(compress-file) A_COMPRESS initially clear
+(compress-file) set A_COMPRESS
+(compress-file) A_COMPRESS now set
+(compress-file) A_COMPRESS cannot be cleared
+(compress-file) write "packed" in 1000-byte chunks
+(compress-file) open "packed" for verification
+(compress-file) verified contents of "packed"
+(compress-file) close "packed"
+(compress-file) overwrite 1000 bytes at 5000
+(compress-file) read them back
+(compress-file) restore them
+(compress-file) close "packed"
+(compress-file) open "packed" for verification
+(compress-file) verified contents of "packed"
+(compress-file) close "packed"
+(compress-file) end
+EOF
+pass;
@@ -0,0 +1,9 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+use tests::random;
+my ($src) = random_bytes (20000);
+my ($dst) = substr ($src, 0, 18000) . substr ($src, 1234, 5000);
+check_archive ({"src" => [$src], "dst" => [$dst]});
+pass;
@@ -0,0 +1,62 @@
+/* Copies a file with copy_file_range(), including a copy that starts
+   part way through the source and one that extends the destination,
+   and checks that an overlapping copy within one file is refused. */
+
+#include <random.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_SIZE 20000
+
+static char buf[FILE_SIZE];
+static char expect[FILE_SIZE + 3000];
+
+void
+test_main (void) 
+{
+  int src_fd, dst_fd;
+  size_t i;
+
+  random_bytes (buf, sizeof buf);
+  CHECK (create ("src", 0), "create \"src\"");
+  CHECK ((src_fd = open ("src")) > 1, "open \"src\"");
+  CHECK (write (src_fd, buf, sizeof buf) == sizeof buf,
+         "write \"src\"");
+  CHECK (create ("dst", 0), "create \"dst\"");
+  CHECK ((dst_fd = open ("dst")) > 1, "open \"dst\"");
+
+  /* The whole file, in pieces that cross block boundaries. */
+  seek (src_fd, 0);
+  CHECK (copy_file_range (src_fd, dst_fd, 7000) == 7000,
+         "copy 7000 bytes");
+  CHECK (copy_file_range (src_fd, dst_fd, FILE_SIZE) == FILE_SIZE - 7000,
+         "copy the remaining %d bytes", FILE_SIZE - 7000);
+  CHECK (copy_file_range (src_fd, dst_fd, FILE_SIZE) == 0,
+         "copy at end of file");
+  CHECK (tell (dst_fd) == FILE_SIZE, "destination position is %d",
+         FILE_SIZE);
+  check_file ("dst", buf, sizeof buf);
+
+  /* An unaligned range that extends the destination. */
+  seek (src_fd, 1234);
+  seek (dst_fd, FILE_SIZE - 2000);
+  CHECK (copy_file_range (src_fd, dst_fd, 5000) == 5000,
+         "copy 5000 bytes from 1234 to %d", FILE_SIZE - 2000);
+  for (i = 0; i < sizeof buf; i++)
+    expect[i] = buf[i];
+  for (i = 0; i < 5000; i++)
+    expect[FILE_SIZE - 2000 + i] = buf[1234 + i];
+
+  /* Overlapping ranges within one file. */
+  seek (src_fd, 0);
+  CHECK (copy_file_range (src_fd, src_fd, 100) == -1,
+         "overlapping copy refused");
+
+  msg ("close \"src\"");
+  close (src_fd);
+  msg ("close \"dst\"");
+  close (dst_fd);
+  check_file ("src", buf, sizeof buf);
+  check_file ("dst", expect, sizeof expect);
+}
@@ -0,0 +1,31 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(copy-range) begin
+(copy-range) create "src"
+(copy-range) open "src"
+(copy-range) write "src"
+(copy-range) create "dst"
+(copy-range) open "dst"
+(copy-range) copy 7000 bytes
+(copy-range) copy the remaining 13000 bytes
+(copy-range) copy at end of file
+(copy-range) destination position is 20000
+(copy-range) open "dst" for verification
+(copy-range) verified contents of "dst"
+(copy-range) close "dst"
+(copy-range) copy 5000 bytes from 1234 to 18000
+(copy-range) overlapping copy refused
+(copy-range) close "src"
+(copy-range) close "dst"
+(copy-range) open "src" for verification
+(copy-range) verified contents of "src"
+(copy-range) close "src"
+(copy-range) open "dst" for verification
+(copy-range) verified contents of "dst"
+(copy-range) close "dst"
+(copy-range) end
+EOF
+pass;
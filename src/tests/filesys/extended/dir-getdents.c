@@ -0,0 +1,84 @@
+/* Lists a directory with getdents(), a few entries per call, and
+   verifies that every entry is returned exactly once with the
+   right type and inode number. */
+
+#include <syscall.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_CNT 30
+
+void
+test_main (void) 
+{
+  bool seen[FILE_CNT];
+  bool seen_sub = false;
+  struct dirent ents[4];
+  unsigned cookie = 0;
+  int sub_inumber;
+  int fd, cnt, total;
+  size_t i;
+
+  CHECK (mkdir ("a"), "mkdir \"a\"");
+  CHECK (mkdir ("a/sub"), "mkdir \"a/sub\"");
+  msg ("creating %d files in \"a\"", FILE_CNT);
+  for (i = 0; i < FILE_CNT; i++)
+    {
+      char name[32];
+      snprintf (name, sizeof name, "a/f%zu", i);
+      if (!create (name, 0))
+        fail ("create \"%s\" failed", name);
+      seen[i] = false;
+    }
+
+  CHECK ((fd = open ("a/sub")) > 1, "open \"a/sub\"");
+  sub_inumber = inumber (fd);
+  close (fd);
+
+  CHECK ((fd = open ("a")) > 1, "open \"a\"");
+  msg ("getdents \"a\"");
+  total = 0;
+  while ((cnt = getdents (fd, ents, 4, &cookie)) > 0)
+    for (i = 0; i < (size_t) cnt; i++)
+      {
+        char expect[32];
+        int n;
+
+        total++;
+        if (!strcmp (ents[i].name, "sub"))
+          {
+            if (seen_sub)
+              fail ("\"sub\" returned twice");
+            if (!ents[i].is_dir)
+              fail ("\"sub\" not reported as a directory");
+            if (ents[i].inumber != sub_inumber)
+              fail ("\"sub\" has inumber %d, expected %d",
+                    ents[i].inumber, sub_inumber);
+            seen_sub = true;
+          }
+        else if (ents[i].name[0] == 'f'
+                 && (n = atoi (ents[i].name + 1)) >= 0 && n < FILE_CNT
+                 && snprintf (expect, sizeof expect, "f%d", n) > 0
+                 && !strcmp (ents[i].name, expect))
+          {
+            if (seen[n])
+              fail ("\"%s\" returned twice", ents[i].name);
+            if (ents[i].is_dir)
+              fail ("\"%s\" reported as a directory", ents[i].name);
+            seen[n] = true;
+          }
+        else
+          fail ("unexpected entry \"%s\"", ents[i].name);
+      }
+  if (cnt < 0)
+    fail ("getdents failed");
+  if (total != FILE_CNT + 1)
+    fail ("getdents returned %d entries, expected %d", total, FILE_CNT + 1);
+  msg ("all entries returned once");
+
+  CHECK (getdents (fd, ents, 4, &cookie) == 0, "getdents at end");
+  close (fd);
+}
@@ -0,0 +1,17 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(dir-getdents) begin
+(dir-getdents) mkdir "a"
+(dir-getdents) mkdir "a/sub"
+(dir-getdents) creating 30 files in "a"
+(dir-getdents) open "a/sub"
+(dir-getdents) open "a"
+(dir-getdents) getdents "a"
+(dir-getdents) all entries returned once
+(dir-getdents) getdents at end
+(dir-getdents) end
+EOF
+pass;
@@ -0,0 +1,20 @@
+/* Tries to create a directory whose name is taken, then creates and
+   opens a file, which may reuse the inode sector freed by the failed
+   mkdir(). */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  int fd;
+
+  CHECK (mkdir ("a"), "mkdir \"a\"");
+  CHECK (!mkdir ("a"), "mkdir \"a\" again (must fail)");
+  CHECK (create ("b", 512), "create \"b\"");
+  CHECK ((fd = open ("b")) > 1, "open \"b\"");
+  CHECK (!isdir (fd), "isdir \"b\" (must be false)");
+  CHECK (filesize (fd) == 512, "filesize \"b\" is 512");
+}
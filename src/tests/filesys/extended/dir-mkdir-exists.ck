@@ -0,0 +1,15 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(dir-mkdir-exists) begin
+(dir-mkdir-exists) mkdir "a"
+(dir-mkdir-exists) mkdir "a" again (must fail)
+(dir-mkdir-exists) create "b"
+(dir-mkdir-exists) open "b"
+(dir-mkdir-exists) isdir "b" (must be false)
+(dir-mkdir-exists) filesize "b" is 512
+(dir-mkdir-exists) end
+EOF
+pass;
@@ -0,0 +1,69 @@
+/* Writes and reads a file with O_DIRECT set, and verifies that
+   direct transfers stay coherent with cached copies of the same
+   blocks in both directions. */
+
+#include <random.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_SIZE 20000
+#define HEAD_SIZE 100
+
+static char buf[FILE_SIZE];
+static char scratch[1024];
+static char readback[1024];
+
+void
+test_main (void) 
+{
+  int direct_fd, cached_fd;
+
+  random_bytes (buf, sizeof buf);
+  CHECK (create ("big", 0), "create \"big\"");
+  CHECK ((direct_fd = open ("big")) > 1, "open \"big\"");
+  CHECK (fcntl (direct_fd, F_GETFL, 0) == 0, "O_DIRECT initially clear");
+  CHECK (fcntl (direct_fd, F_SETFL, O_DIRECT) == 0, "set O_DIRECT");
+  CHECK (fcntl (direct_fd, F_GETFL, 0) == O_DIRECT, "O_DIRECT now set");
+
+  /* An unaligned head, then whole blocks and a partial tail. */
+  CHECK (write (direct_fd, buf, HEAD_SIZE) == HEAD_SIZE,
+         "write %d bytes directly", HEAD_SIZE);
+  CHECK (write (direct_fd, buf + HEAD_SIZE, FILE_SIZE - HEAD_SIZE)
+         == FILE_SIZE - HEAD_SIZE,
+         "write %d bytes directly", FILE_SIZE - HEAD_SIZE);
+  check_file ("big", buf, sizeof buf);
+
+  /* A direct write must not leave a stale cached copy behind. */
+  CHECK ((cached_fd = open ("big")) > 1, "open \"big\" again");
+  memset (scratch, 'x', sizeof scratch);
+  seek (direct_fd, 4096);
+  CHECK (write (direct_fd, scratch, sizeof scratch) == sizeof scratch,
+         "overwrite 1024 bytes at 4096 directly");
+  seek (cached_fd, 4096);
+  CHECK (read (cached_fd, readback, sizeof readback) == sizeof readback,
+         "read them back through the cache");
+  compare_bytes (readback, scratch, sizeof readback, 4096, "big");
+  seek (direct_fd, 4096);
+  CHECK (write (direct_fd, buf + 4096, sizeof scratch) == sizeof scratch,
+         "restore them directly");
+
+  /* A direct read must see data still dirty in the cache. */
+  memset (scratch, 'y', sizeof scratch);
+  seek (cached_fd, 8192);
+  CHECK (write (cached_fd, scratch, sizeof scratch) == sizeof scratch,
+         "overwrite 1024 bytes at 8192 through the cache");
+  seek (direct_fd, 8192);
+  CHECK (read (direct_fd, readback, sizeof readback) == sizeof readback,
+         "read them back directly");
+  compare_bytes (readback, scratch, sizeof readback, 8192, "big");
+  seek (cached_fd, 8192);
+  CHECK (write (cached_fd, buf + 8192, sizeof scratch) == sizeof scratch,
+         "restore them through the cache");
+
+  msg ("close \"big\"");
+  close (cached_fd);
+  close (direct_fd);
+  check_file ("big", buf, sizeof buf);
+}
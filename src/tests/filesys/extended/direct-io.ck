@@ -0,0 +1,30 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(direct-io) begin
+(direct-io) create "big"
+(direct-io) open "big"
+(direct-io) O_DIRECT initially clear
+(direct-io) set O_DIRECT
+(direct-io) O_DIRECT now set
+(direct-io) write 100 bytes directly
+(direct-io) write 19900 bytes directly
+(direct-io) open "big" for verification
+(direct-io) verified contents of "big"
+(direct-io) close "big"
+(direct-io) open "big" again
+(direct-io) overwrite 1024 bytes at 4096 directly
+(direct-io) read them back through the cache
+(direct-io) restore them directly
+(direct-io) overwrite 1024 bytes at 8192 through the cache
+(direct-io) read them back directly
+(direct-io) restore them through the cache
+(direct-io) close "big"
+(direct-io) open "big" for verification
+(direct-io) verified contents of "big"
+(direct-io) close "big"
+(direct-io) end
+EOF
+pass;
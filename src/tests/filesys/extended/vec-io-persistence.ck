@@ -0,0 +1,9 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+use tests::random;
+my ($vec) = random_bytes (9440);
+substr ($vec, 3000, 512) = 'p' x 512;
+check_archive ({"vec" => [$vec]});
+pass;
@@ -0,0 +1,75 @@
+/* Writes a file as many small records with writev() around one large
+   segment, reads it back with readv(), and checks that pread() and
+   pwrite() work at an offset without moving the file position. */
+
+#include <random.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define RECORD_SIZE 37
+#define RECORD_CNT 60
+#define LARGE_SIZE 5000
+#define FILE_SIZE (2 * RECORD_CNT * RECORD_SIZE + LARGE_SIZE)
+
+static char buf[FILE_SIZE];
+static char readback[FILE_SIZE];
+static char scratch[512];
+
+/* Splits BUFFER into IOV as RECORD_CNT records, one LARGE_SIZE segment
+   and RECORD_CNT more records.  Returns the number of segments. */
+static int
+split (char *buffer, struct iovec *iov)
+{
+  int cnt = 0;
+  int i;
+
+  for (i = 0; i < 2 * RECORD_CNT + 1; i++)
+    {
+      iov[cnt].iov_base = buffer;
+      iov[cnt].iov_len = i == RECORD_CNT ? LARGE_SIZE : RECORD_SIZE;
+      buffer += iov[cnt++].iov_len;
+    }
+  return cnt;
+}
+
+void
+test_main (void) 
+{
+  struct iovec iov[2 * RECORD_CNT + 1];
+  int fd, cnt;
+
+  random_bytes (buf, sizeof buf);
+  CHECK (create ("vec", 0), "create \"vec\"");
+  CHECK ((fd = open ("vec")) > 1, "open \"vec\"");
+
+  cnt = split (buf, iov);
+  CHECK (writev (fd, iov, cnt) == FILE_SIZE, "writev %d segments", cnt);
+  CHECK (tell (fd) == FILE_SIZE, "position advanced to %d", FILE_SIZE);
+  check_file ("vec", buf, sizeof buf);
+
+  seek (fd, 0);
+  cnt = split (readback, iov);
+  CHECK (readv (fd, iov, cnt) == FILE_SIZE, "readv %d segments", cnt);
+  compare_bytes (readback, buf, sizeof buf, 0, "vec");
+  CHECK (readv (fd, iov, cnt) == 0, "readv at end of file");
+
+  /* Positional I/O leaves the file position alone. */
+  seek (fd, 100);
+  memset (scratch, 'p', sizeof scratch);
+  CHECK (pwrite (fd, scratch, sizeof scratch, 3000) == sizeof scratch,
+         "pwrite 512 bytes at 3000");
+  memcpy (buf + 3000, scratch, sizeof scratch);
+  CHECK (pread (fd, readback, sizeof scratch, 3000) == sizeof scratch,
+         "pread 512 bytes at 3000");
+  compare_bytes (readback, scratch, sizeof scratch, 3000, "vec");
+  CHECK (pread (fd, readback, sizeof readback, FILE_SIZE - 10) == 10,
+         "pread stops at end of file");
+  CHECK (tell (fd) == 100, "position still 100");
+  CHECK (readv (fd, iov, -1) == -1, "readv rejects a negative count");
+
+  msg ("close \"vec\"");
+  close (fd);
+  check_file ("vec", buf, sizeof buf);
+}
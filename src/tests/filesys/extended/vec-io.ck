@@ -0,0 +1,27 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(vec-io) begin
+(vec-io) create "vec"
+(vec-io) open "vec"
+(vec-io) writev 121 segments
+(vec-io) position advanced to 9440
+(vec-io) open "vec" for verification
+(vec-io) verified contents of "vec"
+(vec-io) close "vec"
+(vec-io) readv 121 segments
+(vec-io) readv at end of file
+(vec-io) pwrite 512 bytes at 3000
+(vec-io) pread 512 bytes at 3000
+(vec-io) pread stops at end of file
+(vec-io) position still 100
+(vec-io) readv rejects a negative count
+(vec-io) close "vec"
+(vec-io) open "vec" for verification
+(vec-io) verified contents of "vec"
+(vec-io) close "vec"
+(vec-io) end
+EOF
+pass;
@@ -0,0 +1,103 @@
+/* Checks bitmap_scan() against a bit-at-a-time reference scan on
+   bitmaps of several sizes and occupancies, then reports how many
+   timer ticks a fixed number of scans takes in each case.
+
+   The timings are informational only: the test passes as long as
+   every scan agrees with the reference. */
+
+#include <bitmap.h>
+#include <random.h>
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/malloc.h"
+#include "devices/timer.h"
+
+/* Number of timed scans per size and occupancy. */
+#define SCAN_ITERS 200
+
+static size_t reference_scan (const struct bitmap *, size_t start,
+                              size_t cnt, bool value);
+static void fill (struct bitmap *, unsigned percent);
+
+void
+test_bitmap_scan (void) 
+{
+  static const size_t sizes[] = {1024, 16384, 131072};
+  static const unsigned percents[] = {0, 50, 90, 99, 100};
+  static const size_t cnts[] = {1, 8, 64};
+  size_t s, p, c, i;
+
+  random_init (0);
+  for (s = 0; s < sizeof sizes / sizeof *sizes; s++)
+    {
+      struct bitmap *b = bitmap_create (sizes[s]);
+      if (b == NULL)
+        fail ("bitmap_create(%zu) failed", sizes[s]);
+
+      for (p = 0; p < sizeof percents / sizeof *percents; p++)
+        {
+          int64_t start_ticks;
+
+          fill (b, percents[p]);
+
+          /* Correctness, from a few starting points. */
+          for (c = 0; c < sizeof cnts / sizeof *cnts; c++)
+            for (i = 0; i < sizes[s]; i += sizes[s] / 8 + 1)
+              {
+                size_t got = bitmap_scan (b, i, cnts[c], false);
+                size_t want = reference_scan (b, i, cnts[c], false);
+                if (got != want)
+                  fail ("size %zu, %u%% full, scan(%zu, %zu): "
+                        "got %zu, expected %zu", sizes[s], percents[p],
+                        i, cnts[c], got, want);
+                got = bitmap_scan (b, i, cnts[c], true);
+                want = reference_scan (b, i, cnts[c], true);
+                if (got != want)
+                  fail ("size %zu, %u%% full, scan for set bits(%zu, %zu): "
+                        "got %zu, expected %zu", sizes[s], percents[p],
+                        i, cnts[c], got, want);
+              }
+
+          /* Timing. */
+          start_ticks = timer_ticks ();
+          for (i = 0; i < SCAN_ITERS; i++)
+            bitmap_scan (b, 0, 1, false);
+          msg ("%zu bits, %u%% full: %d scans in %lld ticks",
+               sizes[s], percents[p], SCAN_ITERS,
+               timer_elapsed (start_ticks));
+        }
+      bitmap_destroy (b);
+    }
+  pass ();
+}
+
+/* Sets PERCENT percent of the bits in B, chosen at random, and
+   clears the rest. */
+static void
+fill (struct bitmap *b, unsigned percent)
+{
+  size_t i;
+
+  for (i = 0; i < bitmap_size (b); i++)
+    bitmap_set (b, i, random_ulong () % 100 < percent);
+}
+
+/* The original bitmap_scan(), which tests one bit at a time. */
+static size_t
+reference_scan (const struct bitmap *b, size_t start, size_t cnt, bool value)
+{
+  if (cnt <= bitmap_size (b))
+    {
+      size_t last = bitmap_size (b) - cnt;
+      size_t i, j;
+      for (i = start; i <= last; i++)
+        {
+          for (j = 0; j < cnt; j++)
+            if (bitmap_test (b, i + j) != value)
+              break;
+          if (j == cnt)
+            return i;
+        }
+    }
+  return BITMAP_ERROR;
+}
@@ -25,6 +25,7 @@
 
 #ifdef USERPROG
 
+#include "userprog/aio.h"
 #include "userprog/process.h"
 #include "userprog/exception.h"
 #include "userprog/gdt.h"
@@ -41,6 +42,11 @@
 
 #include "devices/block.h"
 #include "devices/ide.h"
+#include "devices/pci.h"
+#include "devices/iotrace.h"
+#include "devices/ramdisk.h"
+#include "devices/stripe.h"
+#include "devices/virtio-blk.h"
 #include "filesys/filesys.h"
 #include "filesys/fsutil.h"
 
@@ -53,6 +59,18 @@ uint32_t *init_page_dir;
 /* -f: Format the file system? */
 static bool format_filesys;
 
+/* -ramdisk: Size of RAM disk to create, in kB, or 0 for none. */
+static size_t ramdisk_kb;
+
+/* -iotrace: Number of block requests to trace, or 0 for none. */
+static size_t iotrace_records;
+
+/* -stripe: Names of block devices to stripe md0 across, or null. */
+static const char *stripe_members;
+
+/* -fs-block: Logical block size to format the file system with. */
+static unsigned format_block_size = BLOCK_SECTOR_SIZE;
+
 /* -filesys, -scratch, -swap: Names of block devices to use,
    overriding the defaults. */
 static const char *filesys_bdev_name;
@@ -128,9 +146,19 @@ int main(void) {
 
 #ifdef FILESYS
     /* Initialize file system. */
+    pci_init();
+    iotrace_init(iotrace_records);
     ide_init();
+    virtio_blk_init();
+    if (ramdisk_kb > 0)
+        ramdisk_init(ramdisk_kb);
+    if (stripe_members != NULL)
+        stripe_init(stripe_members);
     locate_block_devices();
-    filesys_init(format_filesys);
+    filesys_init(format_filesys, format_block_size);
+#endif
+#ifdef USERPROG
+    aio_init();
 #endif
 
     printf("Boot complete.\n");
@@ -237,6 +265,18 @@ static char ** parse_options(char **argv) {
 #ifdef FILESYS
         else if (!strcmp(name, "-f"))
             format_filesys = true;
+        else if (!strcmp(name, "-fs-block"))
+            format_block_size = atoi(value);
+        else if (!strcmp(name, "-fs-compress"))
+            fs_compress_files = true;
+        else if (!strcmp(name, "-no-dma"))
+            ide_use_dma = false;
+        else if (!strcmp(name, "-ramdisk"))
+            ramdisk_kb = atoi(value);
+        else if (!strcmp(name, "-stripe"))
+            stripe_members = value;
+        else if (!strcmp(name, "-iotrace"))
+            iotrace_records = atoi(value);
         else if (!strcmp(name, "-filesys"))
             filesys_bdev_name = value;
         else if (!strcmp(name, "-scratch"))
@@ -305,6 +345,10 @@ static void run_actions(char **argv) {
         {"rm", 2, fsutil_rm},
         {"extract", 1, fsutil_extract},
         {"append", 2, fsutil_append},
+        {"bench-open", 1, fsutil_bench_open},
+        {"iostat", 1, fsutil_iostat},
+        {"iotrace", 1, fsutil_iotrace},
+        {"iotrace-save", 1, fsutil_iotrace_save},
 #endif
         {NULL, 0, NULL},
     };
@@ -349,6 +393,10 @@ static void usage(void) {
            "  ls                 List files in the root directory.\n"
            "  cat FILE           Print FILE to the console.\n"
            "  rm FILE            Delete FILE.\n"
+           "  bench-open         Time opening files at path depths 1-16.\n"
+           "  iostat             Print disk I/O statistics so far.\n"
+           "  iotrace            Print the block I/O trace (see -iotrace).\n"
+           "  iotrace-save       Append the block I/O trace to scratch device.\n"
            "Use these actions indirectly via `pintos' -g and -p options:\n"
            "  extract            Untar from scratch device into file system.\n"
            "  append FILE        Append FILE to tar file on scratch device.\n"
@@ -359,6 +407,12 @@ static void usage(void) {
            "  -r                 Reboot after actions.\n"
 #ifdef FILESYS
            "  -f                 Format file system device during startup.\n"
+           "  -fs-block=BYTES    Format with BYTES-byte blocks (512 to 4096).\n"
+           "  -fs-compress       Compress the data of new files.\n"
+           "  -no-dma            Use programmed I/O for IDE disks, not DMA.\n"
+           "  -ramdisk=KB        Create a KB-kB RAM disk named ram0.\n"
+           "  -stripe=BDEV,...   Stripe md0 across the BDEVs, e.g. hdb,hdc.\n"
+           "  -iotrace=N         Trace the last N block requests.\n"
            "  -filesys=BDEV      Use BDEV for file system instead of default.\n"
            "  -scratch=BDEV      Use BDEV for scratch instead of default.\n"
 #ifdef VM
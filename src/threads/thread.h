@@ -128,6 +128,7 @@ struct thread {
     /*! Owned by userprog/process.c. */
     /**@{*/
     uint32_t *pagedir;                  /*!< Page directory. */
+    struct aio_context *aio;            /*!< Asynchronous I/O ring. */
     /**@{*/
 #endif
 
@@ -137,6 +138,14 @@ struct thread {
     // Current directory inode
     struct inode *dir;
 
+    // Nesting depth of journaled file system operations, and the
+    // journal sectors the outermost one may still log.
+    int journal_depth;
+    size_t journal_credits;
+
+    // Why this thread is doing block I/O (enum block_cause).
+    int io_cause;
+
     int nice;  /*!< Nice value for the 4.4BSD Scheduler */
     fixed_point_t recent_cpu; /*!< Recent cpu time used (4.4BSD) */
 
@@ -0,0 +1,338 @@
+/*
+ * Asynchronous I/O rings.
+ *
+ * A process registers a struct aio_ring in its own memory with
+ * aio_setup(), queues read and write requests in the ring's submission
+ * queue, and hands them to the kernel with aio_enter().  Each request is
+ * copied out of the ring and put on a queue shared by AIO_WORKERS kernel
+ * threads, which perform it with file_read_at() or file_write_at() and
+ * post its result to the ring's completion queue.  Because each worker
+ * blocks on its own request, several requests can be waiting on the
+ * disks at once, while the process carries on computing.
+ *
+ * The workers run in their own address space, so they reach the ring
+ * and the process's buffers through the kernel's mapping of the frames
+ * behind them.  Those frames are looked up when the ring is registered
+ * and when each request is submitted, while the process is running and
+ * every page of the buffer must be present.  User frames are never
+ * evicted: they stay mapped from load or allocation until the page
+ * directory is destroyed, so the kernel mappings stay good for as long
+ * as the process does.  A worker's writes through the kernel mapping do
+ * not set the dirty bit in the process's page table, so it sets the bit
+ * itself for each page it reads into.  A request keeps its own struct
+ * file, reopened at submission, so closing the descriptor early is
+ * harmless.  The process cannot go away while it has requests in
+ * flight: aio_destroy(), called on exit before the page directory is
+ * torn down, waits for them to finish.
+ *
+ * The kernel never trusts the counters the process writes: it keeps its
+ * own copies of sq_head and cq_tail, and takes a request only if its
+ * completion is guaranteed a free slot.
+ */
+
+#include "userprog/aio.h"
+#include <debug.h>
+#include <list.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "filesys/file.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/filedes.h"
+#include "userprog/pagedir.h"
+#include "userprog/syscall.h"
+#include "lib/user/syscall.h"
+
+/* Number of worker threads, and so of requests in progress at once. */
+#define AIO_WORKERS 4
+
+/* A process's registered ring. */
+struct aio_context {
+    uint32_t *pagedir;          /* Page directory of the process. */
+    struct aio_ring *ring;      /* Kernel mapping of the ring. */
+    unsigned int sq_head;       /* Next request to take. */
+    unsigned int cq_tail;       /* Next completion slot to fill. */
+    unsigned int inflight;      /* Requests taken but not completed. */
+    struct lock lock;           /* Protects the above and the ring. */
+    struct condition done;      /* Signaled on each completion. */
+};
+
+/* A request taken from a ring. */
+struct aio_request {
+    struct list_elem elem;      /* Element in the request queue. */
+    struct aio_context *ctx;    /* Ring to post the completion to. */
+    struct file *file;          /* Private handle on the file. */
+    int op;                     /* AIO_READ or AIO_WRITE. */
+    uint8_t *buf;               /* User address of the buffer. */
+    uint8_t **pages;            /* Kernel mapping of each page of it. */
+    unsigned int size;          /* Bytes to transfer. */
+    unsigned int offset;        /* Offset in the file. */
+    unsigned int user_data;     /* Copied to the completion. */
+};
+
+/* Requests waiting for a worker. */
+static struct list requests;
+static struct lock requests_lock;
+static struct condition requests_ready;
+
+static void worker(void *aux);
+static bool buffer_valid(const uint8_t *buf, unsigned int size);
+static unsigned int page_cnt(const uint8_t *buf, unsigned int size);
+static bool map_buffer(struct aio_request *);
+static int perform(struct aio_request *);
+static void complete(struct aio_context *, unsigned int user_data,
+                     int result);
+
+/* Starts the workers. */
+void aio_init(void) {
+    int i;
+
+    list_init(&requests);
+    lock_init(&requests_lock);
+    cond_init(&requests_ready);
+    for (i = 0; i < AIO_WORKERS; i++) {
+        char name[16];
+        snprintf(name, sizeof name, "aio%d", i);
+        thread_create(name, PRI_DEFAULT, worker, NULL);
+    }
+}
+
+/* Registers RING, at a user address that has already been checked,
+ * for the current process, and resets its counters.  Returns false if
+ * the process already has a ring or memory runs out. */
+bool aio_register(struct aio_ring *ring) {
+    struct thread *t = thread_current();
+    struct aio_context *ctx;
+
+    if (t->aio != NULL)
+        return false;
+    ctx = malloc(sizeof *ctx);
+    if (ctx == NULL)
+        return false;
+    ctx->pagedir = t->pagedir;
+    ctx->ring = pagedir_get_page(t->pagedir, ring);
+    ctx->sq_head = ctx->cq_tail = ctx->inflight = 0;
+    lock_init(&ctx->lock);
+    cond_init(&ctx->done);
+    ctx->ring->sq_head = ctx->ring->sq_tail = 0;
+    ctx->ring->cq_head = ctx->ring->cq_tail = 0;
+    t->aio = ctx;
+    return true;
+}
+
+/* Takes the requests queued in the current process's ring and hands
+ * them to the workers, stopping early if their completions might not
+ * fit.  A request naming a bad descriptor or a directory completes at
+ * once with result -1; one whose buffer is not all present kills the
+ * process.  Returns the number of requests taken, or -1 if there is no
+ * ring. */
+int aio_submit(void) {
+    struct aio_context *ctx = thread_current()->aio;
+    struct aio_ring *ring;
+    int taken = 0;
+
+    if (ctx == NULL)
+        return -1;
+    ring = ctx->ring;
+
+    lock_acquire(&ctx->lock);
+    while (ctx->sq_head != ring->sq_tail) {
+        struct aio_sqe sqe = ring->sq[ctx->sq_head % AIO_RING_ENTRIES];
+        unsigned int unreaped = ctx->cq_tail - ring->cq_head;
+        struct aio_request *req;
+        struct file *file;
+
+        if (unreaped > AIO_RING_ENTRIES)
+            unreaped = AIO_RING_ENTRIES;
+        if (ctx->inflight + unreaped >= AIO_RING_ENTRIES)
+            break;
+        if (!buffer_valid(sqe.buf, sqe.size)) {
+            lock_release(&ctx->lock);
+            sys_exit(-1);
+        }
+        ctx->sq_head++;
+        ring->sq_head = ctx->sq_head;
+        taken++;
+
+        /* Only ordinary files can be read or written asynchronously. */
+        req = malloc(sizeof *req);
+        file = NULL;
+        if (req != NULL && (sqe.op == AIO_READ || sqe.op == AIO_WRITE) &&
+                sqe.fd != STDIN_FILENO && sqe.fd != STDOUT_FILENO &&
+                fd_valid(sqe.fd) && !sys_isdir(sqe.fd) &&
+                (off_t) sqe.offset >= 0 && (off_t) sqe.size >= 0) {
+            struct file *orig = fd_lookup_file(sqe.fd);
+            file = file_reopen(orig);
+            if (file != NULL)
+                file_set_direct(file, file_is_direct(orig));
+        }
+        if (file != NULL) {
+            req->ctx = ctx;
+            req->buf = sqe.buf;
+            req->size = sqe.size;
+            if (!map_buffer(req)) {
+                file_close(file);
+                file = NULL;
+            }
+        }
+        if (file == NULL) {
+            free(req);
+            ctx->inflight++;
+            complete(ctx, sqe.user_data, -1);
+            continue;
+        }
+
+        req->file = file;
+        req->op = sqe.op;
+        req->offset = sqe.offset;
+        req->user_data = sqe.user_data;
+        ctx->inflight++;
+
+        lock_acquire(&requests_lock);
+        list_push_back(&requests, &req->elem);
+        cond_signal(&requests_ready, &requests_lock);
+        lock_release(&requests_lock);
+    }
+    lock_release(&ctx->lock);
+    return taken;
+}
+
+/* Waits until at least MIN_COMPLETE completions are waiting in the
+ * current process's ring, or until no request is left in flight. */
+void aio_wait(unsigned int min_complete) {
+    struct aio_context *ctx = thread_current()->aio;
+
+    if (ctx == NULL)
+        return;
+    lock_acquire(&ctx->lock);
+    while (ctx->inflight > 0 &&
+           ctx->cq_tail - ctx->ring->cq_head < min_complete)
+        cond_wait(&ctx->done, &ctx->lock);
+    lock_release(&ctx->lock);
+}
+
+/* Waits for the current process's requests to finish and releases its
+ * ring.  Called on exit, before the page directory is destroyed. */
+void aio_destroy(void) {
+    struct thread *t = thread_current();
+    struct aio_context *ctx = t->aio;
+
+    if (ctx == NULL)
+        return;
+    lock_acquire(&ctx->lock);
+    while (ctx->inflight > 0)
+        cond_wait(&ctx->done, &ctx->lock);
+    lock_release(&ctx->lock);
+    t->aio = NULL;
+    free(ctx);
+}
+
+/* Performs queued requests, one at a time. */
+static void worker(void *aux UNUSED) {
+    for (;;) {
+        struct aio_request *req;
+        int result;
+
+        lock_acquire(&requests_lock);
+        while (list_empty(&requests))
+            cond_wait(&requests_ready, &requests_lock);
+        req = list_entry(list_pop_front(&requests), struct aio_request,
+                         elem);
+        lock_release(&requests_lock);
+
+        result = perform(req);
+        free(req->pages);
+        file_close(req->file);
+        lock_acquire(&req->ctx->lock);
+        complete(req->ctx, req->user_data, result);
+        lock_release(&req->ctx->lock);
+        free(req);
+    }
+}
+
+/* Returns whether all SIZE bytes of the user buffer at BUF are
+ * present in the current process's memory. */
+static bool buffer_valid(const uint8_t *buf, unsigned int size) {
+    const uint8_t *end = buf + size - 1;
+    const uint8_t *page;
+
+    if (size == 0)
+        return true;
+    if (end < buf || !mem_valid(buf) || !mem_valid(end))
+        return false;
+    for (page = pg_round_down(buf) + PGSIZE; page < end; page += PGSIZE)
+        if (!mem_valid(page))
+            return false;
+    return true;
+}
+
+/* Returns the number of pages the SIZE bytes at BUF span. */
+static unsigned int page_cnt(const uint8_t *buf, unsigned int size) {
+    return size > 0 ? pg_no(buf + size - 1) - pg_no(buf) + 1 : 0;
+}
+
+/* Looks up the frame behind each page of REQ's buffer, which the
+ * current process must own and which has been checked with
+ * buffer_valid().  Returns false if memory runs out. */
+static bool map_buffer(struct aio_request *req) {
+    unsigned int cnt = page_cnt(req->buf, req->size);
+    uint8_t *upage = pg_round_down(req->buf);
+    unsigned int i;
+
+    req->pages = malloc(cnt * sizeof *req->pages);
+    if (req->pages == NULL && cnt > 0)
+        return false;
+    for (i = 0; i < cnt; i++, upage += PGSIZE) {
+        req->pages[i] = pagedir_get_page(req->ctx->pagedir, upage);
+        ASSERT(req->pages[i] != NULL);
+    }
+    return true;
+}
+
+/* Transfers REQ's data a page of the user buffer at a time, through
+ * the frames looked up at submission.  Returns the number of bytes
+ * transferred. */
+static int perform(struct aio_request *req) {
+    unsigned int done = 0;
+
+    while (done < req->size) {
+        uint8_t *uaddr = req->buf + done;
+        unsigned int page_left = PGSIZE - pg_ofs(uaddr);
+        unsigned int chunk = req->size - done < page_left ?
+            req->size - done : page_left;
+        uint8_t *kaddr = req->pages[pg_no(uaddr) - pg_no(req->buf)]
+            + pg_ofs(uaddr);
+        off_t n;
+
+        if (req->op == AIO_READ) {
+            n = file_read_at(req->file, kaddr, chunk, req->offset + done);
+            if (n > 0)
+                pagedir_set_dirty(req->ctx->pagedir, uaddr, true);
+        } else {
+            n = file_write_at(req->file, kaddr, chunk, req->offset + done);
+        }
+        done += n;
+        if ((unsigned int) n < chunk)
+            break;
+    }
+    return done;
+}
+
+/* Posts a completion with USER_DATA and RESULT to CTX's ring for a
+ * request that was in flight.  CTX's lock must be held. */
+static void complete(struct aio_context *ctx, unsigned int user_data,
+                     int result) {
+    struct aio_cqe *cqe = &ctx->ring->cq[ctx->cq_tail % AIO_RING_ENTRIES];
+
+    ASSERT(lock_held_by_current_thread(&ctx->lock));
+    ASSERT(ctx->inflight > 0);
+    cqe->user_data = user_data;
+    cqe->result = result;
+    barrier();
+    ctx->cq_tail++;
+    ctx->ring->cq_tail = ctx->cq_tail;
+    ctx->inflight--;
+    cond_broadcast(&ctx->done, &ctx->lock);
+}
@@ -0,0 +1,16 @@
+#ifndef USERPROG_AIO_H
+#define USERPROG_AIO_H
+
+#include <stdbool.h>
+
+struct aio_ring;
+
+void aio_init(void);
+
+/* Rings of the current process. */
+bool aio_register(struct aio_ring *ring);
+int aio_submit(void);
+void aio_wait(unsigned int min_complete);
+void aio_destroy(void);
+
+#endif /* userprog/aio.h */
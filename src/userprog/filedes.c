@@ -11,7 +11,6 @@ struct fileordir {
         struct file *f;
         struct dir *d;
     };
-    int count;
 };
 
 static int insert(void *, bool);
@@ -40,8 +39,6 @@ int insert(void *payload, bool is_dir) {
     } else {
         fod->f = payload;
     }
-    // Start the count at 2 to skip . and ..
-    fod->count = 2;
     for (i = STDOUT_FILENO + 1; i < curr->files.size; i++) {
         if (curr->files.data[i] == NULL) {
             curr->files.data[i] = fod;
@@ -110,7 +107,3 @@ bool fd_valid(int fd) {
     return true;
 }
 
-int fd_count_dir(int fd) {
-    struct fileordir *fod = thread_current()->files.data[fd];
-    return fod->count++;
-}
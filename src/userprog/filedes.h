@@ -6,7 +6,6 @@ int fd_insert_dir(struct dir *);
 struct file *fd_lookup_file(int);
 struct dir *fd_lookup_dir(int);
 void fd_clear(int fd);
-int fd_count_dir(int fd);
 
 void fd_init(void);
 void fd_destruct(void);
@@ -10,6 +10,7 @@
 #include "userprog/pagedir.h"
 #include "userprog/tss.h"
 #include "userprog/filedes.h"
+#include "userprog/aio.h"
 #include "filesys/directory.h"
 #include "filesys/file.h"
 #include "filesys/filesys.h"
@@ -216,6 +217,9 @@ void process_exit(void) {
     struct thread *curr = thread_current();
     uint32_t *pd;
 
+    /* Let asynchronous I/O into the process's memory finish. */
+    aio_destroy();
+
     /* Destroy the current process's page directory and switch back
        to the kernel-only page directory. */
     pd = curr->pagedir;
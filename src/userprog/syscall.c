@@ -3,17 +3,22 @@
 #include <syscall-nr.h>
 #include <string.h>
 #include "threads/interrupt.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
 #include "threads/thread.h"
 #include "threads/vaddr.h"
 #include "pagedir.h"
 #include "filesys/file.h"
 #include "filesys/filesys.h"
 #include "filesys/directory.h"
+#include "filesys/inode.h"
+#include "devices/block.h"
 #include "devices/input.h"
 #include "devices/shutdown.h"
 #include "process.h"
 #include "threads/synch.h"
 #include "userprog/filedes.h"
+#include "userprog/aio.h"
 #include "lib/user/syscall.h"
 
 /* Macros to help with arg checking. Checks the pointer to the args
@@ -28,6 +33,17 @@
     (mem_valid((void *) ptr) && \
      mem_valid((void *) ptr + sizeof(type1) + sizeof(type2) + sizeof(type3) \
          - 1))
+#define check_args_4(ptr, type1, type2, type3, type4) \
+    (mem_valid((void *) ptr) && \
+     mem_valid((void *) ptr + sizeof(type1) + sizeof(type2) + sizeof(type3) \
+         + sizeof(type4) - 1))
+
+/* Directory entries sys_getdents() reads from the file system at a time. */
+#define GETDENTS_BATCH 32
+
+/* Size of the buffer sys_readv() and sys_writev() gather small segments
+ * into, so that they reach the file system as one transfer. */
+#define VEC_BUF_SIZE PGSIZE
 
 static void syscall_handler(struct intr_frame *);
 
@@ -47,7 +63,7 @@ static void syscall_handler(struct intr_frame *f) {
     }
 
     int syscall_nr = *((int *) esp);
-    int off1, off2;
+    int off1, off2, off3;
     args = esp + sizeof(int);
 
     // Check that all args are within user memory and call the
@@ -177,6 +193,98 @@ static void syscall_handler(struct intr_frame *f) {
         else
             args_valid = false;
         break;
+    case SYS_GETDENTS:
+        if (check_args_4(args, int, struct dirent *, unsigned int,
+                         unsigned int *)) {
+            off1 = sizeof(int);
+            off2 = off1 + sizeof(struct dirent *);
+            off3 = off2 + sizeof(unsigned int);
+            f->eax = (uint32_t) sys_getdents(*((int *) args),
+                                  *((struct dirent **) (args + off1)),
+                                  *((unsigned int *) (args + off2)),
+                                  *((unsigned int **) (args + off3)));
+        } else
+            args_valid = false;
+        break;
+    case SYS_FCNTL:
+        if (check_args_3(args, int, int, int)) {
+            off1 = sizeof(int);
+            off2 = off1 + sizeof(int);
+            f->eax = (uint32_t) sys_fcntl(*((int *) args),
+                                          *((int *) (args + off1)),
+                                          *((int *) (args + off2)));
+        } else
+            args_valid = false;
+        break;
+    case SYS_PREAD:
+        if (check_args_4(args, int, void *, unsigned int, unsigned int)) {
+            off1 = sizeof(int);
+            off2 = off1 + sizeof(void *);
+            off3 = off2 + sizeof(unsigned int);
+            f->eax = (uint32_t) sys_pread(*((int *) args),
+                                          *((void **) (args + off1)),
+                                          *((unsigned int *) (args + off2)),
+                                          *((unsigned int *) (args + off3)));
+        } else
+            args_valid = false;
+        break;
+    case SYS_PWRITE:
+        if (check_args_4(args, int, void *, unsigned int, unsigned int)) {
+            off1 = sizeof(int);
+            off2 = off1 + sizeof(void *);
+            off3 = off2 + sizeof(unsigned int);
+            f->eax = (uint32_t) sys_pwrite(*((int *) args),
+                                           *((void **) (args + off1)),
+                                           *((unsigned int *) (args + off2)),
+                                           *((unsigned int *) (args + off3)));
+        } else
+            args_valid = false;
+        break;
+    case SYS_READV:
+        if (check_args_3(args, int, struct iovec *, int)) {
+            off1 = sizeof(int);
+            off2 = off1 + sizeof(struct iovec *);
+            f->eax = (uint32_t) sys_readv(*((int *) args),
+                                          *((struct iovec **) (args + off1)),
+                                          *((int *) (args + off2)));
+        } else
+            args_valid = false;
+        break;
+    case SYS_WRITEV:
+        if (check_args_3(args, int, struct iovec *, int)) {
+            off1 = sizeof(int);
+            off2 = off1 + sizeof(struct iovec *);
+            f->eax = (uint32_t) sys_writev(*((int *) args),
+                                           *((struct iovec **) (args + off1)),
+                                           *((int *) (args + off2)));
+        } else
+            args_valid = false;
+        break;
+    case SYS_COPY_FILE_RANGE:
+        if (check_args_3(args, int, int, unsigned int)) {
+            off1 = sizeof(int);
+            off2 = off1 + sizeof(int);
+            f->eax = (uint32_t) sys_copy_file_range(*((int *) args),
+                                    *((int *) (args + off1)),
+                                    *((unsigned int *) (args + off2)));
+        } else
+            args_valid = false;
+        break;
+    case SYS_AIO_SETUP:
+        if (check_args_1(args, struct aio_ring *))
+            f->eax = (uint32_t) sys_aio_setup(*((struct aio_ring **) args));
+        else
+            args_valid = false;
+        break;
+    case SYS_AIO_ENTER:
+        if (check_args_1(args, unsigned int))
+            f->eax = (uint32_t) sys_aio_enter(*((unsigned int *) args));
+        else
+            args_valid = false;
+        break;
+    case SYS_IOSTAT:
+        sys_iostat();
+        break;
     default:
         args_valid = false;
         break;
@@ -409,8 +517,7 @@ bool sys_readdir(int fd, char *name) {
         return false;
     }
     struct dir *dir = fd_lookup_dir(fd);
-    int i = fd_count_dir(fd);
-    return dir_entry_name(dir, i, name);
+    return dir_readdir(dir, name);
 }
 
 bool sys_isdir(int fd) {
@@ -431,3 +538,311 @@ int sys_inumber(int fd) {
     }
     return inode_get_inumber(inode);
 }
+
+/* Fills ENTS with up to CNT entries of directory FD, starting from the
+ * position in *COOKIE, and stores the position after the last entry
+ * back into *COOKIE.  Entries are read from the directory a batch at a
+ * time rather than one call per entry.  Returns the number of entries
+ * filled in, or -1 if FD is not a directory.
+ */
+int sys_getdents(int fd, struct dirent *ents, unsigned int cnt,
+                 unsigned int *cookie) {
+    if (!fd_valid(fd) || !mem_valid(cookie) ||
+            !mem_valid((void *) cookie + sizeof *cookie - 1))
+        sys_exit(-1);
+    if (cnt > 0 && (cnt > UINT32_MAX / sizeof *ents || !mem_valid(ents) ||
+                    !mem_valid((void *) ents + cnt * sizeof *ents - 1)))
+        sys_exit(-1);
+    if (!sys_isdir(fd))
+        return -1;
+
+    struct dir *dir = fd_lookup_dir(fd);
+    struct dir_record *records = malloc(GETDENTS_BATCH * sizeof *records);
+    if (records == NULL)
+        return 0;
+
+    off_t pos = *cookie;
+    unsigned int filled = 0;
+    while (filled < cnt) {
+        size_t want = cnt - filled < GETDENTS_BATCH ?
+            cnt - filled : GETDENTS_BATCH;
+        size_t n = dir_readdir_batch(dir, &pos, records, want);
+        size_t i;
+
+        for (i = 0; i < n; i++, filled++) {
+            ents[filled].inumber = records[i].inumber;
+            ents[filled].is_dir = inode_sector_is_dir(records[i].inumber);
+            strlcpy(ents[filled].name, records[i].name,
+                    sizeof ents[filled].name);
+        }
+        if (n < want)
+            break;
+    }
+    free(records);
+    *cookie = pos;
+    return filled;
+}
+
+/* Gets (F_GETFL) or sets (F_SETFL) the status flags of the open file fd.
+ * The only flag is O_DIRECT, which makes reads and writes of whole blocks
+ * bypass the buffer cache. Also gets (F_GETATTR) or sets (F_SETATTR) the
+ * attributes of the file itself; the only one is A_COMPRESS, which cannot
+ * be cleared once set. Returns the flags or attributes for the get
+ * commands and 0 for the set commands, or -1 if fd is a directory or cmd
+ * or arg is not supported.
+ */
+int sys_fcntl(int fd, int cmd, int arg) {
+    if (fd == STDIN_FILENO || fd == STDOUT_FILENO || !fd_valid(fd))
+        sys_exit(-1);
+    if (sys_isdir(fd))
+        return -1;
+
+    struct file *file = fd_lookup_file(fd);
+    switch (cmd) {
+    case F_GETFL:
+        return file_is_direct(file) ? O_DIRECT : 0;
+    case F_SETFL:
+        if (arg & ~O_DIRECT)
+            return -1;
+        file_set_direct(file, arg & O_DIRECT);
+        return 0;
+    case F_GETATTR:
+        return inode_is_compressed(file_get_inode(file)) ? A_COMPRESS : 0;
+    case F_SETATTR:
+        if (arg & ~A_COMPRESS)
+            return -1;
+        if (arg & A_COMPRESS)
+            return inode_set_compressed(file_get_inode(file)) ? 0 : -1;
+        return inode_is_compressed(file_get_inode(file)) ? -1 : 0;
+    default:
+        return -1;
+    }
+}
+
+/* Reads size bytes from the file fd into buffer, starting at byte offset
+ * in the file rather than at the file's position, which is left alone.
+ * Returns the number of bytes actually read, or -1 if fd is the console
+ * or offset is out of range.
+ */
+int sys_pread(int fd, void *buffer, unsigned int size, unsigned int offset) {
+    if (!mem_valid(buffer) || !mem_valid(buffer + size - 1) ||
+            !fd_valid(fd) || sys_isdir(fd))
+        sys_exit(-1);
+    if (fd == STDIN_FILENO || fd == STDOUT_FILENO || (off_t) offset < 0)
+        return -1;
+
+    struct file *file = fd_lookup_file(fd);
+    return (int) file_read_at(file, buffer, size, offset);
+}
+
+/* Writes size bytes from buffer into the file fd, starting at byte offset
+ * in the file rather than at the file's position, which is left alone.
+ * Returns the number of bytes actually written, or -1 if fd is the
+ * console or offset is out of range.
+ */
+int sys_pwrite(int fd, const void *buffer, unsigned int size,
+               unsigned int offset) {
+    if (!mem_valid(buffer) || !mem_valid(buffer + size - 1) ||
+            !fd_valid(fd) || sys_isdir(fd))
+        sys_exit(-1);
+    if (fd == STDIN_FILENO || fd == STDOUT_FILENO || (off_t) offset < 0)
+        return -1;
+
+    struct file *file = fd_lookup_file(fd);
+    return (int) file_write_at(file, buffer, size, offset);
+}
+
+/* Checks the iovcnt segments of iov, terminating the process if any of
+ * them lies outside user memory. Returns false if iovcnt is out of range
+ * or the segments add up to more than an int can report.
+ */
+static bool iov_valid(const struct iovec *iov, int iovcnt) {
+    size_t total = 0;
+    int i;
+
+    if (iovcnt < 0 || iovcnt > IOV_MAX)
+        return false;
+    if (iovcnt > 0 && (!mem_valid(iov) ||
+                       !mem_valid((void *) iov + iovcnt * sizeof *iov - 1)))
+        sys_exit(-1);
+    for (i = 0; i < iovcnt; i++) {
+        if (iov[i].iov_len == 0)
+            continue;
+        if (!mem_valid(iov[i].iov_base) ||
+                !mem_valid(iov[i].iov_base + iov[i].iov_len - 1))
+            sys_exit(-1);
+        if (iov[i].iov_len > INT32_MAX - total)
+            return false;
+        total += iov[i].iov_len;
+    }
+    return true;
+}
+
+/* Reads size bytes from fd at its current position into buffer. */
+static size_t vec_get(int fd, void *buffer, size_t size) {
+    size_t i;
+
+    if (fd != STDIN_FILENO)
+        return file_read(fd_lookup_file(fd), buffer, size);
+    for (i = 0; i < size; i++)
+        ((char *) buffer)[i] = input_getc();
+    return size;
+}
+
+/* Writes size bytes from buffer to fd at its current position. */
+static size_t vec_put(int fd, const void *buffer, size_t size) {
+    if (fd != STDOUT_FILENO)
+        return file_write(fd_lookup_file(fd), buffer, size);
+    putbuf(buffer, size);
+    return size;
+}
+
+/* Reads from the file fd into the iovcnt segments of iov in turn.
+ * Consecutive segments smaller than VEC_BUF_SIZE are filled from a single
+ * read into a kernel buffer, so many small records cost one trip through
+ * the file system. Returns the number of bytes read, which is short only
+ * at end of file, or -1 if iovcnt is out of range.
+ */
+int sys_readv(int fd, const struct iovec *iov, int iovcnt) {
+    if (fd == STDOUT_FILENO || !fd_valid(fd) || sys_isdir(fd))
+        sys_exit(-1);
+    if (!iov_valid(iov, iovcnt))
+        return -1;
+
+    char *buf = palloc_get_page(0);
+    int total = 0;
+    int i = 0;
+    while (i < iovcnt) {
+        size_t want, got;
+
+        if (buf == NULL || iov[i].iov_len >= VEC_BUF_SIZE) {
+            /* Large segments go straight into the user's buffer. */
+            want = iov[i].iov_len;
+            got = vec_get(fd, iov[i].iov_base, want);
+            i++;
+        } else {
+            /* Read the run of small segments that fits, then scatter. */
+            size_t copied = 0;
+            int end = i;
+
+            for (want = 0; end < iovcnt &&
+                     want + iov[end].iov_len <= VEC_BUF_SIZE; end++)
+                want += iov[end].iov_len;
+            got = vec_get(fd, buf, want);
+            for (; i < end && copied < got; i++) {
+                size_t n = iov[i].iov_len < got - copied ?
+                    iov[i].iov_len : got - copied;
+                memcpy(iov[i].iov_base, buf + copied, n);
+                copied += n;
+            }
+            i = end;
+        }
+        total += got;
+        if (got < want)
+            break;
+    }
+    palloc_free_page(buf);
+    return total;
+}
+
+/* Writes the iovcnt segments of iov to the file fd in turn. Consecutive
+ * segments smaller than VEC_BUF_SIZE are gathered into a kernel buffer
+ * and written with a single call, so many small records cost one trip
+ * through the file system. Returns the number of bytes written, or -1 if
+ * iovcnt is out of range.
+ */
+int sys_writev(int fd, const struct iovec *iov, int iovcnt) {
+    if (fd == STDIN_FILENO || !fd_valid(fd) || sys_isdir(fd))
+        sys_exit(-1);
+    if (!iov_valid(iov, iovcnt))
+        return -1;
+
+    char *buf = palloc_get_page(0);
+    size_t used = 0;
+    int total = 0;
+    int i;
+    for (i = 0; i < iovcnt; i++) {
+        size_t len = iov[i].iov_len;
+        bool gather = buf != NULL && len < VEC_BUF_SIZE;
+
+        /* Flush the gathered segments once this one cannot join them. */
+        if (used > 0 && (!gather || used + len > VEC_BUF_SIZE)) {
+            size_t put = vec_put(fd, buf, used);
+            bool short_write = put < used;
+
+            total += put;
+            used = 0;
+            if (short_write)
+                break;
+        }
+
+        if (gather) {
+            memcpy(buf + used, iov[i].iov_base, len);
+            used += len;
+        } else {
+            /* Large segments go straight from the user's buffer. */
+            size_t put = vec_put(fd, iov[i].iov_base, len);
+
+            total += put;
+            if (put < len)
+                break;
+        }
+    }
+    if (used > 0)
+        total += vec_put(fd, buf, used);
+    palloc_free_page(buf);
+    return total;
+}
+
+/* Copies size bytes from the file in_fd to the file out_fd, starting at
+ * and advancing the current position of each, without the data passing
+ * through user memory. Returns the number of bytes copied, which is 0 at
+ * the end of in_fd, or -1 if either fd is the console or a directory, if
+ * both name the same file and the two ranges overlap, or if nothing
+ * could be written to out_fd.
+ */
+int sys_copy_file_range(int in_fd, int out_fd, unsigned int size) {
+    if (!fd_valid(in_fd) || !fd_valid(out_fd))
+        sys_exit(-1);
+    if (in_fd == STDIN_FILENO || in_fd == STDOUT_FILENO ||
+            out_fd == STDIN_FILENO || out_fd == STDOUT_FILENO ||
+            sys_isdir(in_fd) || sys_isdir(out_fd))
+        return -1;
+    if (size > INT32_MAX)
+        size = INT32_MAX;
+
+    return file_copy(fd_lookup_file(out_fd), fd_lookup_file(in_fd), size);
+}
+
+/* Registers ring as the process's asynchronous I/O ring. Returns 0 on
+ * success, or -1 if the process already has a ring or ring crosses a
+ * page boundary.
+ */
+int sys_aio_setup(struct aio_ring *ring) {
+    void *end = (void *) ring + sizeof *ring - 1;
+
+    if (!mem_valid(ring) || !mem_valid(end))
+        sys_exit(-1);
+    if (pg_no(ring) != pg_no(end))
+        return -1;
+    return aio_register(ring) ? 0 : -1;
+}
+
+/* Submits the requests queued in the process's asynchronous I/O ring,
+ * then waits until at least min_complete completions are waiting in it,
+ * or nothing is left in flight. Returns the number of requests
+ * submitted, or -1 if the process has no ring.
+ */
+int sys_aio_enter(unsigned int min_complete) {
+    int submitted = aio_submit();
+    if (submitted >= 0)
+        aio_wait(min_complete);
+    return submitted;
+}
+
+/* Prints the disk I/O statistics gathered so far, as the "iostat" kernel
+ * action does, so that they can be watched while programs run.
+ */
+void sys_iostat(void) {
+    block_print_io_stats();
+}
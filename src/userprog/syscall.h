@@ -5,6 +5,10 @@
 #include <stdbool.h>
 #include "threads/thread.h"
 
+struct dirent;
+struct iovec;
+struct aio_ring;
+
 void syscall_init(void);
 
 /* System calls. */
@@ -29,6 +33,18 @@ bool sys_mkdir(const char *dir);
 bool sys_readdir(int fd, char *name);
 bool sys_isdir(int fd);
 int sys_inumber(int fd);
+int sys_getdents(int fd, struct dirent *ents, unsigned int cnt,
+                 unsigned int *cookie);
+int sys_fcntl(int fd, int cmd, int arg);
+int sys_pread(int fd, void *buffer, unsigned int size, unsigned int offset);
+int sys_pwrite(int fd, const void *buffer, unsigned int size,
+               unsigned int offset);
+int sys_readv(int fd, const struct iovec *iov, int iovcnt);
+int sys_writev(int fd, const struct iovec *iov, int iovcnt);
+int sys_copy_file_range(int in_fd, int out_fd, unsigned int size);
+int sys_aio_setup(struct aio_ring *ring);
+int sys_aio_enter(unsigned int min_complete);
+void sys_iostat(void);
 
 /* Checks if memory address is valid. */
 bool mem_valid(const void *addr);
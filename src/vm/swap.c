@@ -41,13 +41,10 @@ void swap_free_and_read(void *vaddr, slotid_t swap_slot) {
     /* Check that the block being freed is in use. */
     ASSERT(bitmap_test(swap_table, swap_slot));
     block_sector_t sect = slot_to_sect(swap_slot);
-    /* Read enough sectors from the disk for one page. */
-    int i;
-    for (i = 0; i < PGSIZE / BLOCK_SECTOR_SIZE; i++) {
-        block_read(swap_dev, sect, vaddr);
-        vaddr += BLOCK_SECTOR_SIZE;
-        sect += 1;
-    }
+    /* Read the page's sectors from the disk in one request. */
+    enum block_cause old_cause = block_set_cause(BLOCK_CAUSE_SWAP_IN);
+    block_read_multi(swap_dev, sect, PGSIZE / BLOCK_SECTOR_SIZE, vaddr);
+    block_set_cause(old_cause);
     bitmap_reset(swap_table, swap_slot);
     lock_release(&swap_table_lock);
 }
@@ -77,13 +74,11 @@ slotid_t swap_swalloc_and_write(void *vaddr) {
     if (out == BITMAP_ERROR)
         PANIC("Out of swap slots, could not swalloc.");
     block_sector_t sect = slot_to_sect(out);
-    /* Write the page out over several sectors of the partition. */
-    int i;
-    for (i = 0; i < PGSIZE / BLOCK_SECTOR_SIZE; i++) {
-        block_write(swap_dev, sect, vaddr);
-        vaddr += BLOCK_SECTOR_SIZE;
-        sect += 1;
-    }
+    /* Write the page out over several sectors of the partition, in one
+       request. */
+    enum block_cause old_cause = block_set_cause(BLOCK_CAUSE_SWAP_OUT);
+    block_write_multi(swap_dev, sect, PGSIZE / BLOCK_SECTOR_SIZE, vaddr);
+    block_set_cause(old_cause);
     lock_release(&swap_table_lock);
     return out;
 }